@@ -1,3 +1,8 @@
+#include "nuis/HEPData/HTTPClient.h"
+#include "nuis/HEPData/PredictionValidation.h"
+#include "nuis/HEPData/RecordCache.h"
+#include "nuis/HEPData/RecordIndex.h"
+#include "nuis/HEPData/RecordServer.h"
 #include "nuis/HEPData/ReferenceResolver.h"
 #include "nuis/HEPData/TableFactory.h"
 #include "nuis/HEPData/YAMLConverters.h"
@@ -7,9 +12,15 @@
 #include "fmt/core.h"
 #include "spdlog/spdlog.h"
 
-#include "yaml-cpp/yaml.h"
-
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <csignal>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <utility>
 
 static const char USAGE[] =
     R"(nuis-hepdata
@@ -23,21 +34,112 @@ static const char USAGE[] =
       nuis-hepdata [options] get-qualifiers <ref> [<key>]
       nuis-hepdata [options] dereference-to-local-path <ref> <key>
       nuis-hepdata [options] get-local-additional-resources <ref>
+      nuis-hepdata [options] batch [<file>]
+      nuis-hepdata [options] serve <socket> [<preload>...]
+      nuis-hepdata [options] cache dedup
+      nuis-hepdata [options] cache gc --max-size=<size>
+      nuis-hepdata [options] cache index
+      nuis-hepdata [options] query [<condition>...]
+      nuis-hepdata [options] verify-predictions [<record>...]
       nuis-hepdata help
 
     Options:
       --nuisancedb=<path>   Use <path> as the record database root.
       --debug               Enable logging for any http requests.
       --path                Interpret <ref> as a local path reference
-    
-
-    <ref> arguments are of one of two forms depending on the --path switch: 
+      --ndjson              In batch mode, write one JSON object per command.
+      --endpoints=<urls>    Comma-separated list of record endpoints to fetch
+                            missing records from, tried in order. Either
+                            HEPData-like http(s) URLs or file:// mirrors.
+      --incremental         Fetch only the files of a record that are needed,
+                            as they are referenced, rather than the whole
+                            record archive.
+      --archive             Keep fetched records as their submission.zip
+                            archive and read files directly from it.
+      --dedup               Store each distinct file of fetched records once and
+                            keep parsed snapshots of tables, see cache dedup.
+      --connect-timeout=<s> Give up connecting to a record endpoint after <s>
+                            seconds. Defaults to 10.
+      --timeout=<s>         Give up on any single request to a record endpoint
+                            after <s> seconds, 0 to wait indefinitely.
+                            Defaults to 600.
+      --max-size=<size>     Size to shrink the record database to with cache gc,
+                            in bytes or with a K, M, G, or T suffix.
+      --min-age=<s>         Never evict records used within the last <s>
+                            seconds with cache gc. Defaults to 3600.
+      --tolerance=<t>       Relative tolerance on test statistics checked by
+                            verify-predictions. Defaults to 1E-3.
+      --workers=<n>         Number of threads to verify records on, defaults
+                            to one per core.
+
+
+    <ref> arguments are of one of two forms depending on the --path switch:
       repository reference) [type:]<id>[/resource[:qualifier]]
       local path reference) /path/to/submission[:resource[:qualifier]]
     The <comp> argument can be one of: type, id, resource, or qualifier
     <key> arguments correspond to a specific HEPData qualifier key to reference
+
+    batch reads commands from <file>, or stdin if no file is given, one per
+    line, and answers them in a single process. Each line takes the same form
+    as the arguments to a single nuis-hepdata invocation, e.g.
+      get-qualifiers --path /path/to/submission:cross_section probe_flux
+    Blank lines and lines starting with # are skipped. Resolved references,
+    table metadata, and records are cached between commands.
+
+    serve keeps records loaded in memory and hands them to clients that
+    connect to the unix domain socket at <socket>, see
+    nuis/HEPData/RecordServer.h for the client API. Records referenced by
+    <preload> arguments are loaded before the server starts listening. The
+    server runs until interrupted.
+
+    cache dedup replaces each file in the record database with a hard link to
+    a single stored copy of its content, so files that are identical between
+    records, e.g. between versions of the same record, are only stored once.
+    With --dedup, newly fetched records are deduplicated as they are fetched.
+
+    cache gc evicts the least recently used records, and table snapshots, from
+    the record database until it fits in --max-size. It is safe to run while
+    other processes are using the database, records they have used recently are
+    kept and evicted records are fetched again if they are needed.
+
+    query lists references to the dependent variables of every table in the
+    record database that satisfy all of the <condition>s, each of the form
+    key=value, e.g.
+      query variable_type=cross_section_measurement target=Ar
+    Keys can be record, table, resource, name, variable_type, target,
+    probe_particle, measurement_type, test_statistic, or any other qualifier.
+    It reads only the record index, which is updated as records are fetched.
+    cache index rebuilds the index from every record in the database.
+
+    verify-predictions recomputes the test statistic between each measurement
+    and the predictions attached to it, smearing predictions that are not
+    pre_smeared, and compares it to the prediction's expected_test_statistic.
+    It checks each <record> reference, or every record in the database if
+    none are given, and prints one line per prediction followed by a summary.
 )";
 
+// Parses sizes like 500M or 10G, with binary multiples.
+uintmax_t parse_size(std::string const &size) {
+  size_t pos = 0;
+  double value = 0;
+  try {
+    value = std::stod(size, &pos);
+  } catch (std::exception const &) {
+    pos = 0;
+  }
+  std::string suffix = size.substr(pos);
+  static std::map<std::string, uintmax_t> const multiples = {
+      {"", 1},
+      {"K", uintmax_t(1) << 10},
+      {"M", uintmax_t(1) << 20},
+      {"G", uintmax_t(1) << 30},
+      {"T", uintmax_t(1) << 40}};
+  if (!pos || (value < 0) || !multiples.count(suffix)) {
+    throw std::runtime_error(fmt::format("Invalid size: {}", size));
+  }
+  return uintmax_t(value * multiples.at(suffix));
+}
+
 std::vector<std::string> split_spec(std::string specstring) {
   std::vector<std::string> splits;
 
@@ -56,14 +158,124 @@ std::vector<std::string> split_spec(std::string specstring) {
   return splits;
 }
 
+// splits a batch command line on whitespace, single or double quotes can be
+// used to keep whitespace within an argument
+std::vector<std::string> split_command(std::string const &line) {
+  std::vector<std::string> tokens;
+  std::string tok;
+  bool in_token = false;
+  char quote = 0;
+
+  for (char c : line) {
+    if (quote) {
+      if (c == quote) {
+        quote = 0;
+      } else {
+        tok.push_back(c);
+      }
+    } else if ((c == '\'') || (c == '"')) {
+      quote = c;
+      in_token = true;
+    } else if (std::isspace(static_cast<unsigned char>(c))) {
+      if (in_token) {
+        tokens.push_back(std::move(tok));
+        tok.clear();
+        in_token = false;
+      }
+    } else {
+      tok.push_back(c);
+      in_token = true;
+    }
+  }
+
+  if (quote) {
+    throw std::runtime_error(
+        fmt::format("unterminated quote in command: {}", line));
+  }
+  if (in_token) {
+    tokens.push_back(std::move(tok));
+  }
+  return tokens;
+}
+
+std::string json_string(std::string const &str) {
+  std::string out = "\"";
+  for (char c : str) {
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\r':
+      out += "\\r";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        out += fmt::format("\\u{:04x}", int(c));
+      } else {
+        out.push_back(c);
+      }
+    }
+  }
+  out.push_back('"');
+  return out;
+}
+
 using namespace nuis::HEPData;
 
-int main(int argc, const char **argv) {
-  std::map<std::string, docopt::value> args =
-      docopt::docopt(USAGE, {argv + 1, argv + argc},
-                     true,                // show help if requested
-                     "nuis-hepdata 0.9"); // version string
+// Results that are reused between commands in batch mode. Single invocations
+// go through the same caches, they just never get a second lookup.
+struct Caches {
+  using key_t = std::pair<std::filesystem::path, std::string>;
+
+  std::map<key_t, std::filesystem::path> local_paths;
+  std::map<std::filesystem::path, Table> table_metadata;
+  std::map<key_t, Record> records;
+
+  std::filesystem::path const &
+  resolve(ResourceReference const &ref,
+          std::filesystem::path const &local_cache_root) {
+    key_t key{local_cache_root, ref.str()};
+    auto it = local_paths.find(key);
+    if (it == local_paths.end()) {
+      it = local_paths
+               .emplace(key, resolve_reference(ref, local_cache_root))
+               .first;
+    }
+    return it->second;
+  }
 
+  Table const &metadata(ResourceReference const &ref,
+                        std::filesystem::path const &local_cache_root) {
+    auto const &source = resolve(ref, local_cache_root);
+    auto it = table_metadata.find(source);
+    if (it == table_metadata.end()) {
+      it = table_metadata.emplace(source, load_Table_metadata(source)).first;
+    }
+    return it->second;
+  }
+
+  Record const &record(ResourceReference const &ref,
+                       std::filesystem::path const &local_cache_root) {
+    key_t key{local_cache_root, ref.record_ref().str()};
+    auto it = records.find(key);
+    if (it == records.end()) {
+      it = records.emplace(key, make_Record(ref, local_cache_root)).first;
+    }
+    return it->second;
+  }
+};
+
+std::filesystem::path
+get_local_cache_root(std::map<std::string, docopt::value> &args) {
   std::filesystem::path local_cache_root = ".";
   if (args["--nuisancedb"]) {
     local_cache_root = args["--nuisancedb"].asString();
@@ -86,10 +298,6 @@ int main(int argc, const char **argv) {
     }
   }
 
-  if (args["--debug"].asBool()) {
-    spdlog::set_level(spdlog::level::debug);
-  }
-
   if (!std::filesystem::exists(local_cache_root)) {
     throw std::runtime_error(fmt::format(
         "record database root directory: {}, does not exist. If this location "
@@ -97,6 +305,111 @@ int main(int argc, const char **argv) {
         local_cache_root.native()));
   }
 
+  return local_cache_root;
+}
+
+// Runs a single non-batch command and returns its output lines.
+std::vector<std::string> run_command(std::map<std::string, docopt::value> &args,
+                                     Caches &caches) {
+  std::vector<std::string> out;
+
+  if (args["help"].asBool()) {
+    out.push_back(USAGE);
+    return out;
+  }
+
+  auto local_cache_root = get_local_cache_root(args);
+
+  if (args["cache"].asBool() && args["dedup"].asBool()) {
+    out.push_back(fmt::format("saved {} bytes",
+                              deduplicate_records(local_cache_root)));
+    return out;
+  }
+
+  if (args["cache"].asBool() && args["index"].asBool()) {
+    auto index = rebuild_record_index(local_cache_root);
+    out.push_back(fmt::format("indexed {} records", index.records.size()));
+    return out;
+  }
+
+  if (args["query"].asBool()) {
+    std::vector<std::pair<std::string, std::string>> conditions;
+    for (auto const &cond : args["<condition>"].asStringList()) {
+      auto eq = cond.find('=');
+      if (eq == std::string::npos) {
+        throw std::runtime_error(fmt::format(
+            "Invalid query condition: {}, expected key=value", cond));
+      }
+      conditions.emplace_back(cond.substr(0, eq), cond.substr(eq + 1));
+    }
+    for (auto const &entry : query_record_index(
+             read_record_index(local_cache_root), conditions)) {
+      out.push_back(entry.ref());
+    }
+    return out;
+  }
+
+  if (args["verify-predictions"].asBool()) {
+    double tolerance = 1E-3;
+    if (args["--tolerance"]) {
+      tolerance = std::stod(args["--tolerance"].asString());
+    }
+    size_t nworkers = 0;
+    if (args["--workers"]) {
+      nworkers = std::stoul(args["--workers"].asString());
+    }
+
+    std::vector<PredictionCheck> checks;
+    if (args["<record>"].asStringList().size()) {
+      std::vector<ResourceReference> refs;
+      for (auto const &refstr : args["<record>"].asStringList()) {
+        refs.push_back(args["--path"].asBool() ? PathResourceReference(refstr)
+                                               : ResourceReference(refstr));
+      }
+      checks = verify_predictions(refs, local_cache_root, tolerance, nworkers);
+    } else {
+      checks = verify_all_predictions(local_cache_root, tolerance, nworkers);
+    }
+
+    std::map<PredictionCheck::Status, size_t> counts;
+    for (auto const &check : checks) {
+      ++counts[check.status];
+      if (check.status == PredictionCheck::Status::kError) {
+        out.push_back(fmt::format(
+            "{} {} {}{}: {}", to_string(check.status), check.record_ref,
+            check.prediction.native(),
+            check.prediction_name.size() ? (":" + check.prediction_name) : "",
+            check.error));
+        continue;
+      }
+      out.push_back(fmt::format(
+          "{} {} {}:{} {} {} (expected {})", to_string(check.status),
+          check.record_ref, check.prediction.native(), check.prediction_name,
+          check.test_statistic, check.computed, check.expected));
+    }
+    out.push_back(fmt::format(
+        "{} passed, {} failed, {} without an expected value, {} errors",
+        counts[PredictionCheck::Status::kPassed],
+        counts[PredictionCheck::Status::kFailed],
+        counts[PredictionCheck::Status::kNoExpectation],
+        counts[PredictionCheck::Status::kError]));
+    return out;
+  }
+
+  if (args["cache"].asBool() && args["gc"].asBool()) {
+    std::chrono::seconds min_age = std::chrono::hours(1);
+    if (args["--min-age"]) {
+      min_age = std::chrono::seconds(std::stol(args["--min-age"].asString()));
+    }
+    auto result = cache_gc(local_cache_root,
+                           parse_size(args["--max-size"].asString()), min_age);
+    out.push_back(fmt::format(
+        "evicted {} records and {} table snapshots, {} -> {} bytes",
+        result.records_evicted, result.snapshots_evicted, result.size_before,
+        result.size_after));
+    return out;
+  }
+
   ResourceReference cli_ref;
   if (args["--path"].asBool()) {
     cli_ref = PathResourceReference(args["<ref>"].asString());
@@ -105,47 +418,44 @@ int main(int argc, const char **argv) {
   }
 
   if (args["get-ref-component"].asBool()) {
-    std::cout << cli_ref.component(args["<comp>"].asString()) << std::endl;
-    return 0;
+    out.push_back(cli_ref.component(args["<comp>"].asString()));
+    return out;
   }
 
   if (args["get-cross-section-measurements"].asBool()) {
     for (auto const &measurement :
-         make_Record(cli_ref, local_cache_root).measurements) {
-      std::cout << measurement.source.stem().native() << std::endl;
+         caches.record(cli_ref, local_cache_root).measurements) {
+      out.push_back(measurement.source.stem().native());
     }
-    return 0;
+    return out;
   }
 
   if (args["get-local-path"].asBool()) {
-    std::cout << resolve_reference(cli_ref, local_cache_root).native()
-              << std::endl;
-    return 0;
+    out.push_back(
+        extract_resource(caches.resolve(cli_ref, local_cache_root)).native());
+    return out;
   }
 
   if (args["get-independent-vars"].asBool()) {
-    auto tbl = YAML::LoadFile(resolve_reference(cli_ref, local_cache_root))
-                   .as<Table>();
-    for (auto const &ivar : tbl.independent_vars) {
-      std::cout << ivar.name << std::endl;
+    for (auto const &ivar :
+         caches.metadata(cli_ref, local_cache_root).independent_vars) {
+      out.push_back(ivar.name);
     }
-    return 0;
+    return out;
   }
 
   if (args["get-dependent-vars"].asBool()) {
-    auto tbl = YAML::LoadFile(resolve_reference(cli_ref, local_cache_root))
-                   .as<Table>();
-    for (auto const &dvar : tbl.dependent_vars) {
-      std::cout << dvar.name << std::endl;
+    for (auto const &dvar :
+         caches.metadata(cli_ref, local_cache_root).dependent_vars) {
+      out.push_back(dvar.name);
     }
-    return 0;
+    return out;
   }
 
   if (args["get-qualifiers"].asBool() ||
       args["dereference-to-local-path"].asBool()) {
     auto ref = cli_ref;
-    auto tbl =
-        YAML::LoadFile(resolve_reference(ref, local_cache_root)).as<Table>();
+    auto const &tbl = caches.metadata(ref, local_cache_root);
 
     decltype(tbl.dependent_vars.front().qualifiers) quals;
     for (auto const &dvar : tbl.dependent_vars) {
@@ -164,20 +474,20 @@ int main(int argc, const char **argv) {
         if (args["<key>"].asString() == kvp.first) {
           if (args["dereference-to-local-path"].asBool()) {
             for (auto const &el : split_spec(kvp.second)) {
-              std::cout << resolve_reference(ResourceReference(el, ref),
-                                             local_cache_root)
-                               .native()
-                        << std::endl;
+              out.push_back(extract_resource(caches.resolve(
+                                    ResourceReference(el, ref),
+                                    local_cache_root))
+                                .native());
             }
             found = true;
           } else {
-            std::cout << kvp.second << std::endl;
+            out.push_back(kvp.second);
             found = true;
           }
           break;
         }
       } else {
-        std::cout << kvp.first << ": " << kvp.second << std::endl;
+        out.push_back(kvp.first + ": " + kvp.second);
         found = true;
       }
     }
@@ -188,20 +498,163 @@ int main(int argc, const char **argv) {
                       args["<key>"].asString()));
     }
 
-    return 0;
+    return out;
   }
 
   if (args["get-local-additional-resources"].asBool()) {
     for (auto const &addres :
-         make_Record(cli_ref, local_cache_root).additional_resources) {
-      std::cout << addres.filename().native() << std::endl;
+         caches.record(cli_ref, local_cache_root).additional_resources) {
+      out.push_back(addres.filename().native());
     }
   }
 
-  if (args["help"].asBool()) {
-    std::cout << USAGE << std::endl;
+  return out;
+}
+
+// Answers each command read from is in turn. Failed commands are reported
+// and do not stop the batch, the return code is non-zero if any failed.
+int run_batch(std::istream &is, std::map<std::string, docopt::value> &args,
+              bool ndjson) {
+  Caches caches;
+  bool any_failed = false;
+
+  std::string line;
+  for (size_t lineno = 1; std::getline(is, line); ++lineno) {
+    auto first = line.find_first_not_of(" \t\r");
+    if ((first == std::string::npos) || (line[first] == '#')) {
+      continue;
+    }
+
+    std::vector<std::string> output;
+    bool ok = false;
+    std::string error;
+    try {
+      auto tokens = split_command(line);
+      // options given to the batch invocation apply to every command unless
+      // the command overrides them
+      if (args["--nuisancedb"] &&
+          std::none_of(tokens.begin(), tokens.end(), [](auto const &tok) {
+            return tok.rfind("--nuisancedb", 0) == 0;
+          })) {
+        tokens.insert(tokens.begin(),
+                      "--nuisancedb=" + args["--nuisancedb"].asString());
+      }
+      auto cmd_args = docopt::docopt_parse(USAGE, tokens, false, false);
+      if (cmd_args["batch"].asBool() || cmd_args["serve"].asBool()) {
+        throw std::runtime_error("batch and serve cannot be run from a batch");
+      }
+      output = run_command(cmd_args, caches);
+      ok = true;
+    } catch (docopt::DocoptArgumentError const &) {
+      error = "invalid command, see nuis-hepdata help for usage";
+    } catch (std::exception const &e) {
+      error = e.what();
+    }
+
+    if (ndjson) {
+      std::string outarr;
+      for (auto const &o : output) {
+        outarr += (outarr.size() ? "," : "") + json_string(o);
+      }
+      if (!ok) {
+        std::cout << fmt::format(
+            "{{\"line\":{},\"command\":{},\"ok\":false,\"error\":{}}}", lineno,
+            json_string(line), json_string(error));
+      } else {
+        std::cout << fmt::format(
+            "{{\"line\":{},\"command\":{},\"ok\":true,\"output\":[{}]}}",
+            lineno, json_string(line), outarr);
+      }
+      std::cout << std::endl;
+    } else if (!ok) {
+      std::cerr << fmt::format("line {}: \"{}\" failed: {}", lineno, line,
+                               error)
+                << std::endl;
+    } else {
+      for (auto const &o : output) {
+        std::cout << o << "\n";
+      }
+      std::cout << std::flush;
+    }
+
+    any_failed = any_failed || !ok;
+  }
+
+  return any_failed ? 1 : 0;
+}
+
+std::atomic<bool> stop_serving{false};
+
+int main(int argc, const char **argv) {
+  std::map<std::string, docopt::value> args =
+      docopt::docopt(USAGE, {argv + 1, argv + argc},
+                     true,                // show help if requested
+                     "nuis-hepdata 0.9"); // version string
+
+  if (args["--debug"].asBool()) {
+    spdlog::set_level(spdlog::level::debug);
+  }
+
+  if (args["--endpoints"]) {
+    set_record_endpoints(split_spec(args["--endpoints"].asString()));
+  }
+
+  if (args["--incremental"].asBool()) {
+    set_incremental_fetch(true);
+  }
+
+  if (args["--archive"].asBool()) {
+    set_archive_records(true);
+  }
+
+  if (args["--dedup"].asBool()) {
+    set_deduplicate_records(true);
+  }
+
+  if (args["--connect-timeout"] || args["--timeout"]) {
+    auto [connect_timeout, total_timeout] = get_http_timeouts();
+    if (args["--connect-timeout"]) {
+      connect_timeout = std::chrono::milliseconds(
+          long(std::stod(args["--connect-timeout"].asString()) * 1000));
+    }
+    if (args["--timeout"]) {
+      total_timeout = std::chrono::milliseconds(
+          long(std::stod(args["--timeout"].asString()) * 1000));
+    }
+    set_http_timeouts(connect_timeout, total_timeout);
+  }
+
+  if (args["batch"].asBool()) {
+    if (args["<file>"]) {
+      std::ifstream fin(args["<file>"].asString());
+      if (!fin) {
+        throw std::runtime_error(fmt::format("failed to open batch file: {}",
+                                             args["<file>"].asString()));
+      }
+      return run_batch(fin, args, args["--ndjson"].asBool());
+    }
+    return run_batch(std::cin, args, args["--ndjson"].asBool());
+  }
+
+  if (args["serve"].asBool()) {
+    auto local_cache_root = get_local_cache_root(args);
+    std::vector<ResourceReference> preload;
+    for (auto const &refstr : args["<preload>"].asStringList()) {
+      preload.push_back(args["--path"].asBool() ? PathResourceReference(refstr)
+                                                : ResourceReference(refstr));
+    }
+
+    std::signal(SIGINT, [](int) { stop_serving = true; });
+    std::signal(SIGTERM, [](int) { stop_serving = true; });
+    serve_Records(args["<socket>"].asString(), local_cache_root, preload,
+                  &stop_serving);
     return 0;
   }
 
+  Caches caches;
+  for (auto const &o : run_command(args, caches)) {
+    std::cout << o << std::endl;
+  }
+
   return 0;
 }
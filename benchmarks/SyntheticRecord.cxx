@@ -0,0 +1,355 @@
+#include "SyntheticRecord.h"
+
+#include "yaml-cpp/yaml.h"
+
+#include "fmt/core.h"
+
+#include <cmath>
+#include <fstream>
+
+namespace nuis::HEPData {
+
+std::string SyntheticRecordSpec::record_refstr() const {
+  return fmt::format("hepdata:{}v{}", recordid, recordvers);
+}
+
+namespace {
+
+void write_yaml(std::filesystem::path const &location,
+                YAML::Emitter const &out) {
+  std::ofstream of(location);
+  if (!of.good()) {
+    throw std::runtime_error(
+        fmt::format("Failed to open {} for writing.", location.native()));
+  }
+  of << out.c_str() << "\n";
+}
+
+void emit_header(YAML::Emitter &out, std::string const &name,
+                 std::string const &units) {
+  out << YAML::Key << "header" << YAML::Value << YAML::Flow << YAML::BeginMap
+      << YAML::Key << "name" << YAML::Value << name << YAML::Key << "units"
+      << YAML::Value << units << YAML::EndMap;
+}
+
+void emit_qualifiers(
+    YAML::Emitter &out,
+    std::vector<std::pair<std::string, std::string>> const &quals) {
+  out << YAML::Key << "qualifiers" << YAML::Value << YAML::BeginSeq;
+  for (auto const &[k, v] : quals) {
+    out << YAML::Flow << YAML::BeginMap << YAML::Key << "name" << YAML::Value
+        << k << YAML::Key << "value" << YAML::Value << v << YAML::EndMap;
+  }
+  out << YAML::EndSeq;
+}
+
+// regular grid of nbins bins over ndims, with bin i in dimension d spanning
+// [idx_d(i)*width, (idx_d(i)+1)*width)
+void emit_grid_independent_variables(YAML::Emitter &out, size_t nbins,
+                                     size_t ndims, std::string const &prefix,
+                                     double width) {
+  size_t nper_dim = std::max(
+      size_t(1), size_t(std::ceil(std::pow(double(nbins), 1.0 / ndims))));
+
+  out << YAML::Key << "independent_variables" << YAML::Value
+      << YAML::BeginSeq;
+  size_t stride = 1;
+  for (size_t d = 0; d < ndims; ++d) {
+    out << YAML::BeginMap;
+    emit_header(out, fmt::format("{}{}", prefix, d), "GeV");
+    out << YAML::Key << "values" << YAML::Value << YAML::BeginSeq;
+    for (size_t i = 0; i < nbins; ++i) {
+      size_t idx = (i / stride) % nper_dim;
+      out << YAML::Flow << YAML::BeginMap << YAML::Key << "low" << YAML::Value
+          << idx * width << YAML::Key << "high" << YAML::Value
+          << (idx + 1) * width << YAML::EndMap;
+    }
+    out << YAML::EndSeq << YAML::EndMap;
+    stride *= nper_dim;
+  }
+  out << YAML::EndSeq;
+}
+
+// two global bin number independent variables, as used for error and smearing
+// matrices, with the first index varying slowest
+void emit_matrix_independent_variables(YAML::Emitter &out, size_t nrows,
+                                       size_t ncols) {
+  out << YAML::Key << "independent_variables" << YAML::Value
+      << YAML::BeginSeq;
+  for (size_t d = 0; d < 2; ++d) {
+    out << YAML::BeginMap;
+    emit_header(out, d ? "bin_j" : "bin_i", "");
+    out << YAML::Key << "values" << YAML::Value << YAML::BeginSeq;
+    for (size_t i = 0; i < nrows; ++i) {
+      for (size_t j = 0; j < ncols; ++j) {
+        out << YAML::Flow << YAML::BeginMap << YAML::Key << "value"
+            << YAML::Value << (d ? j : i) << YAML::EndMap;
+      }
+    }
+    out << YAML::EndSeq << YAML::EndMap;
+  }
+  out << YAML::EndSeq;
+}
+
+template <typename VF>
+void emit_values(YAML::Emitter &out, size_t nvalues, VF const &vf,
+                 bool with_errors = false) {
+  out << YAML::Key << "values" << YAML::Value << YAML::BeginSeq;
+  for (size_t i = 0; i < nvalues; ++i) {
+    double v = vf(i);
+    out << YAML::Flow << YAML::BeginMap << YAML::Key << "value" << YAML::Value
+        << v;
+    if (with_errors) {
+      out << YAML::Key << "errors" << YAML::Value << YAML::BeginSeq
+          << YAML::BeginMap << YAML::Key << "label" << YAML::Value << "total"
+          << YAML::Key << "symerror" << YAML::Value << 0.1 * v << YAML::EndMap
+          << YAML::EndSeq;
+    }
+    out << YAML::EndMap;
+  }
+  out << YAML::EndSeq;
+}
+
+void write_flux_table(SyntheticRecordSpec const &spec,
+                      std::filesystem::path const &location) {
+  YAML::Emitter out;
+  out << YAML::BeginMap;
+  emit_grid_independent_variables(out, spec.nbins, 1, "E_nu_", 0.1);
+  out << YAML::Key << "dependent_variables" << YAML::Value << YAML::BeginSeq;
+  for (size_t f = 0; f < spec.nfluxes; ++f) {
+    out << YAML::BeginMap;
+    emit_header(out, fmt::format("flux_{}", f), "/cm^2/POT/GeV");
+    emit_qualifiers(out, {{"variable_type", "probe_flux"},
+                          {"probe_particle", (f % 2) ? "nue" : "numu"},
+                          {"bin_content_type", "count_density"}});
+    emit_values(out, spec.nbins, [&](size_t i) {
+      return (1.0 + f) * std::exp(-0.1 * double(i));
+    });
+    out << YAML::EndMap;
+  }
+  out << YAML::EndSeq << YAML::EndMap;
+
+  write_yaml(location, out);
+}
+
+void write_covariance_table(SyntheticRecordSpec const &spec,
+                            std::filesystem::path const &location) {
+  YAML::Emitter out;
+  out << YAML::BeginMap;
+  emit_matrix_independent_variables(out, spec.nbins, spec.nbins);
+  out << YAML::Key << "dependent_variables" << YAML::Value << YAML::BeginSeq
+      << YAML::BeginMap;
+  emit_header(out, "covariance", "");
+  emit_qualifiers(out, {{"variable_type", "error_table"},
+                        {"error_type", "covariance"}});
+  emit_values(out, spec.nbins * spec.nbins, [&](size_t g) {
+    size_t i = g / spec.nbins, j = g % spec.nbins;
+    return (i == j) ? 1.0 : 0.5 / (1.0 + std::abs(double(i) - double(j)));
+  });
+  out << YAML::EndMap << YAML::EndSeq << YAML::EndMap;
+
+  write_yaml(location, out);
+}
+
+void write_universes_table(SyntheticRecordSpec const &spec,
+                           std::filesystem::path const &location) {
+  YAML::Emitter out;
+  out << YAML::BeginMap;
+  out << YAML::Key << "independent_variables" << YAML::Value
+      << YAML::BeginSeq << YAML::BeginMap;
+  emit_header(out, "bin", "");
+  emit_values(out, spec.nbins, [](size_t i) { return double(i); });
+  out << YAML::EndMap << YAML::EndSeq;
+
+  out << YAML::Key << "dependent_variables" << YAML::Value << YAML::BeginSeq;
+  for (size_t u = 0; u < spec.nuniverses; ++u) {
+    out << YAML::BeginMap;
+    emit_header(out, fmt::format("universe_{}", u), "");
+    emit_qualifiers(out, {{"variable_type", "error_table"},
+                          {"error_type", "universes"}});
+    emit_values(out, spec.nbins, [&](size_t i) {
+      return 1.0 + 0.01 * std::sin(double(u * spec.nbins + i));
+    });
+    out << YAML::EndMap;
+  }
+  out << YAML::EndSeq << YAML::EndMap;
+
+  write_yaml(location, out);
+}
+
+void write_smearing_table(SyntheticRecordSpec const &spec,
+                          std::filesystem::path const &location) {
+  YAML::Emitter out;
+  out << YAML::BeginMap;
+  emit_matrix_independent_variables(out, spec.nbins, spec.nbins);
+  out << YAML::Key << "dependent_variables" << YAML::Value << YAML::BeginSeq
+      << YAML::BeginMap;
+  emit_header(out, "smearing", "");
+  emit_qualifiers(out, {{"variable_type", "smearing_table"},
+                        {"smearing_type", "smearing_matrix"}});
+  emit_values(out, spec.nbins * spec.nbins, [&](size_t g) {
+    size_t i = g / spec.nbins, j = g % spec.nbins;
+    return (i == j) ? 0.8 : ((std::max(i, j) - std::min(i, j)) == 1 ? 0.1 : 0);
+  });
+  out << YAML::EndMap << YAML::EndSeq << YAML::EndMap;
+
+  write_yaml(location, out);
+}
+
+void write_measurement_table(SyntheticRecordSpec const &spec, size_t mi,
+                             std::filesystem::path const &location) {
+  YAML::Emitter out;
+  out << YAML::BeginMap;
+  emit_grid_independent_variables(out, spec.nbins, spec.ndims, "x", 0.1);
+
+  std::vector<std::pair<std::string, std::string>> quals = {
+      {"variable_type", "cross_section_measurement"},
+      {"selectfunc", fmt::format("analysis.cxx:Synthetic_Select_{}", mi)},
+      {"target", "CH"},
+      {"probe_flux", "flux:flux_0"},
+      {"cross_section_units", "1e-38 cm2|PerTargetNucleon|per_bin_width"},
+      {"errors", spec.nuniverses ? fmt::format("universes-{}", mi)
+                                 : fmt::format("covariance-{}", mi)},
+  };
+  for (size_t d = 0; d < spec.ndims; ++d) {
+    quals.emplace_back(fmt::format("x{}:projectfunc", d),
+                       fmt::format("analysis.cxx:Synthetic_Project_x{}", d));
+  }
+  if (spec.with_smearing) {
+    quals.emplace_back("smearing", fmt::format("smearing-{}", mi));
+  }
+
+  out << YAML::Key << "dependent_variables" << YAML::Value << YAML::BeginSeq
+      << YAML::BeginMap;
+  emit_header(out, "cross_section", "1e-38 cm^2/GeV/nucleon");
+  emit_qualifiers(out, quals);
+  emit_values(
+      out, spec.nbins, [](size_t i) { return 1.0 + 0.1 * double(i); }, true);
+  out << YAML::EndMap;
+
+  if (spec.with_predictions) {
+    out << YAML::BeginMap;
+    emit_header(out, "cross_section-prediction", "1e-38 cm^2/GeV/nucleon");
+    emit_qualifiers(out, {{"variable_type", "cross_section_prediction"},
+                          {"for_measurement",
+                           fmt::format("cross_section-{}", mi)},
+                          {"expected_test_statistic", "1.234"},
+                          {"pre_smeared", "true"},
+                          {"label", "Synthetic"}});
+    emit_values(out, spec.nbins,
+                [](size_t i) { return 1.05 + 0.1 * double(i); });
+    out << YAML::EndMap;
+  }
+  out << YAML::EndSeq << YAML::EndMap;
+
+  write_yaml(location, out);
+}
+
+// a Pb/CH ratio in the layout of the target ratio example of the specification
+void write_ratio_table(SyntheticRecordSpec const &spec,
+                       std::filesystem::path const &location) {
+  YAML::Emitter out;
+  out << YAML::BeginMap;
+  emit_grid_independent_variables(out, spec.nbins, 1, "x", 0.1);
+
+  out << YAML::Key << "dependent_variables" << YAML::Value << YAML::BeginSeq
+      << YAML::BeginMap;
+  emit_header(out, "ratio", "");
+  emit_qualifiers(out,
+                  {{"variable_type", "composite_cross_section_measurement"},
+                   {"measurement_type", "ratio"},
+                   {"selectfunc", "analysis.cxx:Synthetic_Select_0"},
+                   {"target", "Pb"},
+                   {"target[1]", "CH"},
+                   {"probe_flux", "flux:flux_0"},
+                   {"errors", "ratio-covariance"}});
+  emit_values(
+      out, spec.nbins, [](size_t i) { return 6.0 + 0.01 * double(i); }, true);
+  out << YAML::EndMap << YAML::EndSeq << YAML::EndMap;
+
+  write_yaml(location, out);
+}
+
+void emit_table_doc(YAML::Emitter &out, std::string const &name) {
+  out << YAML::BeginDoc << YAML::BeginMap << YAML::Key << "name"
+      << YAML::Value << name << YAML::Key << "description" << YAML::Value
+      << fmt::format("synthetic table {}", name) << YAML::Key << "data_file"
+      << YAML::Value << fmt::format("{}.yaml", name) << YAML::EndMap;
+}
+
+} // namespace
+
+std::filesystem::path
+write_SyntheticRecord(SyntheticRecordSpec const &spec,
+                      std::filesystem::path const &local_cache_root) {
+
+  if (!spec.nbins || !spec.ndims || !spec.nfluxes) {
+    throw std::runtime_error(
+        "SyntheticRecordSpec must have at least one bin, dimension, and flux.");
+  }
+
+  auto record_root =
+      local_cache_root / fmt::format("hepdata/{0}/HEPData-{0}-v{1}",
+                                     spec.recordid, spec.recordvers);
+  std::filesystem::create_directories(record_root);
+
+  YAML::Emitter submission;
+  submission << YAML::BeginDoc << YAML::BeginMap << YAML::Key << "comment"
+             << YAML::Value << "Synthetic NUISANCE HEPData benchmark record"
+             << YAML::Key << "additional_resources" << YAML::Value
+             << YAML::BeginSeq << YAML::BeginMap << YAML::Key << "location"
+             << YAML::Value << "analysis.cxx" << YAML::Key << "description"
+             << YAML::Value << "analysis snippet" << YAML::EndMap
+             << YAML::EndSeq << YAML::EndMap;
+
+  {
+    std::ofstream snippet(record_root / "analysis.cxx");
+    for (size_t mi = 0; mi < spec.nmeasurements; ++mi) {
+      snippet << fmt::format(
+          "int Synthetic_Select_{}(HepMC3::GenEvent const &) {{ return 1; }}\n",
+          mi);
+    }
+    for (size_t d = 0; d < spec.ndims; ++d) {
+      snippet << fmt::format("double Synthetic_Project_x{}(HepMC3::GenEvent "
+                             "const &) {{ return 0; }}\n",
+                             d);
+    }
+  }
+
+  write_flux_table(spec, record_root / "flux.yaml");
+  emit_table_doc(submission, "flux");
+
+  for (size_t mi = 0; mi < spec.nmeasurements; ++mi) {
+    auto name = fmt::format("cross_section-{}", mi);
+    write_measurement_table(spec, mi, record_root / (name + ".yaml"));
+    emit_table_doc(submission, name);
+
+    if (spec.nuniverses) {
+      name = fmt::format("universes-{}", mi);
+      write_universes_table(spec, record_root / (name + ".yaml"));
+    } else {
+      name = fmt::format("covariance-{}", mi);
+      write_covariance_table(spec, record_root / (name + ".yaml"));
+    }
+    emit_table_doc(submission, name);
+
+    if (spec.with_smearing) {
+      name = fmt::format("smearing-{}", mi);
+      write_smearing_table(spec, record_root / (name + ".yaml"));
+      emit_table_doc(submission, name);
+    }
+  }
+
+  if (spec.with_ratio) {
+    write_ratio_table(spec, record_root / "ratio.yaml");
+    emit_table_doc(submission, "ratio");
+    write_covariance_table(spec, record_root / "ratio-covariance.yaml");
+    emit_table_doc(submission, "ratio-covariance");
+  }
+
+  write_yaml(record_root / "submission.yaml", submission);
+
+  return record_root;
+}
+
+} // namespace nuis::HEPData
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+namespace nuis::HEPData {
+
+// Describes a synthetic, but convention-compliant, HEPData record that can be
+// written into a local record database for benchmarking the reference
+// resolution and table parsing machinery at scale.
+struct SyntheticRecordSpec {
+  size_t recordid;
+  int recordvers;
+
+  // every measurement table has nbins bins laid out on a regular grid over
+  // ndims independent variables
+  size_t nbins;
+  size_t ndims;
+  size_t nmeasurements;
+
+  // the number of probe_flux dependent variables written to the shared flux
+  // table, each measurement refers to the first one
+  size_t nfluxes;
+
+  // if non-zero, measurements refer to an error_type=universes table with
+  // this many dependent variables instead of a covariance matrix
+  size_t nuniverses;
+
+  bool with_smearing;
+  bool with_predictions;
+  // writes a target ratio composite_cross_section_measurement table, ratio,
+  // with its own data and covariance and no sub_measurements
+  bool with_ratio;
+
+  SyntheticRecordSpec()
+      : recordid{1}, recordvers{1}, nbins{10}, ndims{1}, nmeasurements{1},
+        nfluxes{1}, nuniverses{0}, with_smearing{true},
+        with_predictions{true}, with_ratio{false} {}
+
+  // hepdata:<id>v<vers>
+  std::string record_refstr() const;
+};
+
+// Writes the record described by spec to the location that a
+// hepdata:<id>v<vers> reference is expected to resolve to under
+// local_cache_root so that no remote requests are made when the record is
+// subsequently referenced. Returns the path to the record directory.
+std::filesystem::path
+write_SyntheticRecord(SyntheticRecordSpec const &spec,
+                      std::filesystem::path const &local_cache_root = ".");
+
+} // namespace nuis::HEPData
@@ -0,0 +1,349 @@
+#include "SyntheticRecord.h"
+
+#include "nuis/HEPData/BinarySerialization.h"
+#include "nuis/HEPData/ReferenceResolver.h"
+#include "nuis/HEPData/ResourceReference.h"
+#include "nuis/HEPData/TableFactory.h"
+#include "nuis/HEPData/TestStatistic.h"
+#include "nuis/HEPData/YAMLConverters.h"
+
+#include "yaml-cpp/yaml.h"
+
+#include "benchmark/benchmark.h"
+
+#include "fmt/core.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <map>
+#include <tuple>
+
+using namespace nuis::HEPData;
+
+namespace {
+
+// The database is written to a temporary directory per process unless
+// NUISANCEHEPData_BENCH_DB is set, in which case it is reused between runs.
+std::filesystem::path const &bench_db() {
+  static std::filesystem::path db = []() {
+    auto env = std::getenv("NUISANCEHEPData_BENCH_DB");
+    std::filesystem::path loc =
+        env ? std::filesystem::path(env)
+            : std::filesystem::temp_directory_path() /
+                  fmt::format("nuis-hepdata-bench-{}", getpid());
+    std::filesystem::create_directories(loc);
+    return loc;
+  }();
+  return db;
+}
+
+// Records are written once per distinct spec and then reused by every
+// benchmark that asks for the same spec.
+SyntheticRecordSpec const &get_record(size_t nbins, size_t ndims = 1,
+                                      size_t nmeasurements = 1,
+                                      size_t nfluxes = 1,
+                                      size_t nuniverses = 0) {
+  static std::map<std::tuple<size_t, size_t, size_t, size_t, size_t>,
+                  SyntheticRecordSpec>
+      records;
+
+  auto key = std::make_tuple(nbins, ndims, nmeasurements, nfluxes, nuniverses);
+  if (!records.count(key)) {
+    SyntheticRecordSpec spec;
+    spec.recordid = 1000 + records.size();
+    spec.nbins = nbins;
+    spec.ndims = ndims;
+    spec.nmeasurements = nmeasurements;
+    spec.nfluxes = nfluxes;
+    spec.nuniverses = nuniverses;
+    write_SyntheticRecord(spec, bench_db());
+    records[key] = spec;
+  }
+  return records.at(key);
+}
+
+void report_memory(benchmark::State &state) {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  // ru_maxrss is in kilobytes on linux
+  state.counters["maxrss_MB"] = double(usage.ru_maxrss) / 1024.0;
+}
+
+void set_file_bytes(benchmark::State &state,
+                    std::filesystem::path const &file) {
+  state.SetBytesProcessed(int64_t(state.iterations()) *
+                          int64_t(std::filesystem::file_size(file)));
+}
+
+void BM_ResourceReference_parse(benchmark::State &state) {
+  static std::vector<std::string> const refstrs = {
+      "MyCrossSection",
+      "12345/MyCrossSection",
+      "inspirehep:123/MyCrossSection",
+      "hepdata-sandbox:678910v2/MyCrossSection",
+      "12345/MyCrossSection:Bkg",
+      "12345/flux.root:flux_numu",
+      "hepdata:12345v1",
+  };
+  ResourceReference context("hepdata:12345v1/cross_section");
+
+  for (auto _ : state) {
+    for (auto const &refstr : refstrs) {
+      benchmark::DoNotOptimize(ResourceReference(refstr, context));
+    }
+  }
+  state.SetItemsProcessed(int64_t(state.iterations() * refstrs.size()));
+}
+BENCHMARK(BM_ResourceReference_parse);
+
+void BM_resolve_reference(benchmark::State &state) {
+  auto const &spec = get_record(10);
+  ResourceReference ref(spec.record_refstr() + "/cross_section-0");
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(resolve_reference(ref, bench_db()));
+  }
+}
+BENCHMARK(BM_resolve_reference);
+
+void BM_resolve_reference_path(benchmark::State &state) {
+  auto const &spec = get_record(10);
+  auto record_root = bench_db() / fmt::format("hepdata/{0}/HEPData-{0}-v{1}",
+                                              spec.recordid, spec.recordvers);
+  auto ref = PathResourceReference(record_root.native() + ":cross_section-0");
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(resolve_reference(ref, bench_db()));
+  }
+}
+BENCHMARK(BM_resolve_reference_path);
+
+void BM_make_ProbeFlux(benchmark::State &state) {
+  auto const &spec = get_record(state.range(0), 1, 1, state.range(1));
+  // ask for the last flux so that the whole file must be scanned
+  ResourceReference ref(spec.record_refstr() +
+                        fmt::format("/flux:flux_{}", spec.nfluxes - 1));
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(make_ProbeFlux(ref, bench_db()));
+  }
+  set_file_bytes(state, resolve_reference(ref, bench_db()));
+  report_memory(state);
+}
+BENCHMARK(BM_make_ProbeFlux)
+    ->ArgNames({"nbins", "nfluxes"})
+    ->ArgsProduct({{10, 100, 1000}, {1, 16}})
+    ->Unit(benchmark::kMillisecond);
+
+void BM_make_ErrorTable_covariance(benchmark::State &state) {
+  auto const &spec = get_record(state.range(0));
+  ResourceReference ref(spec.record_refstr() + "/covariance-0");
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(make_ErrorTable(ref, bench_db()));
+  }
+  set_file_bytes(state, resolve_reference(ref, bench_db()));
+  report_memory(state);
+}
+BENCHMARK(BM_make_ErrorTable_covariance)
+    ->ArgName("nbins")
+    ->RangeMultiplier(4)
+    ->Range(8, 128)
+    ->Unit(benchmark::kMillisecond);
+
+void BM_make_ErrorTable_universes(benchmark::State &state) {
+  auto const &spec = get_record(state.range(0), 1, 1, 1, state.range(1));
+  // ask for the last universe so that the whole file must be scanned
+  ResourceReference ref(spec.record_refstr() +
+                        fmt::format("/universes-0:universe_{}",
+                                    spec.nuniverses - 1));
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(make_ErrorTable(ref, bench_db()));
+  }
+  set_file_bytes(state, resolve_reference(ref, bench_db()));
+  report_memory(state);
+}
+BENCHMARK(BM_make_ErrorTable_universes)
+    ->ArgNames({"nbins", "nuniverses"})
+    ->ArgsProduct({{10, 100}, {10, 100}})
+    ->Unit(benchmark::kMillisecond);
+
+void BM_make_SmearingTable(benchmark::State &state) {
+  auto const &spec = get_record(state.range(0));
+  ResourceReference ref(spec.record_refstr() + "/smearing-0");
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(make_SmearingTable(ref, bench_db()));
+  }
+  set_file_bytes(state, resolve_reference(ref, bench_db()));
+  report_memory(state);
+}
+BENCHMARK(BM_make_SmearingTable)
+    ->ArgName("nbins")
+    ->RangeMultiplier(4)
+    ->Range(8, 128)
+    ->Unit(benchmark::kMillisecond);
+
+void BM_make_PredictionTable(benchmark::State &state) {
+  auto const &spec = get_record(state.range(0), state.range(1));
+  ResourceReference ref(spec.record_refstr() +
+                        "/cross_section-0:cross_section-prediction");
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(make_PredictionTable(ref, bench_db()));
+  }
+  set_file_bytes(state, resolve_reference(ref, bench_db()));
+  report_memory(state);
+}
+BENCHMARK(BM_make_PredictionTable)
+    ->ArgNames({"nbins", "ndims"})
+    ->ArgsProduct({{10, 100, 1000}, {1, 3}})
+    ->Unit(benchmark::kMillisecond);
+
+void BM_load_Table(benchmark::State &state) {
+  auto const &spec = get_record(state.range(0), 1, 1, state.range(1));
+  auto source =
+      resolve_reference(ResourceReference(spec.record_refstr() + "/flux"),
+                        bench_db());
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(YAML::LoadFile(source).as<Table>());
+  }
+  set_file_bytes(state, source);
+  report_memory(state);
+}
+BENCHMARK(BM_load_Table)
+    ->ArgNames({"nbins", "nfluxes"})
+    ->ArgsProduct({{10, 100, 1000}, {1, 16}})
+    ->Unit(benchmark::kMillisecond);
+
+void BM_load_Table_metadata(benchmark::State &state) {
+  auto const &spec = get_record(state.range(0), 1, 1, state.range(1));
+  auto source =
+      resolve_reference(ResourceReference(spec.record_refstr() + "/flux"),
+                        bench_db());
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(load_Table_metadata(source));
+  }
+  set_file_bytes(state, source);
+  report_memory(state);
+}
+BENCHMARK(BM_load_Table_metadata)
+    ->ArgNames({"nbins", "nfluxes"})
+    ->ArgsProduct({{10, 100, 1000}, {1, 16}})
+    ->Unit(benchmark::kMillisecond);
+
+void BM_make_CrossSectionMeasurement(benchmark::State &state) {
+  auto const &spec = get_record(state.range(0), state.range(1));
+  ResourceReference ref(spec.record_refstr() + "/cross_section-0");
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(make_CrossSectionMeasurement(ref, bench_db()));
+  }
+  report_memory(state);
+}
+BENCHMARK(BM_make_CrossSectionMeasurement)
+    ->ArgNames({"nbins", "ndims"})
+    ->ArgsProduct({{10, 100}, {1, 3}})
+    ->Unit(benchmark::kMillisecond);
+
+void BM_make_Record(benchmark::State &state) {
+  auto const &spec =
+      get_record(state.range(0), state.range(1), state.range(2));
+  ResourceReference ref(spec.record_refstr());
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(make_Record(ref, bench_db()));
+  }
+  report_memory(state);
+}
+BENCHMARK(BM_make_Record)
+    ->ArgNames({"nbins", "ndims", "nmeasurements"})
+    ->ArgsProduct({{10, 50}, {1, 3}, {1, 8}})
+    ->Unit(benchmark::kMillisecond);
+
+void BM_Record_to_binary(benchmark::State &state) {
+  auto const &spec = get_record(state.range(0), 1, state.range(1));
+  auto rec = make_Record(ResourceReference(spec.record_refstr()), bench_db());
+
+  size_t nbytes = 0;
+  for (auto _ : state) {
+    auto bytes = to_binary(rec);
+    nbytes = bytes.size();
+    benchmark::DoNotOptimize(bytes);
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(nbytes));
+  report_memory(state);
+}
+BENCHMARK(BM_Record_to_binary)
+    ->ArgNames({"nbins", "nmeasurements"})
+    ->ArgsProduct({{10, 50}, {1, 8}})
+    ->Unit(benchmark::kMillisecond);
+
+void BM_Record_from_binary(benchmark::State &state) {
+  auto const &spec = get_record(state.range(0), 1, state.range(1));
+  auto bytes =
+      to_binary(make_Record(ResourceReference(spec.record_refstr()), bench_db()));
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(from_binary<Record>(bytes));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(bytes.size()));
+  report_memory(state);
+}
+BENCHMARK(BM_Record_from_binary)
+    ->ArgNames({"nbins", "nmeasurements"})
+    ->ArgsProduct({{10, 50}, {1, 8}})
+    ->Unit(benchmark::kMillisecond);
+
+// Also checks that a target ratio composite, which has its own data rather
+// than sub_measurements, can be flattened and compared to a prediction.
+void BM_ratio_test_statistic(benchmark::State &state) {
+  SyntheticRecordSpec spec;
+  spec.recordid = 2000 + state.range(0);
+  spec.nbins = state.range(0);
+  spec.with_ratio = true;
+  write_SyntheticRecord(spec, bench_db());
+  auto xsm = make_CrossSectionMeasurement(
+      ResourceReference(spec.record_refstr() + "/ratio"), bench_db());
+  std::vector<double> prediction(spec.nbins, 6);
+
+  try {
+    if (!(evaluate_test_statistic(xsm, prediction) >= 0)) {
+      state.SkipWithError("ratio chi2 is not a non-negative number");
+      return;
+    }
+  } catch (std::exception const &e) {
+    state.SkipWithError(e.what());
+    return;
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(evaluate_test_statistic(xsm, prediction));
+  }
+  report_memory(state);
+}
+BENCHMARK(BM_ratio_test_statistic)
+    ->ArgNames({"nbins"})
+    ->Arg(10)
+    ->Arg(100)
+    ->Unit(benchmark::kMicrosecond);
+
+} // namespace
+
+int main(int argc, char **argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+
+  if (!std::getenv("NUISANCEHEPData_BENCH_DB")) {
+    std::filesystem::remove_all(bench_db());
+  }
+  return 0;
+}
@@ -1,13 +1,41 @@
+#include "pybind11/numpy.h"
 #include "pybind11/pybind11.h"
 #include "pybind11/stl.h"
 
+#include "nuis/HEPData/BinarySerialization.h"
+#include "nuis/HEPData/FluxHistogram.h"
+#include "nuis/HEPData/FluxReweighter.h"
+#include "nuis/HEPData/FluxSampler.h"
+#include "nuis/HEPData/HTTPClient.h"
+#include "nuis/HEPData/JointLikelihood.h"
+#include "nuis/HEPData/JointMeasurement.h"
+#include "nuis/HEPData/PoissonLikelihood.h"
+#include "nuis/HEPData/PredictionValidation.h"
+#include "nuis/HEPData/Rebinning.h"
+#include "nuis/HEPData/RecordCache.h"
+#include "nuis/HEPData/RecordIndex.h"
+#include "nuis/HEPData/RecordServer.h"
 #include "nuis/HEPData/ReferenceResolver.h"
 #include "nuis/HEPData/ResourceReference.h"
 #include "nuis/HEPData/StreamHelpers.h"
 #include "nuis/HEPData/TableFactory.h"
+#include "nuis/HEPData/TestStatistic.h"
+#include "nuis/HEPData/ToyGenerator.h"
 
+#include "fmt/core.h"
 #include "spdlog/spdlog.h"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <random>
+#include <string_view>
+#include <variant>
+
 namespace py = pybind11;
 using namespace nuis;
 
@@ -19,6 +47,246 @@ spdlog::logger &ref_log();
 spdlog::logger &rec_log();
 } // namespace nuis::HEPData
 
+// numpy accessors: where the values of a variable all hold the same
+// alternative, the arrays are read-only strided views directly into the
+// std::vector<Value> owned by the bound C++ object, which is kept alive as the
+// array base. Quantities that are not laid out regularly in memory, such as
+// per-source errors, are gathered once into a buffer owned by the array.
+
+static py::array_t<double> readonly_array(double const *ptr,
+                                          std::vector<py::ssize_t> shape,
+                                          std::vector<py::ssize_t> strides,
+                                          py::handle base) {
+  py::array_t<double> arr(std::move(shape), std::move(strides), ptr, base);
+  arr.attr("setflags")(py::arg("write") = false);
+  return arr;
+}
+
+static py::array_t<double> owned_array(std::vector<double> &&data,
+                                       std::vector<py::ssize_t> shape) {
+  auto owned = new std::vector<double>(std::move(data));
+  py::capsule base(owned, [](void *p) {
+    delete reinterpret_cast<std::vector<double> *>(p);
+  });
+
+  std::vector<py::ssize_t> strides(shape.size(), sizeof(double));
+  for (size_t i = shape.size(); i > 1; --i) {
+    strides[i - 2] = strides[i - 1] * shape[i - 1];
+  }
+  return readonly_array(owned->data(), std::move(shape), std::move(strides),
+                        base);
+}
+
+// Containers of bound objects are exposed as lists of references to their
+// elements, which keep the owning python object alive, rather than being
+// converted by value, which would deep copy every nested table on each access.
+template <typename E>
+static py::list element_views(std::vector<E> const &v, py::handle owner) {
+  py::list views;
+  for (auto const &el : v) {
+    views.append(
+        py::cast(el, py::return_value_policy::reference_internal, owner));
+  }
+  return views;
+}
+
+template <typename E>
+static py::list element_views(std::vector<std::vector<E>> const &v,
+                              py::handle owner) {
+  py::list views;
+  for (auto const &el : v) {
+    views.append(element_views(el, owner));
+  }
+  return views;
+}
+
+template <typename T, typename M> static auto views_of(M T::*member) {
+  return [member](py::object const &self) {
+    return element_views(self.cast<T const &>().*member, self);
+  };
+}
+
+template <typename T>
+static void check_alternative(HEPData::Variable const &var,
+                              std::string const &what) {
+  for (auto const &v : var.values) {
+    if (!std::holds_alternative<T>(v.value)) {
+      throw std::runtime_error(
+          fmt::format("Cannot build a {} array for variable: {}, as not all "
+                      "of its values are {}.",
+                      what, var.name,
+                      std::is_same_v<T, double> ? "single values"
+                                                : "low/high extents"));
+    }
+  }
+}
+
+static py::array_t<double> values_array(HEPData::Variable const &var,
+                                        py::handle base) {
+  check_alternative<double>(var, "values");
+  if (!var.values.size()) {
+    return owned_array({}, {0});
+  }
+  return readonly_array(&std::get<double>(var.values.front().value),
+                        {py::ssize_t(var.values.size())},
+                        {sizeof(HEPData::Value)}, base);
+}
+
+// (nbins, 2) array of low and high edges
+static py::array_t<double> bin_edges_array(HEPData::Variable const &var,
+                                           py::handle base) {
+  check_alternative<HEPData::Extent>(var, "bin edges");
+  if (!var.values.size()) {
+    return owned_array({}, {0, 2});
+  }
+  return readonly_array(
+      &std::get<HEPData::Extent>(var.values.front().value).low,
+      {py::ssize_t(var.values.size()), 2},
+      {sizeof(HEPData::Value), offsetof(HEPData::Extent, high)}, base);
+}
+
+static std::vector<std::string> error_labels(HEPData::Variable const &var) {
+  std::vector<std::string> labels;
+  for (auto const &v : var.values) {
+    for (auto const &[label, err] : v.errors) {
+      if (std::find(labels.begin(), labels.end(), label) == labels.end()) {
+        labels.push_back(label);
+      }
+    }
+  }
+  return labels;
+}
+
+// bins without an error of the requested label are given an error of 0
+static py::array_t<double> errors_array(HEPData::Variable const &var,
+                                        std::string const &label) {
+  std::vector<double> errs;
+  errs.reserve(var.values.size());
+  for (auto const &v : var.values) {
+    errs.push_back(v.errors.count(label) ? v.errors.at(label) : 0);
+  }
+  return owned_array(std::move(errs), {py::ssize_t(var.values.size())});
+}
+
+static HEPData::DependentVariable const &
+get_dependent_var(HEPData::Table const &tbl, size_t dv) {
+  if (dv >= tbl.dependent_vars.size()) {
+    throw py::index_error(
+        fmt::format("Requested dependent variable {}, but table: {} has {}.",
+                    dv, tbl.source.native(), tbl.dependent_vars.size()));
+  }
+  return tbl.dependent_vars[dv];
+}
+
+// Interprets a table with two independent variables, such as an error or
+// smearing matrix, as a dense (nrows, ncols) matrix. Row and column indices
+// are assigned in order of first appearance of each independent variable
+// value. If the values are stored row-major with every element present, the
+// result is a view, otherwise it is a dense copy with missing elements zeroed.
+static py::array_t<double> matrix_array(HEPData::Table const &tbl, size_t dv,
+                                        py::handle base) {
+  auto const &var = get_dependent_var(tbl, dv);
+  check_alternative<double>(var, "matrix");
+
+  if (tbl.independent_vars.size() != 2) {
+    throw std::runtime_error(
+        fmt::format("Cannot build a matrix array for table: {}, which has {} "
+                    "independent variables, expected 2.",
+                    tbl.source.native(), tbl.independent_vars.size()));
+  }
+
+  auto bin_key = [](HEPData::Value const &v) {
+    return v.value.index() ? std::get<double>(v.value)
+                           : std::get<HEPData::Extent>(v.value).low;
+  };
+
+  std::array<std::vector<size_t>, 2> indices;
+  std::array<size_t, 2> extent{0, 0};
+  for (size_t d = 0; d < 2; ++d) {
+    auto const &ivar = tbl.independent_vars[d];
+    if (ivar.values.size() != var.values.size()) {
+      throw std::runtime_error(fmt::format(
+          "Cannot build a matrix array for table: {}, independent variable {} "
+          "has {} values, but dependent variable {} has {}.",
+          tbl.source.native(), ivar.name, ivar.values.size(), var.name,
+          var.values.size()));
+    }
+    std::map<double, size_t> first_seen;
+    for (auto const &v : ivar.values) {
+      auto it = first_seen.emplace(bin_key(v), first_seen.size()).first;
+      indices[d].push_back(it->second);
+    }
+    extent[d] = first_seen.size();
+  }
+
+  bool row_major = (var.values.size() == (extent[0] * extent[1]));
+  for (size_t k = 0; row_major && (k < var.values.size()); ++k) {
+    row_major = ((indices[0][k] * extent[1] + indices[1][k]) == k);
+  }
+
+  if (row_major && var.values.size()) {
+    return readonly_array(
+        &std::get<double>(var.values.front().value),
+        {py::ssize_t(extent[0]), py::ssize_t(extent[1])},
+        {py::ssize_t(extent[1] * sizeof(HEPData::Value)),
+         sizeof(HEPData::Value)},
+        base);
+  }
+
+  std::vector<double> dense(extent[0] * extent[1], 0);
+  for (size_t k = 0; k < var.values.size(); ++k) {
+    dense[indices[0][k] * extent[1] + indices[1][k]] =
+        std::get<double>(var.values[k].value);
+  }
+  return owned_array(std::move(dense),
+                     {py::ssize_t(extent[0]), py::ssize_t(extent[1])});
+}
+
+// The python exception that pybind11's registered translators raise for eptr,
+// found by rethrowing it from a bound function and catching the result.
+static py::object translated_exception(std::exception_ptr const &eptr) {
+  auto rethrow = py::cpp_function([eptr]() { std::rethrow_exception(eptr); });
+  try {
+    rethrow();
+  } catch (py::error_already_set &e) {
+    return e.value();
+  }
+  return py::none();
+}
+
+// Loads records concurrently without the GIL and returns a list with either
+// the Record or the exception raised while loading it for each reference, as
+// the python exception that the same failure raises from make_Record.
+static py::list load_records(std::vector<HEPData::ResourceReference> const &refs,
+                             std::filesystem::path const &local_cache_root,
+                             size_t workers) {
+  std::vector<std::variant<HEPData::Record, std::exception_ptr>> records;
+  {
+    py::gil_scoped_release release;
+    records = HEPData::make_Records(refs, local_cache_root, workers);
+  }
+
+  py::list results;
+  for (auto &rec : records) {
+    if (rec.index() == 0) {
+      results.append(py::cast(std::move(std::get<0>(rec))));
+      continue;
+    }
+    results.append(translated_exception(std::get<1>(rec)));
+  }
+  return results;
+}
+
+// pickling uses the compact binary encoding so that parsed records can be
+// sent to worker processes without re-reading any YAML
+template <typename T> static auto binary_pickle() {
+  return py::pickle(
+      [](T const &obj) { return py::bytes(HEPData::to_binary(obj)); },
+      [](py::bytes const &state) {
+        return HEPData::from_binary<T>(std::string_view(state));
+      });
+}
+
 PYBIND11_MODULE(pyNUISANCEHEPData, m) {
   m.doc() = "pyNUISANCEHEPData implementation in python";
 
@@ -39,7 +307,18 @@ PYBIND11_MODULE(pyNUISANCEHEPData, m) {
   py::class_<HEPData::Variable>(m, "Variable")
       .def_readonly("values", &HEPData::Variable::values)
       .def_readonly("name", &HEPData::Variable::name)
-      .def_readonly("units", &HEPData::Variable::units);
+      .def_readonly("units", &HEPData::Variable::units)
+      .def("values_array",
+           [](py::object const &self) {
+             return values_array(self.cast<HEPData::Variable const &>(), self);
+           })
+      .def("bin_edges_array",
+           [](py::object const &self) {
+             return bin_edges_array(self.cast<HEPData::Variable const &>(),
+                                    self);
+           })
+      .def("error_labels", &error_labels)
+      .def("errors_array", &errors_array, py::arg("label"));
 
   py::class_<HEPData::DependentVariable, HEPData::Variable>(m,
                                                             "DependentVariable")
@@ -47,8 +326,40 @@ PYBIND11_MODULE(pyNUISANCEHEPData, m) {
 
   py::class_<HEPData::Table>(m, "Table")
       .def_readonly("source", &HEPData::Table::source)
-      .def_readonly("independent_vars", &HEPData::Table::independent_vars)
-      .def_readonly("dependent_vars", &HEPData::Table::dependent_vars)
+      .def_property_readonly("independent_vars",
+                             views_of(&HEPData::Table::independent_vars))
+      .def_property_readonly("dependent_vars",
+                             views_of(&HEPData::Table::dependent_vars))
+      .def(
+          "values_array",
+          [](py::object const &self, size_t dv) {
+            return values_array(
+                get_dependent_var(self.cast<HEPData::Table const &>(), dv),
+                self);
+          },
+          py::arg("dv") = 0)
+      .def(
+          "errors_array",
+          [](HEPData::Table const &tbl, std::string const &label, size_t dv) {
+            return errors_array(get_dependent_var(tbl, dv), label);
+          },
+          py::arg("label"), py::arg("dv") = 0)
+      .def("bin_edges_arrays",
+           [](py::object const &self) {
+             py::list edges;
+             for (auto const &ivar :
+                  self.cast<HEPData::Table const &>().independent_vars) {
+               edges.append(bin_edges_array(ivar, self));
+             }
+             return edges;
+           })
+      .def(
+          "matrix_array",
+          [](py::object const &self, size_t dv) {
+            return matrix_array(self.cast<HEPData::Table const &>(), dv, self);
+          },
+          py::arg("dv") = 0)
+      .def(binary_pickle<HEPData::Table>())
       .def("__str__", [](HEPData::Table const &hpd) {
         std::stringstream ss;
         ss << hpd;
@@ -58,14 +369,42 @@ PYBIND11_MODULE(pyNUISANCEHEPData, m) {
   py::class_<HEPData::ProbeFlux, HEPData::Table>(m, "ProbeFlux")
       .def_readonly("probe_particle", &HEPData::ProbeFlux::probe_particle)
       .def_readonly("bin_content_type", &HEPData::ProbeFlux::bin_content_type)
+      .def_readonly("histogram", &HEPData::ProbeFlux::histogram)
+      .def(binary_pickle<HEPData::ProbeFlux>())
       .def("__str__", [](HEPData::ProbeFlux const &hpd) {
         std::stringstream ss;
         ss << hpd;
         return ss.str();
       });
 
+  py::class_<HEPData::FluxHistogram>(m, "FluxHistogram")
+      .def_readonly("integral", &HEPData::FluxHistogram::integral)
+      .def_readonly("mean", &HEPData::FluxHistogram::mean)
+      .def("nbins", &HEPData::FluxHistogram::nbins)
+      .def("density", &HEPData::FluxHistogram::density, py::arg("i"))
+      .def("edges_array",
+           [](py::object self) {
+             auto const &hist = self.cast<HEPData::FluxHistogram const &>();
+             return readonly_array(hist.edges.data(),
+                                   {py::ssize_t(hist.edges.size())},
+                                   {sizeof(double)}, self);
+           })
+      .def("counts_array",
+           [](py::object self) {
+             auto const &hist = self.cast<HEPData::FluxHistogram const &>();
+             return readonly_array(hist.counts.data(),
+                                   {py::ssize_t(hist.counts.size())},
+                                   {sizeof(double)}, self);
+           })
+      .def("cdf_array", [](py::object self) {
+        auto const &hist = self.cast<HEPData::FluxHistogram const &>();
+        return readonly_array(hist.cdf.data(), {py::ssize_t(hist.cdf.size())},
+                              {sizeof(double)}, self);
+      });
+
   py::class_<HEPData::ErrorTable, HEPData::Table>(m, "ErrorTable")
       .def_readonly("error_type", &HEPData::ErrorTable::error_type)
+      .def(binary_pickle<HEPData::ErrorTable>())
       .def("__str__", [](HEPData::ErrorTable const &hpd) {
         std::stringstream ss;
         ss << hpd;
@@ -75,6 +414,7 @@ PYBIND11_MODULE(pyNUISANCEHEPData, m) {
   py::class_<HEPData::SmearingTable, HEPData::Table>(m, "SmearingTable")
       .def_readonly("smearing_type", &HEPData::SmearingTable::smearing_type)
       .def_readonly("truth_binning", &HEPData::SmearingTable::truth_binning)
+      .def(binary_pickle<HEPData::SmearingTable>())
       .def("__str__", [](HEPData::SmearingTable const &hpd) {
         std::stringstream ss;
         ss << hpd;
@@ -87,7 +427,8 @@ PYBIND11_MODULE(pyNUISANCEHEPData, m) {
       .def_readonly("expected_test_statistic",
                     &HEPData::PredictionTable::expected_test_statistic)
       .def_readonly("pre_smeared", &HEPData::PredictionTable::pre_smeared)
-      .def_readonly("label", &HEPData::PredictionTable::label);
+      .def_readonly("label", &HEPData::PredictionTable::label)
+      .def(binary_pickle<HEPData::PredictionTable>());
 
   py::class_<HEPData::CrossSectionMeasurement::funcref>(
       m, "CrossSectionMeasurement_funcref")
@@ -120,11 +461,13 @@ PYBIND11_MODULE(pyNUISANCEHEPData, m) {
   py::class_<HEPData::CrossSectionMeasurement, HEPData::Table>(
       m, "CrossSectionMeasurement")
       .def_readonly("name", &HEPData::CrossSectionMeasurement::name)
-      .def_readonly("probe_fluxes",
-                    &HEPData::CrossSectionMeasurement::probe_fluxes)
+      .def_property_readonly(
+          "probe_fluxes", views_of(&HEPData::CrossSectionMeasurement::probe_fluxes))
       .def_readonly("targets", &HEPData::CrossSectionMeasurement::targets)
-      .def_readonly("errors", &HEPData::CrossSectionMeasurement::errors)
-      .def_readonly("smearings", &HEPData::CrossSectionMeasurement::smearings)
+      .def_property_readonly(
+          "errors", views_of(&HEPData::CrossSectionMeasurement::errors))
+      .def_property_readonly(
+          "smearings", views_of(&HEPData::CrossSectionMeasurement::smearings))
       .def_readonly("selectfuncs",
                     &HEPData::CrossSectionMeasurement::selectfuncs)
       .def_readonly("projectfuncs",
@@ -133,16 +476,20 @@ PYBIND11_MODULE(pyNUISANCEHEPData, m) {
                     &HEPData::CrossSectionMeasurement::variable_type)
       .def_readonly("measurement_type",
                     &HEPData::CrossSectionMeasurement::measurement_type)
-      .def_readonly("sub_measurements",
-                    &HEPData::CrossSectionMeasurement::sub_measurements)
+      .def_property_readonly(
+          "sub_measurements", views_of(&HEPData::CrossSectionMeasurement::sub_measurements))
       .def_readonly("cross_section_units",
                     &HEPData::CrossSectionMeasurement::cross_section_units)
+      .def_readonly("normalisation",
+                    &HEPData::CrossSectionMeasurement::normalisation)
+      .def_property_readonly(
+          "combined_probe_fluxes", views_of(&HEPData::CrossSectionMeasurement::combined_probe_fluxes))
       .def_readonly("test_statistic",
                     &HEPData::CrossSectionMeasurement::test_statistic)
       .def_readonly("project_prettynames",
                     &HEPData::CrossSectionMeasurement::project_prettynames)
-      .def_readonly("predictions",
-                    &HEPData::CrossSectionMeasurement::predictions)
+      .def_property_readonly(
+          "predictions", views_of(&HEPData::CrossSectionMeasurement::predictions))
       .def("get_single_probe_flux",
            &HEPData::CrossSectionMeasurement::get_single_probe_flux)
       .def("get_simple_target",
@@ -153,18 +500,431 @@ PYBIND11_MODULE(pyNUISANCEHEPData, m) {
            &HEPData::CrossSectionMeasurement::get_single_projectfuncs)
       .def("get_single_project_prettynames",
            &HEPData::CrossSectionMeasurement::get_single_project_prettynames)
+      .def(binary_pickle<HEPData::CrossSectionMeasurement>())
       .def("__str__", [](HEPData::CrossSectionMeasurement const &hpd) {
         std::stringstream ss;
         ss << hpd;
         return ss.str();
       });
 
+  py::class_<HEPData::CrossSectionNormalisation>(m, "CrossSectionNormalisation")
+      .def_readonly("unit_scale",
+                    &HEPData::CrossSectionNormalisation::unit_scale)
+      .def_property_readonly(
+          "target_scale",
+          [](HEPData::CrossSectionNormalisation const &norm) {
+            using TS = HEPData::CrossSectionNormalisation::TargetScale;
+            switch (norm.target_scale) {
+            case TS::kPerTargetNucleon:
+              return "PerTargetNucleon";
+            case TS::kPerTargetNeutron:
+              return "PerTargetNeutron";
+            case TS::kPerTargetProton:
+              return "PerTargetProton";
+            default:
+              return "PerTarget";
+            }
+          })
+      .def_property_readonly(
+          "density_scale",
+          [](HEPData::CrossSectionNormalisation const &norm) {
+            using DS = HEPData::CrossSectionNormalisation::DensityScale;
+            switch (norm.density_scale) {
+            case DS::kPerBinWidth:
+              return "per_bin_width";
+            case DS::kPerFirstBinWidth:
+              return "per_first_bin_width";
+            default:
+              return "";
+            }
+          })
+      .def("bin_factors_array",
+           [](py::object self) {
+             auto const &norm =
+                 self.cast<HEPData::CrossSectionNormalisation const &>();
+             return readonly_array(norm.bin_factors.data(),
+                                   {py::ssize_t(norm.bin_factors.size())},
+                                   {sizeof(double)}, self);
+           })
+      .def(
+          "apply",
+          [](HEPData::CrossSectionNormalisation const &norm,
+             py::array_t<double, py::array::c_style | py::array::forcecast>
+                 predictions) {
+            auto nbins = py::ssize_t(norm.bin_factors.size());
+            if (((predictions.ndim() != 1) && (predictions.ndim() != 2)) ||
+                (predictions.shape(predictions.ndim() - 1) != nbins)) {
+              throw std::runtime_error(fmt::format(
+                  "CrossSectionNormalisation.apply expects an array of shape "
+                  "({0},) or (nbatch, {0}).",
+                  nbins));
+            }
+            std::vector<double> preds(predictions.data(),
+                                      predictions.data() + predictions.size());
+            std::vector<py::ssize_t> shape(predictions.shape(),
+                                           predictions.shape() +
+                                               predictions.ndim());
+            return owned_array(norm.apply_batch(preds), std::move(shape));
+          },
+          py::arg("predictions"));
+
+  py::class_<HEPData::JointMeasurement::Segment>(m, "JointMeasurementSegment")
+      .def_readonly("source", &HEPData::JointMeasurement::Segment::source)
+      .def_readonly("name", &HEPData::JointMeasurement::Segment::name)
+      .def_readonly("offset", &HEPData::JointMeasurement::Segment::offset)
+      .def_readonly("size", &HEPData::JointMeasurement::Segment::size);
+
+  py::class_<HEPData::JointMeasurement>(m, "JointMeasurement")
+      .def_readonly("segments", &HEPData::JointMeasurement::segments)
+      .def("segment", &HEPData::JointMeasurement::segment, py::arg("source"))
+      .def("data_array",
+           [](py::object self) {
+             auto const &jm = self.cast<HEPData::JointMeasurement const &>();
+             return readonly_array(jm.data.data(),
+                                   {py::ssize_t(jm.data.size())},
+                                   {sizeof(double)}, self);
+           })
+      .def("covariance_array",
+           [](HEPData::JointMeasurement const &jm) {
+             auto n = py::ssize_t(jm.covariance.size());
+             return owned_array(jm.covariance.to_dense(), {n, n});
+           })
+      .def("inverse_covariance_array",
+           [](HEPData::JointMeasurement const &jm) {
+             auto n = py::ssize_t(jm.covariance.size());
+             return owned_array(
+                 HEPData::factorize(jm.covariance).inverse().to_dense(),
+                 {n, n});
+           });
+
+  m.def("flatten_measurement", &HEPData::flatten_measurement, py::arg("xsm"));
+
+  py::class_<HEPData::CrossCovariance>(m, "CrossCovariance")
+      .def(py::init([](size_t first, size_t second,
+                       py::array_t<double, py::array::c_style |
+                                               py::array::forcecast>
+                           covariance) {
+             return HEPData::CrossCovariance{
+                 first, second,
+                 std::vector<double>(covariance.data(),
+                                     covariance.data() + covariance.size())};
+           }),
+           py::arg("first"), py::arg("second"), py::arg("covariance"))
+      .def_readonly("first", &HEPData::CrossCovariance::first)
+      .def_readonly("second", &HEPData::CrossCovariance::second);
+
+  py::class_<HEPData::JointLikelihood>(m, "JointLikelihood")
+      .def_readonly("measurements", &HEPData::JointLikelihood::measurements)
+      .def_readonly("offsets", &HEPData::JointLikelihood::offsets)
+      .def("data_array",
+           [](py::object self) {
+             auto const &jl = self.cast<HEPData::JointLikelihood const &>();
+             return readonly_array(jl.data.data(),
+                                   {py::ssize_t(jl.data.size())},
+                                   {sizeof(double)}, self);
+           })
+      .def("covariance_array",
+           [](HEPData::JointLikelihood const &jl) {
+             auto n = py::ssize_t(jl.covariance.size());
+             return owned_array(jl.covariance.to_dense(), {n, n});
+           })
+      .def(
+          "chi2",
+          [](HEPData::JointLikelihood const &jl,
+             std::vector<std::vector<double>> const &predictions,
+             size_t workers) {
+            py::gil_scoped_release release;
+            return jl.chi2(predictions, workers);
+          },
+          py::arg("predictions"), py::arg("workers") = 1);
+
+  py::class_<HEPData::PoissonLikelihood>(m, "PoissonLikelihood")
+      .def_readonly("counts", &HEPData::PoissonLikelihood::counts)
+      .def_readonly("saturated_log_likelihood",
+                    &HEPData::PoissonLikelihood::saturated_log_likelihood)
+      .def(
+          "log_likelihood",
+          [](HEPData::PoissonLikelihood const &pl,
+             py::array_t<double, py::array::c_style | py::array::forcecast>
+                 predictions,
+             bool gradient) -> py::object {
+            auto nbins = py::ssize_t(pl.size());
+            if (((predictions.ndim() != 1) && (predictions.ndim() != 2)) ||
+                (predictions.shape(predictions.ndim() - 1) != nbins)) {
+              throw std::runtime_error(fmt::format(
+                  "PoissonLikelihood.log_likelihood expects an array of "
+                  "shape ({0},) or (nbatch, {0}).",
+                  nbins));
+            }
+            std::vector<double> preds(predictions.data(),
+                                      predictions.data() + predictions.size());
+            std::vector<double> grads, llhs;
+            {
+              py::gil_scoped_release release;
+              llhs = pl.log_likelihood_batch(preds,
+                                             gradient ? &grads : nullptr);
+            }
+
+            if (predictions.ndim() == 1) {
+              if (!gradient) {
+                return py::float_(llhs.front());
+              }
+              return py::make_tuple(llhs.front(),
+                                    owned_array(std::move(grads), {nbins}));
+            }
+            auto nbatch = py::ssize_t(llhs.size());
+            auto llh_arr = owned_array(std::move(llhs), {nbatch});
+            if (!gradient) {
+              return std::move(llh_arr);
+            }
+            return py::make_tuple(llh_arr,
+                                  owned_array(std::move(grads), {nbatch, nbins}));
+          },
+          py::arg("predictions"), py::arg("gradient") = false)
+      .def("chi2", &HEPData::PoissonLikelihood::chi2, py::arg("prediction"));
+
+  m.def("make_PoissonLikelihood", &HEPData::make_PoissonLikelihood,
+        py::arg("xsm"));
+
+  m.def("evaluate_test_statistic",
+        py::overload_cast<HEPData::CrossSectionMeasurement const &,
+                          HEPData::PredictionTable const &>(
+            &HEPData::evaluate_test_statistic),
+        py::arg("xsm"), py::arg("prediction"))
+      .def("evaluate_test_statistic",
+           py::overload_cast<HEPData::CrossSectionMeasurement const &,
+                             std::vector<double> const &>(
+               &HEPData::evaluate_test_statistic),
+           py::arg("xsm"), py::arg("prediction"))
+      .def("smear_prediction", &HEPData::smear_prediction, py::arg("xsm"),
+           py::arg("truth"));
+
+  py::class_<HEPData::PredictionCheck>(m, "PredictionCheck")
+      .def_readonly("record_ref", &HEPData::PredictionCheck::record_ref)
+      .def_readonly("measurement", &HEPData::PredictionCheck::measurement)
+      .def_readonly("prediction", &HEPData::PredictionCheck::prediction)
+      .def_readonly("prediction_name",
+                    &HEPData::PredictionCheck::prediction_name)
+      .def_readonly("label", &HEPData::PredictionCheck::label)
+      .def_readonly("test_statistic", &HEPData::PredictionCheck::test_statistic)
+      .def_readonly("pre_smeared", &HEPData::PredictionCheck::pre_smeared)
+      .def_readonly("expected", &HEPData::PredictionCheck::expected)
+      .def_readonly("computed", &HEPData::PredictionCheck::computed)
+      .def_property_readonly("status",
+                             [](HEPData::PredictionCheck const &check) {
+                               return HEPData::to_string(check.status);
+                             })
+      .def_readonly("error", &HEPData::PredictionCheck::error);
+
+  m.def(
+       "verify_predictions",
+       [](std::vector<std::string> const &refstrs,
+          std::filesystem::path const &local_cache_root, double tolerance,
+          size_t workers) {
+         std::vector<HEPData::ResourceReference> refs;
+         for (auto const &refstr : refstrs) {
+           refs.emplace_back(refstr);
+         }
+         py::gil_scoped_release release;
+         return HEPData::verify_predictions(refs, local_cache_root, tolerance,
+                                            workers);
+       },
+       py::arg("refs"), py::arg("local_cache_root") = ".",
+       py::arg("tolerance") = 1E-3, py::arg("workers") = 0)
+      .def("verify_predictions",
+           py::overload_cast<HEPData::Record const &, double>(
+               &HEPData::verify_predictions),
+           py::arg("record"), py::arg("tolerance") = 1E-3,
+           py::call_guard<py::gil_scoped_release>())
+      .def("verify_all_predictions", &HEPData::verify_all_predictions,
+           py::arg("local_cache_root") = ".", py::arg("tolerance") = 1E-3,
+           py::arg("workers") = 0, py::call_guard<py::gil_scoped_release>());
+
+  py::class_<HEPData::Rebinner>(m, "Rebinner")
+      .def_readonly("nsource", &HEPData::Rebinner::nsource)
+      .def_readonly("ntarget", &HEPData::Rebinner::ntarget)
+      .def(
+          "apply",
+          [](HEPData::Rebinner const &rb,
+             py::array_t<double, py::array::c_style | py::array::forcecast>
+                 histograms) {
+            if (((histograms.ndim() != 1) && (histograms.ndim() != 2)) ||
+                (histograms.shape(histograms.ndim() - 1) !=
+                 py::ssize_t(rb.nsource))) {
+              throw std::runtime_error(
+                  fmt::format("Rebinner.apply expects an array of shape ({0},) "
+                              "or (nbatch, {0}).",
+                              rb.nsource));
+            }
+            std::vector<double> hists(histograms.data(),
+                                      histograms.data() + histograms.size());
+            auto rebinned = rb.apply_batch(hists);
+            if (histograms.ndim() == 1) {
+              return owned_array(std::move(rebinned),
+                                 {py::ssize_t(rb.ntarget)});
+            }
+            return owned_array(std::move(rebinned),
+                               {histograms.shape(0), py::ssize_t(rb.ntarget)});
+          },
+          py::arg("histograms"))
+      .def("matrix_array", [](HEPData::Rebinner const &rb) {
+        return owned_array(rb.to_dense(), {py::ssize_t(rb.ntarget),
+                                           py::ssize_t(rb.nsource)});
+      });
+
+  m.def("make_Rebinner", &HEPData::make_Rebinner, py::arg("source"),
+        py::arg("target"))
+      .def("projected_binning", &HEPData::projected_binning,
+           py::arg("binning"), py::arg("axes"));
+
+  m.def("make_FluxHistogram", &HEPData::make_FluxHistogram, py::arg("flux"))
+      .def("combine_FluxHistograms", &HEPData::combine_FluxHistograms,
+           py::arg("fluxes"), py::arg("weights"));
+
+  py::class_<HEPData::FluxSampler>(m, "FluxSampler")
+      .def("edges_array",
+           [](py::object self) {
+             auto const &fs = self.cast<HEPData::FluxSampler const &>();
+             return readonly_array(fs.edges.data(),
+                                   {py::ssize_t(fs.edges.size())},
+                                   {sizeof(double)}, self);
+           })
+      .def(
+          "sample",
+          [](HEPData::FluxSampler const &fs,
+             py::array_t<double, py::array::c_style | py::array::forcecast>
+                 uniforms) {
+            if (((uniforms.ndim() != 1) && (uniforms.ndim() != 2)) ||
+                (uniforms.shape(uniforms.ndim() - 1) % 2) ||
+                ((uniforms.ndim() == 2) && (uniforms.shape(1) != 2))) {
+              throw std::runtime_error(
+                  "FluxSampler.sample expects an array of uniform numbers of "
+                  "shape (2n,) or (n, 2).");
+            }
+            std::vector<double> energies(uniforms.size() / 2);
+            fs.sample(uniforms.data(), energies.data(), energies.size());
+            return owned_array(std::move(energies),
+                               {py::ssize_t(uniforms.size() / 2)});
+          },
+          py::arg("uniforms"))
+      .def(
+          "sample",
+          [](HEPData::FluxSampler const &fs, size_t n, std::uint64_t seed) {
+            std::mt19937_64 rng(seed);
+            std::vector<double> energies(n);
+            {
+              py::gil_scoped_release release;
+              fs.fill(rng, energies.data(), n);
+            }
+            return owned_array(std::move(energies), {py::ssize_t(n)});
+          },
+          py::arg("n"), py::arg("seed"));
+
+  m.def("make_FluxSampler",
+        py::overload_cast<HEPData::FluxHistogram const &>(
+            &HEPData::make_FluxSampler),
+        py::arg("flux"))
+      .def("make_FluxSampler",
+           py::overload_cast<HEPData::ProbeFlux const &>(
+               &HEPData::make_FluxSampler),
+           py::arg("flux"));
+
+  py::class_<HEPData::FluxReweighter>(m, "FluxReweighter")
+      .def("edges_array",
+           [](py::object self) {
+             auto const &fr = self.cast<HEPData::FluxReweighter const &>();
+             return readonly_array(fr.edges.data(),
+                                   {py::ssize_t(fr.edges.size())},
+                                   {sizeof(double)}, self);
+           })
+      .def("weights_array",
+           [](py::object self) {
+             auto const &fr = self.cast<HEPData::FluxReweighter const &>();
+             return readonly_array(fr.weights.data(),
+                                   {py::ssize_t(fr.weights.size())},
+                                   {sizeof(double)}, self);
+           })
+      .def(
+          "weight",
+          [](HEPData::FluxReweighter const &fr,
+             py::array_t<double, py::array::c_style | py::array::forcecast>
+                 energies) {
+            std::vector<double> event_weights(energies.size());
+            {
+              py::gil_scoped_release release;
+              fr.weight(energies.data(), event_weights.data(),
+                        event_weights.size());
+            }
+            std::vector<py::ssize_t> shape(energies.shape(),
+                                           energies.shape() + energies.ndim());
+            return owned_array(std::move(event_weights), std::move(shape));
+          },
+          py::arg("energies"));
+
+  m.def("make_FluxReweighter",
+        py::overload_cast<HEPData::FluxHistogram const &,
+                          HEPData::FluxHistogram const &>(
+            &HEPData::make_FluxReweighter),
+        py::arg("nominal"), py::arg("alternate"))
+      .def("make_FluxReweighter",
+           py::overload_cast<HEPData::ProbeFlux const &,
+                             HEPData::ProbeFlux const &>(
+               &HEPData::make_FluxReweighter),
+           py::arg("nominal"), py::arg("alternate"));
+
+  py::class_<HEPData::ToyGenerator>(m, "ToyGenerator")
+      .def_readonly("measurement", &HEPData::ToyGenerator::measurement)
+      .def_readonly("test_statistic", &HEPData::ToyGenerator::test_statistic)
+      .def_readonly("seed", &HEPData::ToyGenerator::seed)
+      .def("size", &HEPData::ToyGenerator::size)
+      .def("mean_array",
+           [](py::object self) {
+             auto const &tg = self.cast<HEPData::ToyGenerator const &>();
+             return readonly_array(tg.mean.data(),
+                                   {py::ssize_t(tg.mean.size())},
+                                   {sizeof(double)}, self);
+           })
+      .def(
+          "generate",
+          [](HEPData::ToyGenerator const &tg, size_t first, size_t ntoys,
+             size_t workers) {
+            std::vector<double> toys;
+            {
+              py::gil_scoped_release release;
+              toys = tg.generate(first, ntoys, workers);
+            }
+            return owned_array(std::move(toys), {py::ssize_t(ntoys),
+                                                 py::ssize_t(tg.size())});
+          },
+          py::arg("first"), py::arg("ntoys"), py::arg("workers") = 1)
+      .def(
+          "test_statistics",
+          [](HEPData::ToyGenerator const &tg, size_t first, size_t ntoys,
+             size_t workers) {
+            std::vector<double> stats;
+            {
+              py::gil_scoped_release release;
+              stats = tg.test_statistics(first, ntoys, workers);
+            }
+            return owned_array(std::move(stats), {py::ssize_t(ntoys)});
+          },
+          py::arg("first"), py::arg("ntoys"), py::arg("workers") = 1);
+
+  m.def("make_ToyGenerator", &HEPData::make_ToyGenerator, py::arg("xsm"),
+        py::arg("seed"), py::arg("prediction") = std::vector<double>{});
+
+  m.def("make_JointLikelihood", &HEPData::make_JointLikelihood,
+        py::arg("measurements"), py::arg("cross_covariances") =
+                                     std::vector<HEPData::CrossCovariance>{});
+
   py::class_<HEPData::Record>(m, "Record")
       .def_readonly("record_root", &HEPData::Record::record_root)
       .def_readonly("record_ref", &HEPData::Record::record_ref)
-      .def_readonly("measurements", &HEPData::Record::measurements)
+      .def_property_readonly("measurements",
+                             views_of(&HEPData::Record::measurements))
       .def_readonly("additional_resources",
                     &HEPData::Record::additional_resources)
+      .def(binary_pickle<HEPData::Record>())
       .def("__str__", [](HEPData::Record const &hpd) {
         std::stringstream ss;
         ss << hpd;
@@ -182,8 +942,100 @@ PYBIND11_MODULE(pyNUISANCEHEPData, m) {
 
   m.def("PathResourceReference", &HEPData::PathResourceReference);
 
+  m.def("get_record_endpoints", &HEPData::get_record_endpoints)
+      .def("set_record_endpoints", &HEPData::set_record_endpoints,
+           py::arg("endpoints"));
+
+  m.def("get_incremental_fetch", &HEPData::get_incremental_fetch)
+      .def("set_incremental_fetch", &HEPData::set_incremental_fetch,
+           py::arg("enabled"));
+
+  m.def("get_archive_records", &HEPData::get_archive_records)
+      .def("set_archive_records", &HEPData::set_archive_records,
+           py::arg("enabled"))
+      .def(
+          "read_resource",
+          [](std::filesystem::path const &path) {
+            return py::bytes(HEPData::read_resource(path));
+          },
+          py::arg("path"));
+
+  m.def("get_deduplicate_records", &HEPData::get_deduplicate_records)
+      .def("set_deduplicate_records", &HEPData::set_deduplicate_records,
+           py::arg("enabled"))
+      .def("deduplicate_records", &HEPData::deduplicate_records,
+           py::arg("local_cache_root") = ".",
+           py::call_guard<py::gil_scoped_release>());
+
+  py::class_<HEPData::IndexEntry>(m, "IndexEntry")
+      .def_readonly("record_ref", &HEPData::IndexEntry::record_ref)
+      .def_readonly("table", &HEPData::IndexEntry::table)
+      .def_readonly("resource", &HEPData::IndexEntry::resource)
+      .def_readonly("dependent_var", &HEPData::IndexEntry::dependent_var)
+      .def_readonly("location", &HEPData::IndexEntry::location)
+      .def_readonly("variable_type", &HEPData::IndexEntry::variable_type)
+      .def_readonly("qualifiers", &HEPData::IndexEntry::qualifiers)
+      .def_readonly("targets", &HEPData::IndexEntry::targets)
+      .def_readonly("probe_particles", &HEPData::IndexEntry::probe_particles)
+      .def_readonly("measurement_type", &HEPData::IndexEntry::measurement_type)
+      .def_readonly("test_statistic", &HEPData::IndexEntry::test_statistic)
+      .def("ref", &HEPData::IndexEntry::ref);
+
+  m.def(
+      "query_record_index",
+      [](std::filesystem::path const &local_cache_root,
+         std::map<std::string, std::string> const &conditions) {
+        return HEPData::query_record_index(
+            HEPData::read_record_index(local_cache_root),
+            {conditions.begin(), conditions.end()});
+      },
+      py::arg("local_cache_root"), py::arg("conditions"));
+
+  m.def(
+      "rebuild_record_index",
+      [](std::filesystem::path const &local_cache_root) {
+        return HEPData::rebuild_record_index(local_cache_root).records.size();
+      },
+      py::arg("local_cache_root") = ".",
+      py::call_guard<py::gil_scoped_release>());
+
+  py::class_<HEPData::CacheGCResult>(m, "CacheGCResult")
+      .def_readonly("size_before", &HEPData::CacheGCResult::size_before)
+      .def_readonly("size_after", &HEPData::CacheGCResult::size_after)
+      .def_readonly("records_evicted", &HEPData::CacheGCResult::records_evicted)
+      .def_readonly("snapshots_evicted",
+                    &HEPData::CacheGCResult::snapshots_evicted);
+
+  m.def(
+      "cache_gc",
+      [](std::filesystem::path const &local_cache_root, uintmax_t max_size,
+         double min_age) {
+        return HEPData::cache_gc(local_cache_root, max_size,
+                                 std::chrono::seconds(long(min_age)));
+      },
+      py::arg("local_cache_root"), py::arg("max_size"),
+      py::arg("min_age") = 3600, py::call_guard<py::gil_scoped_release>());
+
+  m.def("get_http_timeouts",
+        []() {
+          auto [connect_timeout, total_timeout] = HEPData::get_http_timeouts();
+          return std::make_pair(connect_timeout.count() / 1000.0,
+                                total_timeout.count() / 1000.0);
+        })
+      .def(
+          "set_http_timeouts",
+          [](double connect_timeout, double total_timeout) {
+            HEPData::set_http_timeouts(
+                std::chrono::milliseconds(long(connect_timeout * 1000)),
+                std::chrono::milliseconds(long(total_timeout * 1000)));
+          },
+          py::arg("connect_timeout"), py::arg("total_timeout"));
+
+  // the C++ work, including any downloads, runs without the GIL so that
+  // python threads can make progress concurrently
   m.def("make_CrossSectionMeasurement", &HEPData::make_CrossSectionMeasurement,
-        py::arg("ref"), py::arg("local_cache_root") = ".")
+        py::arg("ref"), py::arg("local_cache_root") = ".",
+        py::call_guard<py::gil_scoped_release>())
       .def(
           "make_CrossSectionMeasurement",
           [](std::string const &ref,
@@ -191,27 +1043,74 @@ PYBIND11_MODULE(pyNUISANCEHEPData, m) {
             return make_CrossSectionMeasurement(HEPData::ResourceReference(ref),
                                                 local_cache_root);
           },
-          py::arg("ref"), py::arg("local_cache_root") = ".")
+          py::arg("ref"), py::arg("local_cache_root") = ".",
+          py::call_guard<py::gil_scoped_release>())
       .def("make_Record",
            py::overload_cast<HEPData::ResourceReference,
                              std::filesystem::path const &>(
                &HEPData::make_Record),
-           py::arg("ref"), py::arg("local_cache_root") = ".")
+           py::arg("ref"), py::arg("local_cache_root") = ".",
+           py::call_guard<py::gil_scoped_release>())
       .def("make_Record",
            py::overload_cast<std::filesystem::path const &,
                              std::filesystem::path const &>(
                &HEPData::make_Record),
-           py::arg("location"), py::arg("local_cache_root") = ".")
-      .def("resolve_reference", &HEPData::resolve_reference, py::arg("ref"),
-           py::arg("local_cache_root") = ".")
+           py::arg("location"), py::arg("local_cache_root") = ".",
+           py::call_guard<py::gil_scoped_release>())
+      .def(
+          "resolve_reference",
+          [](HEPData::ResourceReference const &ref,
+             std::filesystem::path const &local_cache_root) {
+            return HEPData::extract_resource(
+                HEPData::resolve_reference(ref, local_cache_root));
+          },
+          py::arg("ref"), py::arg("local_cache_root") = ".",
+          py::call_guard<py::gil_scoped_release>())
       .def(
           "resolve_reference",
           [](std::string const &ref,
              std::filesystem::path const &local_cache_root) {
-            return HEPData::resolve_reference(HEPData::ResourceReference(ref),
-                                              local_cache_root);
+            return HEPData::extract_resource(HEPData::resolve_reference(
+                HEPData::ResourceReference(ref), local_cache_root));
+          },
+          py::arg("ref"), py::arg("local_cache_root") = ".",
+          py::call_guard<py::gil_scoped_release>())
+      .def("load_records", &load_records, py::arg("refs"),
+           py::arg("local_cache_root") = ".", py::arg("workers") = 0)
+      .def(
+          "load_records",
+          [](std::vector<std::string> const &refstrs,
+             std::filesystem::path const &local_cache_root, size_t workers) {
+            std::vector<HEPData::ResourceReference> refs;
+            for (auto const &refstr : refstrs) {
+              refs.emplace_back(refstr);
+            }
+            return load_records(refs, local_cache_root, workers);
+          },
+          py::arg("refs"), py::arg("local_cache_root") = ".",
+          py::arg("workers") = 0)
+      .def(
+          "fetch_served_Record",
+          [](std::string const &ref, std::filesystem::path const &socket,
+             bool shared_memory) {
+            return HEPData::fetch_served_Record(
+                HEPData::ResourceReference(ref), socket,
+                shared_memory ? HEPData::ServerTransport::kSharedMemory
+                              : HEPData::ServerTransport::kSocket);
+          },
+          py::arg("ref"), py::arg("socket"), py::arg("shared_memory") = false,
+          py::call_guard<py::gil_scoped_release>())
+      .def(
+          "fetch_served_CrossSectionMeasurement",
+          [](std::string const &ref, std::filesystem::path const &socket,
+             bool shared_memory) {
+            return HEPData::fetch_served_CrossSectionMeasurement(
+                HEPData::ResourceReference(ref), socket,
+                shared_memory ? HEPData::ServerTransport::kSharedMemory
+                              : HEPData::ServerTransport::kSocket);
           },
-          py::arg("ref"), py::arg("local_cache_root") = ".");
+          py::arg("ref"), py::arg("socket"), py::arg("shared_memory") = false,
+          py::call_guard<py::gil_scoped_release>());
 
   m.def(
        "enable_debug",
@@ -0,0 +1,568 @@
+#include "nuis/HEPData/BinarySerialization.h"
+
+#include "fmt/core.h"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+
+namespace nuis::HEPData {
+
+namespace {
+
+constexpr char magic[] = {'N', 'H', 'P', 'B'};
+constexpr uint8_t format_version = 1;
+
+enum class ObjectType : uint8_t {
+  kTable = 1,
+  kProbeFlux,
+  kErrorTable,
+  kSmearingTable,
+  kPredictionTable,
+  kCrossSectionMeasurement,
+  kRecord,
+  kRecordIndex
+};
+
+template <typename T> struct object_type;
+template <> struct object_type<Table> {
+  static constexpr ObjectType value = ObjectType::kTable;
+  static constexpr char const *name = "Table";
+};
+template <> struct object_type<ProbeFlux> {
+  static constexpr ObjectType value = ObjectType::kProbeFlux;
+  static constexpr char const *name = "ProbeFlux";
+};
+template <> struct object_type<ErrorTable> {
+  static constexpr ObjectType value = ObjectType::kErrorTable;
+  static constexpr char const *name = "ErrorTable";
+};
+template <> struct object_type<SmearingTable> {
+  static constexpr ObjectType value = ObjectType::kSmearingTable;
+  static constexpr char const *name = "SmearingTable";
+};
+template <> struct object_type<PredictionTable> {
+  static constexpr ObjectType value = ObjectType::kPredictionTable;
+  static constexpr char const *name = "PredictionTable";
+};
+template <> struct object_type<CrossSectionMeasurement> {
+  static constexpr ObjectType value = ObjectType::kCrossSectionMeasurement;
+  static constexpr char const *name = "CrossSectionMeasurement";
+};
+template <> struct object_type<Record> {
+  static constexpr ObjectType value = ObjectType::kRecord;
+  static constexpr char const *name = "Record";
+};
+template <> struct object_type<RecordIndex> {
+  static constexpr ObjectType value = ObjectType::kRecordIndex;
+  static constexpr char const *name = "RecordIndex";
+};
+
+// Strings are interned as they are written: the first occurrence of a string
+// is written as the next unused index followed by its length and bytes, later
+// occurrences are written as just the index. Error labels, units, and
+// qualifier keys are repeated many times in a typical record.
+class Writer {
+  std::string buf;
+  std::unordered_map<std::string, uint64_t> strings;
+
+public:
+  std::string take() { return std::move(buf); }
+
+  template <typename T> void raw(T v) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    buf.append(reinterpret_cast<char const *>(&v), sizeof(T));
+  }
+
+  void varint(uint64_t v) {
+    while (v >= 0x80) {
+      buf.push_back(char((v & 0x7F) | 0x80));
+      v >>= 7;
+    }
+    buf.push_back(char(v));
+  }
+
+  void write(std::string const &str) {
+    auto [it, inserted] = strings.emplace(str, strings.size());
+    varint(it->second);
+    if (inserted) {
+      varint(str.size());
+      buf.append(str);
+    }
+  }
+
+  void write(std::filesystem::path const &p) { write(p.native()); }
+  void write(double d) { raw(d); }
+  void write(bool b) { raw(uint8_t(b)); }
+  void write(int i) { raw(int32_t(i)); }
+
+  template <typename T> void write(std::vector<T> const &vec) {
+    varint(vec.size());
+    for (auto const &el : vec) {
+      write(el);
+    }
+  }
+
+  template <typename V> void write(std::map<std::string, V> const &map) {
+    varint(map.size());
+    for (auto const &[k, v] : map) {
+      write(k);
+      write(v);
+    }
+  }
+
+  void write(std::set<std::string> const &set) {
+    varint(set.size());
+    for (auto const &el : set) {
+      write(el);
+    }
+  }
+
+  // the variant index and the number of errors share a single varint
+  void write(Value const &val) {
+    varint((uint64_t(val.errors.size()) << 1) | val.value.index());
+    if (val.value.index() == 0) {
+      auto const &ext = std::get<Extent>(val.value);
+      raw(ext.low);
+      raw(ext.high);
+    } else {
+      raw(std::get<double>(val.value));
+    }
+    for (auto const &[label, err] : val.errors) {
+      write(label);
+      raw(err);
+    }
+  }
+
+  void write(Variable const &var) {
+    write(var.values);
+    write(var.name);
+    write(var.units);
+  }
+
+  void write(DependentVariable const &var) {
+    write(static_cast<Variable const &>(var));
+    write(var.qualifiers);
+    write(var.prettyname);
+  }
+
+  void write(Table const &tbl) {
+    write(tbl.source);
+    write(tbl.independent_vars);
+    write(tbl.dependent_vars);
+  }
+
+  void write(ProbeFlux const &pf) {
+    write(static_cast<Table const &>(pf));
+    write(pf.probe_particle);
+    write(pf.bin_content_type);
+  }
+
+  void write(ErrorTable const &et) {
+    write(static_cast<Table const &>(et));
+    write(et.error_type);
+  }
+
+  void write(SmearingTable const &st) {
+    write(static_cast<Table const &>(st));
+    write(st.smearing_type);
+    write(st.truth_binning);
+  }
+
+  void write(PredictionTable const &pt) {
+    write(static_cast<Table const &>(pt));
+    write(pt.for_measurement);
+    write(pt.expected_test_statistic);
+    write(pt.pre_smeared);
+    write(pt.label);
+  }
+
+  template <typename T>
+  void write(CrossSectionMeasurement::Weighted<T> const &wobj) {
+    write(wobj.obj);
+    write(wobj.weight);
+  }
+
+  void write(CrossSectionMeasurement::Target const &tgt) {
+    write(tgt.A);
+    write(tgt.Z);
+  }
+
+  void write(CrossSectionMeasurement::funcref const &fref) {
+    write(fref.source);
+    write(fref.fname);
+  }
+
+  void write(CrossSectionMeasurement const &xsm) {
+    write(static_cast<Table const &>(xsm));
+    write(xsm.name);
+    write(xsm.is_composite);
+    write(xsm.variable_type);
+    write(xsm.measurement_type);
+    write(xsm.cross_section_units);
+    write(xsm.test_statistic);
+    write(xsm.probe_fluxes);
+    write(xsm.targets);
+    write(xsm.errors);
+    write(xsm.smearings);
+    write(xsm.sub_measurements);
+    write(xsm.selectfuncs);
+    write(xsm.projectfuncs);
+    write(xsm.project_prettynames);
+    write(xsm.predictions);
+  }
+
+  void write(ResourceReference const &ref) {
+    write(ref.reftype);
+    varint(ref.recordid);
+    write(ref.recordvers);
+    write(ref.path);
+    write(ref.resourcename);
+    write(ref.qualifier);
+    write(ref.refstr);
+    write(ref.context_refstr);
+    write(ref.valid);
+  }
+
+  void write(Record const &rec) {
+    write(rec.record_root);
+    write(rec.record_ref);
+    write(rec.measurements);
+    write(rec.additional_resources);
+  }
+
+  void write(IndexEntry const &entry) {
+    write(entry.record_ref);
+    write(entry.table);
+    write(entry.resource);
+    write(entry.dependent_var);
+    write(entry.location);
+    write(entry.variable_type);
+    write(entry.qualifiers);
+    write(entry.targets);
+    write(entry.probe_particles);
+    write(entry.measurement_type);
+    write(entry.test_statistic);
+  }
+
+  void write(RecordIndex const &index) { write(index.records); }
+};
+
+class Reader {
+  char const *it;
+  char const *end;
+  std::vector<std::string> strings;
+
+  void require(size_t nbytes) {
+    if (size_t(end - it) < nbytes) {
+      throw std::runtime_error(
+          "Binary encoded NUISANCE HEPData object is truncated.");
+    }
+  }
+
+public:
+  Reader(std::string_view bytes)
+      : it{bytes.data()}, end{bytes.data() + bytes.size()} {}
+
+  bool at_end() const { return it == end; }
+
+  template <typename T> T raw() {
+    static_assert(std::is_trivially_copyable_v<T>);
+    require(sizeof(T));
+    T v;
+    std::memcpy(&v, it, sizeof(T));
+    it += sizeof(T);
+    return v;
+  }
+
+  uint64_t varint() {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      require(1);
+      uint8_t byte = uint8_t(*it++);
+      v |= uint64_t(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) {
+        return v;
+      }
+    }
+    throw std::runtime_error(
+        "Binary encoded NUISANCE HEPData object contains a malformed integer.");
+  }
+
+  // the remaining bytes bound any container size, which stops a corrupt
+  // length from triggering a huge allocation
+  size_t size() {
+    auto n = varint();
+    require(n);
+    return size_t(n);
+  }
+
+  void read(std::string &str) {
+    auto idx = varint();
+    if (idx < strings.size()) {
+      str = strings[idx];
+      return;
+    }
+    if (idx != strings.size()) {
+      throw std::runtime_error(fmt::format(
+          "Binary encoded NUISANCE HEPData object refers to string {} before "
+          "it is defined.",
+          idx));
+    }
+    auto len = size();
+    str.assign(it, len);
+    it += len;
+    strings.push_back(str);
+  }
+
+  void read(std::filesystem::path &p) {
+    std::string str;
+    read(str);
+    p = std::move(str);
+  }
+  void read(double &d) { d = raw<double>(); }
+  void read(bool &b) { b = raw<uint8_t>(); }
+  void read(int &i) { i = raw<int32_t>(); }
+
+  template <typename T> void read(std::vector<T> &vec) {
+    vec.resize(size());
+    for (auto &el : vec) {
+      read(el);
+    }
+  }
+
+  template <typename V> void read(std::map<std::string, V> &map) {
+    map.clear();
+    for (size_t n = size(); n > 0; --n) {
+      std::string k;
+      read(k);
+      read(map[k]);
+    }
+  }
+
+  void read(std::set<std::string> &set) {
+    set.clear();
+    for (size_t n = size(); n > 0; --n) {
+      std::string el;
+      read(el);
+      set.insert(std::move(el));
+    }
+  }
+
+  void read(Value &val) {
+    auto header = varint();
+    if (header & 1) {
+      val.value = raw<double>();
+    } else {
+      Extent ext;
+      ext.low = raw<double>();
+      ext.high = raw<double>();
+      val.value = ext;
+    }
+    val.errors.clear();
+    for (auto n = header >> 1; n > 0; --n) {
+      std::string label;
+      read(label);
+      val.errors[label] = raw<double>();
+    }
+  }
+
+  void read(Variable &var) {
+    read(var.values);
+    read(var.name);
+    read(var.units);
+  }
+
+  void read(DependentVariable &var) {
+    read(static_cast<Variable &>(var));
+    read(var.qualifiers);
+    read(var.prettyname);
+  }
+
+  void read(Table &tbl) {
+    read(tbl.source);
+    read(tbl.independent_vars);
+    read(tbl.dependent_vars);
+  }
+
+  void read(ProbeFlux &pf) {
+    read(static_cast<Table &>(pf));
+    read(pf.probe_particle);
+    read(pf.bin_content_type);
+    // derived from the fields above rather than stored, make_ProbeFlux has
+    // already warned about any flux that has no histogram
+    try {
+      pf.histogram = make_FluxHistogram(pf);
+    } catch (std::exception const &) {
+      pf.histogram = FluxHistogram{};
+    }
+  }
+
+  void read(ErrorTable &et) {
+    read(static_cast<Table &>(et));
+    read(et.error_type);
+  }
+
+  void read(SmearingTable &st) {
+    read(static_cast<Table &>(st));
+    read(st.smearing_type);
+    read(st.truth_binning);
+  }
+
+  void read(PredictionTable &pt) {
+    read(static_cast<Table &>(pt));
+    read(pt.for_measurement);
+    read(pt.expected_test_statistic);
+    read(pt.pre_smeared);
+    read(pt.label);
+  }
+
+  template <typename T> void read(CrossSectionMeasurement::Weighted<T> &wobj) {
+    read(wobj.obj);
+    read(wobj.weight);
+  }
+
+  void read(CrossSectionMeasurement::Target &tgt) {
+    read(tgt.A);
+    read(tgt.Z);
+  }
+
+  void read(CrossSectionMeasurement::funcref &fref) {
+    read(fref.source);
+    read(fref.fname);
+  }
+
+  void read(CrossSectionMeasurement &xsm) {
+    read(static_cast<Table &>(xsm));
+    read(xsm.name);
+    read(xsm.is_composite);
+    read(xsm.variable_type);
+    read(xsm.measurement_type);
+    read(xsm.cross_section_units);
+    read(xsm.test_statistic);
+    read(xsm.probe_fluxes);
+    read(xsm.targets);
+    read(xsm.errors);
+    read(xsm.smearings);
+    read(xsm.sub_measurements);
+    read(xsm.selectfuncs);
+    read(xsm.projectfuncs);
+    read(xsm.project_prettynames);
+    read(xsm.predictions);
+    // derived from the fields above rather than stored,
+    // make_CrossSectionMeasurement has already warned about any measurement
+    // that has no normalisation
+    try {
+      xsm.normalisation = make_CrossSectionNormalisation(xsm);
+    } catch (std::exception const &) {
+      xsm.normalisation = CrossSectionNormalisation{};
+    }
+    xsm.combined_probe_fluxes = make_combined_probe_fluxes(xsm);
+  }
+
+  void read(ResourceReference &ref) {
+    read(ref.reftype);
+    ref.recordid = varint();
+    read(ref.recordvers);
+    read(ref.path);
+    read(ref.resourcename);
+    read(ref.qualifier);
+    read(ref.refstr);
+    read(ref.context_refstr);
+    read(ref.valid);
+  }
+
+  void read(Record &rec) {
+    read(rec.record_root);
+    read(rec.record_ref);
+    read(rec.measurements);
+    read(rec.additional_resources);
+  }
+
+  void read(IndexEntry &entry) {
+    read(entry.record_ref);
+    read(entry.table);
+    read(entry.resource);
+    read(entry.dependent_var);
+    read(entry.location);
+    read(entry.variable_type);
+    read(entry.qualifiers);
+    read(entry.targets);
+    read(entry.probe_particles);
+    read(entry.measurement_type);
+    read(entry.test_statistic);
+  }
+
+  void read(RecordIndex &index) { read(index.records); }
+};
+
+template <typename T> std::string encode(T const &obj) {
+  Writer w;
+  for (auto c : magic) {
+    w.raw(c);
+  }
+  w.raw(format_version);
+  w.raw(object_type<T>::value);
+  w.write(obj);
+  return w.take();
+}
+
+} // namespace
+
+std::string to_binary(Table const &tbl) { return encode(tbl); }
+std::string to_binary(ProbeFlux const &pf) { return encode(pf); }
+std::string to_binary(ErrorTable const &et) { return encode(et); }
+std::string to_binary(SmearingTable const &st) { return encode(st); }
+std::string to_binary(PredictionTable const &pt) { return encode(pt); }
+std::string to_binary(CrossSectionMeasurement const &xsm) {
+  return encode(xsm);
+}
+std::string to_binary(Record const &rec) { return encode(rec); }
+std::string to_binary(RecordIndex const &index) { return encode(index); }
+
+template <typename T> T from_binary(std::string_view bytes) {
+  if ((bytes.size() < (sizeof(magic) + 2)) ||
+      (std::memcmp(bytes.data(), magic, sizeof(magic)) != 0)) {
+    throw std::runtime_error(
+        fmt::format("Attempted to decode a {} from bytes that are not a binary "
+                    "encoded NUISANCE HEPData object.",
+                    object_type<T>::name));
+  }
+
+  Reader r(bytes.substr(sizeof(magic)));
+  auto vers = r.raw<uint8_t>();
+  if (vers != format_version) {
+    throw std::runtime_error(
+        fmt::format("Binary encoded NUISANCE HEPData object has format "
+                    "version {}, but this library reads version {}.",
+                    vers, format_version));
+  }
+  auto type = r.raw<ObjectType>();
+  if (type != object_type<T>::value) {
+    throw std::runtime_error(fmt::format(
+        "Attempted to decode a {} from a binary encoded object of type id {}.",
+        object_type<T>::name, uint8_t(type)));
+  }
+
+  T obj;
+  r.read(obj);
+  if (!r.at_end()) {
+    throw std::runtime_error(fmt::format(
+        "Trailing bytes after binary encoded {}.", object_type<T>::name));
+  }
+  return obj;
+}
+
+template Table from_binary<Table>(std::string_view);
+template ProbeFlux from_binary<ProbeFlux>(std::string_view);
+template ErrorTable from_binary<ErrorTable>(std::string_view);
+template SmearingTable from_binary<SmearingTable>(std::string_view);
+template PredictionTable from_binary<PredictionTable>(std::string_view);
+template CrossSectionMeasurement
+    from_binary<CrossSectionMeasurement>(std::string_view);
+template Record from_binary<Record>(std::string_view);
+template RecordIndex from_binary<RecordIndex>(std::string_view);
+
+} // namespace nuis::HEPData
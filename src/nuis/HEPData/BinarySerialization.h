@@ -0,0 +1,29 @@
+#pragma once
+
+#include "nuis/HEPData/Record.h"
+#include "nuis/HEPData/RecordIndex.h"
+
+#include <string>
+#include <string_view>
+
+namespace nuis::HEPData {
+
+// A compact binary encoding of the in-memory objects, intended for handing
+// already-parsed records between processes without re-reading any YAML.
+// Numbers are stored in host byte order and the encoding carries a format
+// version, so it should not be used as an archival format.
+
+std::string to_binary(Table const &tbl);
+std::string to_binary(ProbeFlux const &pf);
+std::string to_binary(ErrorTable const &et);
+std::string to_binary(SmearingTable const &st);
+std::string to_binary(PredictionTable const &pt);
+std::string to_binary(CrossSectionMeasurement const &xsm);
+std::string to_binary(Record const &rec);
+std::string to_binary(RecordIndex const &index);
+
+// T must be one of the types accepted by to_binary. Throws if bytes were not
+// produced by to_binary for the same type and format version.
+template <typename T> T from_binary(std::string_view bytes);
+
+} // namespace nuis::HEPData
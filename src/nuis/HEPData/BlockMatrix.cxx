@@ -0,0 +1,349 @@
+#include "nuis/HEPData/BlockMatrix.h"
+#include "nuis/HEPData/ParallelFor.h"
+
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+namespace nuis::HEPData {
+
+namespace {
+
+// In place lower triangular Cholesky factorisation of the n x n row-major a,
+// the upper triangle is zeroed. Returns false if a is not positive definite.
+bool cholesky(std::vector<double> &a, size_t n) {
+  for (size_t j = 0; j < n; ++j) {
+    double *aj = a.data() + j * n;
+    double d = aj[j];
+    for (size_t k = 0; k < j; ++k) {
+      d -= aj[k] * aj[k];
+    }
+    if (!(d > 0)) {
+      return false;
+    }
+    d = std::sqrt(d);
+    aj[j] = d;
+    for (size_t i = j + 1; i < n; ++i) {
+      double *ai = a.data() + i * n;
+      double s = ai[j];
+      for (size_t k = 0; k < j; ++k) {
+        s -= ai[k] * aj[k];
+      }
+      ai[j] = s / d;
+    }
+    std::fill(aj + j + 1, aj + n, 0.0);
+  }
+  return true;
+}
+
+// solves L y = b in place
+void forward_substitute(std::vector<double> const &L, size_t n, double *b) {
+  for (size_t i = 0; i < n; ++i) {
+    double const *li = L.data() + i * n;
+    double s = b[i];
+    for (size_t k = 0; k < i; ++k) {
+      s -= li[k] * b[k];
+    }
+    b[i] = s / li[i];
+  }
+}
+
+// solves L^T x = y in place
+void back_substitute(std::vector<double> const &L, size_t n, double *y) {
+  for (size_t i = n; i-- > 0;) {
+    double s = y[i];
+    for (size_t k = i + 1; k < n; ++k) {
+      s -= L[k * n + i] * y[k];
+    }
+    y[i] = s / L[i * n + i];
+  }
+}
+
+size_t find_block(std::vector<size_t> const &offsets, size_t i) {
+  return size_t(std::upper_bound(offsets.begin(), offsets.end(), i) -
+                offsets.begin()) -
+         1;
+}
+
+} // namespace
+
+size_t BlockMatrix::size() const { return offsets.size() ? offsets.back() : 0; }
+
+size_t BlockMatrix::nblocks() const {
+  return offsets.size() ? (offsets.size() - 1) : 0;
+}
+
+size_t BlockMatrix::block_size(size_t b) const {
+  return offsets[b + 1] - offsets[b];
+}
+
+double BlockMatrix::operator()(size_t i, size_t j) const {
+  if (i < j) {
+    std::swap(i, j);
+  }
+  auto bi = find_block(offsets, i), bj = find_block(offsets, j);
+  auto blk = blocks.find({bi, bj});
+  if (blk == blocks.end()) {
+    return 0;
+  }
+  return blk->second[(i - offsets[bi]) * block_size(bj) + (j - offsets[bj])];
+}
+
+bool BlockMatrix::is_block_diagonal() const {
+  return std::all_of(blocks.begin(), blocks.end(), [](auto const &blk) {
+    return blk.first.first == blk.first.second;
+  });
+}
+
+std::vector<double> BlockMatrix::multiply(std::vector<double> const &x) const {
+  if (x.size() != size()) {
+    throw std::runtime_error(
+        fmt::format("Cannot multiply a {0}x{0} BlockMatrix by a vector of "
+                    "length {1}.",
+                    size(), x.size()));
+  }
+  std::vector<double> y(size(), 0);
+  for (auto const &[idx, blk] : blocks) {
+    auto [bi, bj] = idx;
+    size_t oi = offsets[bi], oj = offsets[bj];
+    size_t ni = block_size(bi), nj = block_size(bj);
+    for (size_t i = 0; i < ni; ++i) {
+      for (size_t j = 0; j < nj; ++j) {
+        y[oi + i] += blk[i * nj + j] * x[oj + j];
+        // the transpose of blocks below the diagonal
+        if (bi != bj) {
+          y[oj + j] += blk[i * nj + j] * x[oi + i];
+        }
+      }
+    }
+  }
+  return y;
+}
+
+std::vector<double> BlockMatrix::to_dense() const {
+  size_t n = size();
+  std::vector<double> dense(n * n, 0);
+  for (auto const &[idx, blk] : blocks) {
+    auto [bi, bj] = idx;
+    size_t ni = block_size(bi), nj = block_size(bj);
+    for (size_t i = 0; i < ni; ++i) {
+      for (size_t j = 0; j < nj; ++j) {
+        dense[(offsets[bi] + i) * n + (offsets[bj] + j)] = blk[i * nj + j];
+        dense[(offsets[bj] + j) * n + (offsets[bi] + i)] = blk[i * nj + j];
+      }
+    }
+  }
+  return dense;
+}
+
+BlockMatrix make_BlockMatrix(std::vector<double> const &dense,
+                             std::vector<size_t> offsets) {
+  if (!offsets.size() || offsets.front() ||
+      !std::is_sorted(offsets.begin(), offsets.end()) ||
+      (dense.size() != (offsets.back() * offsets.back()))) {
+    throw std::runtime_error(
+        fmt::format("Invalid block boundaries for a {} element matrix.",
+                    dense.size()));
+  }
+
+  BlockMatrix m{std::move(offsets), {}};
+  size_t n = m.size();
+  for (size_t bi = 0; bi < m.nblocks(); ++bi) {
+    for (size_t bj = 0; bj <= bi; ++bj) {
+      size_t ni = m.block_size(bi), nj = m.block_size(bj);
+      std::vector<double> blk(ni * nj);
+      bool nonzero = false;
+      for (size_t i = 0; i < ni; ++i) {
+        for (size_t j = 0; j < nj; ++j) {
+          blk[i * nj + j] = dense[(m.offsets[bi] + i) * n + (m.offsets[bj] + j)];
+          nonzero = nonzero || (blk[i * nj + j] != 0);
+        }
+      }
+      if (nonzero) {
+        m.blocks.emplace(std::make_pair(bi, bj), std::move(blk));
+      }
+    }
+  }
+  return m;
+}
+
+BlockCholesky factorize(BlockMatrix const &m) {
+  BlockCholesky chol{m.size(), m.offsets, {}};
+
+  // group the blocks into the connected components of the graph whose edges
+  // are the stored off-diagonal blocks
+  std::vector<size_t> parent(m.nblocks());
+  std::iota(parent.begin(), parent.end(), 0);
+  auto root = [&](size_t b) {
+    while (parent[b] != b) {
+      b = parent[b] = parent[parent[b]];
+    }
+    return b;
+  };
+  for (auto const &[idx, blk] : m.blocks) {
+    parent[root(idx.first)] = root(idx.second);
+  }
+
+  std::map<size_t, size_t> group_of_root;
+  for (size_t b = 0; b < m.nblocks(); ++b) {
+    auto [it, inserted] =
+        group_of_root.emplace(root(b), chol.groups.size());
+    if (inserted) {
+      chol.groups.emplace_back();
+    }
+    auto &group = chol.groups[it->second];
+    group.blocks.push_back(b);
+    for (size_t i = m.offsets[b]; i < m.offsets[b + 1]; ++i) {
+      group.indices.push_back(i);
+    }
+  }
+
+  for (auto &group : chol.groups) {
+    size_t ng = group.indices.size();
+    group.L.assign(ng * ng, 0);
+
+    // where each block starts within the group
+    std::map<size_t, size_t> local_offset;
+    for (size_t b = 0, off = 0; b < group.blocks.size(); ++b) {
+      local_offset[group.blocks[b]] = off;
+      off += m.block_size(group.blocks[b]);
+    }
+
+    for (size_t bi : group.blocks) {
+      for (size_t bj : group.blocks) {
+        if (bj > bi) {
+          continue;
+        }
+        auto blk = m.blocks.find({bi, bj});
+        if (blk == m.blocks.end()) {
+          continue;
+        }
+        size_t ni = m.block_size(bi), nj = m.block_size(bj);
+        for (size_t i = 0; i < ni; ++i) {
+          for (size_t j = 0; j < nj; ++j) {
+            group.L[(local_offset[bi] + i) * ng + (local_offset[bj] + j)] =
+                blk->second[i * nj + j];
+          }
+        }
+      }
+    }
+
+    if (!cholesky(group.L, ng)) {
+      throw std::runtime_error(fmt::format(
+          "Matrix is not positive definite, failed to factorise the {} rows "
+          "starting at row {}.",
+          ng, group.indices.front()));
+    }
+  }
+
+  return chol;
+}
+
+std::vector<double> BlockCholesky::solve(std::vector<double> const &b) const {
+  if (b.size() != n) {
+    throw std::runtime_error(
+        fmt::format("Cannot solve a {0}x{0} system for a vector of length {1}.",
+                    n, b.size()));
+  }
+  std::vector<double> x(n), work;
+  for (auto const &group : groups) {
+    size_t ng = group.indices.size();
+    work.resize(ng);
+    for (size_t i = 0; i < ng; ++i) {
+      work[i] = b[group.indices[i]];
+    }
+    forward_substitute(group.L, ng, work.data());
+    back_substitute(group.L, ng, work.data());
+    for (size_t i = 0; i < ng; ++i) {
+      x[group.indices[i]] = work[i];
+    }
+  }
+  return x;
+}
+
+double BlockCholesky::chi2(std::vector<double> const &r,
+                           size_t nworkers) const {
+  if (r.size() != n) {
+    throw std::runtime_error(fmt::format(
+        "Cannot evaluate chi2 for a {0}x{0} covariance with a residual of "
+        "length {1}.",
+        n, r.size()));
+  }
+
+  // r^T (L L^T)^-1 r = |L^-1 r|^2, summed over the groups
+  std::vector<double> group_chi2(groups.size(), 0);
+  std::vector<std::vector<double>> work(
+      parallel_for_workers(groups.size(), nworkers));
+  parallel_for(groups.size(), nworkers, [&](size_t g, size_t w) {
+    auto const &group = groups[g];
+    size_t ng = group.indices.size();
+    auto &gwork = work[w];
+    gwork.resize(ng);
+    for (size_t i = 0; i < ng; ++i) {
+      gwork[i] = r[group.indices[i]];
+    }
+    forward_substitute(group.L, ng, gwork.data());
+    for (auto x : gwork) {
+      group_chi2[g] += x * x;
+    }
+  });
+
+  // summed in a fixed order so the result doesn't depend on nworkers
+  return std::accumulate(group_chi2.begin(), group_chi2.end(), 0.0);
+}
+
+double BlockCholesky::log_determinant() const {
+  double logdet = 0;
+  for (auto const &group : groups) {
+    size_t ng = group.indices.size();
+    for (size_t i = 0; i < ng; ++i) {
+      logdet += 2 * std::log(group.L[i * ng + i]);
+    }
+  }
+  return logdet;
+}
+
+BlockMatrix BlockCholesky::inverse() const {
+  BlockMatrix inv{offsets, {}};
+
+  std::vector<double> col;
+  for (auto const &group : groups) {
+    size_t ng = group.indices.size();
+
+    // column by column solution of L L^T X = I
+    std::vector<double> dense(ng * ng);
+    col.resize(ng);
+    for (size_t j = 0; j < ng; ++j) {
+      std::fill(col.begin(), col.end(), 0);
+      col[j] = 1;
+      forward_substitute(group.L, ng, col.data());
+      back_substitute(group.L, ng, col.data());
+      for (size_t i = 0; i < ng; ++i) {
+        dense[i * ng + j] = col[i];
+      }
+    }
+
+    for (size_t gi = 0, oi = 0; gi < group.blocks.size(); ++gi) {
+      size_t bi = group.blocks[gi], ni = inv.block_size(bi);
+      for (size_t gj = 0, oj = 0; gj <= gi; ++gj) {
+        size_t bj = group.blocks[gj], nj = inv.block_size(bj);
+        std::vector<double> blk(ni * nj);
+        for (size_t i = 0; i < ni; ++i) {
+          for (size_t j = 0; j < nj; ++j) {
+            blk[i * nj + j] = dense[(oi + i) * ng + (oj + j)];
+          }
+        }
+        inv.blocks.emplace(std::make_pair(bi, bj), std::move(blk));
+        oj += nj;
+      }
+      oi += ni;
+    }
+  }
+
+  return inv;
+}
+
+} // namespace nuis::HEPData
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace nuis::HEPData {
+
+// A square symmetric matrix partitioned into blocks along the same boundaries
+// in rows and columns. Only the blocks on or below the diagonal that contain
+// a non-zero element are stored, each as a dense row-major array, so e.g. the
+// joint covariance of several uncorrelated measurements costs no more than
+// their separate covariances.
+struct BlockMatrix {
+  // block b covers rows and columns [offsets[b], offsets[b+1])
+  std::vector<size_t> offsets;
+  // keyed by (row block, column block), with row block >= column block
+  std::map<std::pair<size_t, size_t>, std::vector<double>> blocks;
+
+  size_t size() const;
+  size_t nblocks() const;
+  size_t block_size(size_t b) const;
+
+  double operator()(size_t i, size_t j) const;
+  bool is_block_diagonal() const;
+
+  // M x
+  std::vector<double> multiply(std::vector<double> const &x) const;
+  // the whole matrix, row-major
+  std::vector<double> to_dense() const;
+};
+
+// Partitions the dense, row-major, symmetric matrix at the given block
+// boundaries, which must start at 0 and end at the matrix size, keeping only
+// the blocks that have a non-zero element.
+BlockMatrix make_BlockMatrix(std::vector<double> const &dense,
+                             std::vector<size_t> offsets);
+
+// The Cholesky factorisation, M = L L^T, of a symmetric positive definite
+// BlockMatrix. Blocks are grouped by whether they are coupled through stored
+// off-diagonal blocks, and each group is factorised separately, so a block
+// diagonal matrix costs the sum of the factorisations of its blocks rather
+// than that of the whole matrix.
+struct BlockCholesky {
+  struct Group {
+    std::vector<size_t> blocks;
+    // the rows of the matrix covered by the group, in order
+    std::vector<size_t> indices;
+    // the dense, row-major, lower triangular factor of the group
+    std::vector<double> L;
+  };
+
+  size_t n;
+  std::vector<size_t> offsets;
+  std::vector<Group> groups;
+
+  // M^-1 b
+  std::vector<double> solve(std::vector<double> const &b) const;
+  // r^T M^-1 r, the groups are evaluated on up to nworkers threads, 0 uses
+  // one thread per hardware core. The threads are started on each call, so
+  // nworkers > 1 only pays off when the groups hold thousands of bins, e.g.
+  // not inside a fit evaluating chi2 for a small covariance many times.
+  double chi2(std::vector<double> const &r, size_t nworkers = 1) const;
+  double log_determinant() const;
+  // Only the blocks within each group are non-zero in the inverse.
+  BlockMatrix inverse() const;
+};
+
+// Throws if m is not positive definite.
+BlockCholesky factorize(BlockMatrix const &m);
+
+} // namespace nuis::HEPData
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "nuis/HEPData/CrossSectionUnits.h"
 #include "nuis/HEPData/Tables.h"
 
 #include <filesystem>
@@ -24,6 +25,10 @@ struct CrossSectionMeasurement : public Table {
   std::string variable_type;
   std::string measurement_type;
   std::set<std::string> cross_section_units;
+  // cross_section_units parsed once, with the factors for each bin. If they
+  // cannot be interpreted, this is value-initialised with empty bin_factors
+  // rather than failing to load the measurement.
+  CrossSectionNormalisation normalisation;
   std::string test_statistic;
 
   struct Target {
@@ -31,6 +36,8 @@ struct CrossSectionMeasurement : public Table {
   };
 
   std::vector<std::vector<Weighted<ProbeFlux>>> probe_fluxes;
+  // each entry of probe_fluxes summed with its weights onto a common binning
+  std::vector<FluxHistogram> combined_probe_fluxes;
 
   using TargetList = std::vector<Weighted<Target>>;
   std::vector<TargetList> targets;
@@ -0,0 +1,182 @@
+#include "nuis/HEPData/CrossSectionUnits.h"
+
+#include "nuis/HEPData/CrossSectionMeasurement.h"
+
+#include "fmt/core.h"
+#include "fmt/ranges.h"
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <stdexcept>
+
+namespace nuis::HEPData {
+
+namespace {
+
+std::string canonical_flag(std::string const &flag) {
+  std::string canon;
+  for (auto c : flag) {
+    if ((c != '_') && !std::isspace(static_cast<unsigned char>(c))) {
+      canon.push_back(char(std::tolower(static_cast<unsigned char>(c))));
+    }
+  }
+  return canon;
+}
+
+} // namespace
+
+std::vector<double> CrossSectionNormalisation::apply(
+    std::vector<double> const &prediction) const {
+  if (prediction.size() != bin_factors.size()) {
+    throw std::runtime_error(
+        fmt::format("CrossSectionNormalisation has {} bins, but was passed a "
+                    "prediction with {}.",
+                    bin_factors.size(), prediction.size()));
+  }
+  return apply_batch(prediction);
+}
+
+std::vector<double> CrossSectionNormalisation::apply_batch(
+    std::vector<double> const &predictions) const {
+  size_t n = bin_factors.size();
+  if (!n || (predictions.size() % n)) {
+    throw std::runtime_error(
+        fmt::format("CrossSectionNormalisation has {} bins, but was passed {} "
+                    "predicted values, which is not a whole number of "
+                    "predictions.",
+                    n, predictions.size()));
+  }
+
+  std::vector<double> published(predictions.size());
+  double const *f = bin_factors.data();
+  for (size_t offset = 0; offset < predictions.size(); offset += n) {
+    double const *in = predictions.data() + offset;
+    double *out = published.data() + offset;
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = f[i] * in[i];
+    }
+  }
+  return published;
+}
+
+CrossSectionNormalisation
+parse_cross_section_units(std::set<std::string> const &units) {
+  using TargetScale = CrossSectionNormalisation::TargetScale;
+  using DensityScale = CrossSectionNormalisation::DensityScale;
+
+  static std::map<std::string, double> const unit_flags = {
+      {"cm2", 1}, {"1e-38cm2", 1E38}, {"pb", 1E36}, {"nb", 1E33}};
+  static std::map<std::string, TargetScale> const target_flags = {
+      {"pertarget", TargetScale::kPerTarget},
+      {"pertargetnucleon", TargetScale::kPerTargetNucleon},
+      {"pertargetneutron", TargetScale::kPerTargetNeutron},
+      {"pertargetproton", TargetScale::kPerTargetProton}};
+  static std::map<std::string, DensityScale> const density_flags = {
+      {"perbinwidth", DensityScale::kPerBinWidth},
+      {"perfirstbinwidth", DensityScale::kPerFirstBinWidth}};
+
+  if (!units.size()) {
+    return CrossSectionNormalisation{1E38, TargetScale::kPerTarget,
+                                     DensityScale::kPerBinWidth, {}};
+  }
+
+  CrossSectionNormalisation norm{1E38, TargetScale::kPerTarget,
+                                 DensityScale::kNone, {}};
+  static char const *const group_names[] = {"unit", "target", "density"};
+  bool seen[3] = {false, false, false};
+  auto set_once = [&](size_t group, std::string const &flag) {
+    if (seen[group]) {
+      throw std::runtime_error(
+          fmt::format("cross_section_units: {} has more than one {} flag, at "
+                      "flag: {}",
+                      units, group_names[group], flag));
+    }
+    seen[group] = true;
+  };
+
+  for (auto const &flag : units) {
+    auto canon = canonical_flag(flag);
+    if (unit_flags.count(canon)) {
+      set_once(0, flag);
+      norm.unit_scale = unit_flags.at(canon);
+    } else if (target_flags.count(canon)) {
+      set_once(1, flag);
+      norm.target_scale = target_flags.at(canon);
+    } else if (density_flags.count(canon)) {
+      set_once(2, flag);
+      norm.density_scale = density_flags.at(canon);
+    } else {
+      throw std::runtime_error(
+          fmt::format("invalid cross_section_units flag: {}", flag));
+    }
+  }
+
+  return norm;
+}
+
+CrossSectionNormalisation
+make_CrossSectionNormalisation(CrossSectionMeasurement const &xsm) {
+  using TargetScale = CrossSectionNormalisation::TargetScale;
+  using DensityScale = CrossSectionNormalisation::DensityScale;
+
+  auto norm = parse_cross_section_units(xsm.cross_section_units);
+
+  double per_target = 1;
+  if (norm.target_scale != TargetScale::kPerTarget) {
+    if (xsm.is_composite && (xsm.targets.size() != 1)) {
+      return norm;
+    }
+    auto [A, Z] = xsm.get_simple_target();
+    if (norm.target_scale == TargetScale::kPerTargetNucleon) {
+      per_target = A;
+    } else if (norm.target_scale == TargetScale::kPerTargetNeutron) {
+      per_target = A - Z;
+    } else {
+      per_target = Z;
+    }
+    if (!(per_target > 0)) {
+      throw std::runtime_error(fmt::format(
+          "Measurement: {} has cross_section_units scaled per target nucleon, "
+          "neutron, or proton, but its target has none.",
+          xsm.source.native()));
+    }
+  }
+
+  size_t nbins =
+      xsm.dependent_vars.size() ? xsm.dependent_vars[0].values.size() : 0;
+  size_t nwidth_vars = xsm.independent_vars.size();
+  if (norm.density_scale == DensityScale::kNone) {
+    nwidth_vars = 0;
+  } else if (norm.density_scale == DensityScale::kPerFirstBinWidth) {
+    nwidth_vars = std::min(size_t(1), nwidth_vars);
+  }
+
+  norm.bin_factors.assign(nbins, norm.unit_scale / per_target);
+  for (size_t d = 0; d < nwidth_vars; ++d) {
+    auto const &var = xsm.independent_vars[d];
+    if (var.values.size() != nbins) {
+      throw std::runtime_error(fmt::format(
+          "Measurement: {} independent variable {} has {} values, but the "
+          "measurement has {} bins.",
+          xsm.source.native(), var.name, var.values.size(), nbins));
+    }
+    for (size_t i = 0; i < nbins; ++i) {
+      if (var.values[i].value.index() != 0) {
+        continue;
+      }
+      auto const &ext = std::get<Extent>(var.values[i].value);
+      if (!(ext.high > ext.low)) {
+        throw std::runtime_error(fmt::format(
+            "Measurement: {} independent variable {} bin {} has non-positive "
+            "width: [{}, {}].",
+            xsm.source.native(), var.name, i, ext.low, ext.high));
+      }
+      norm.bin_factors[i] /= (ext.high - ext.low);
+    }
+  }
+
+  return norm;
+}
+
+} // namespace nuis::HEPData
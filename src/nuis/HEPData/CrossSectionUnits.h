@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace nuis::HEPData {
+
+struct CrossSectionMeasurement;
+
+// The cross_section_units flags of a measurement parsed into the factors that
+// take a prediction of the cross section per target in cm2, summed over each
+// bin, to the units that the measurement is published in.
+struct CrossSectionNormalisation {
+  enum class TargetScale {
+    kPerTarget,
+    kPerTargetNucleon,
+    kPerTargetNeutron,
+    kPerTargetProton
+  };
+  enum class DensityScale { kNone, kPerBinWidth, kPerFirstBinWidth };
+
+  // published units per cm2, e.g. 1E38 for 1e-38 cm2
+  double unit_scale;
+  TargetScale target_scale;
+  DensityScale density_scale;
+
+  // unit_scale / (nucleons per target) / (bin volume) for each bin, so that
+  // published_i = bin_factors[i] * prediction_i
+  std::vector<double> bin_factors;
+
+  std::vector<double> apply(std::vector<double> const &prediction) const;
+  // For predictions.size()/bin_factors.size() predictions laid out one after
+  // the other, the results are laid out in the same way.
+  std::vector<double> apply_batch(std::vector<double> const &predictions) const;
+};
+
+// Flags are matched ignoring case and underscores, so per_target_nucleon and
+// PerTargetNucleon are equivalent. At most one flag may be given from each of
+// the unit, target, and density groups. If units is empty, the default
+// 1E-38 cm2|PerTarget|per_bin_width is assumed, otherwise a group with no flag
+// takes 1E-38 cm2, PerTarget, or no density scaling, respectively. Throws for
+// unknown or conflicting flags. bin_factors are left empty.
+CrossSectionNormalisation
+parse_cross_section_units(std::set<std::string> const &units);
+
+// The parsed cross_section_units of xsm with the bin_factors computed from
+// its binning. The bin volume is the product of the widths of the bin in each
+// independent variable for per_bin_width, or just the first for
+// per_first_bin_width, independent variables with single values have unit
+// width. Nucleon, neutron, and proton counts are the A, A-Z, and Z of
+// get_simple_target. For composite measurements with more than one target,
+// bin_factors are only computed when no target scaling is needed. Throws if a
+// bin has zero or negative width.
+CrossSectionNormalisation
+make_CrossSectionNormalisation(CrossSectionMeasurement const &xsm);
+
+} // namespace nuis::HEPData
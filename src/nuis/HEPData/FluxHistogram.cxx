@@ -0,0 +1,182 @@
+#include "nuis/HEPData/FluxHistogram.h"
+
+#include "nuis/HEPData/CrossSectionMeasurement.h"
+
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace nuis::HEPData {
+
+namespace {
+
+// fills integral, mean, and cdf from edges and counts
+void summarise(FluxHistogram &hist) {
+  double sum = 0, moment = 0;
+  hist.cdf.assign(1, 0);
+  for (size_t i = 0; i < hist.counts.size(); ++i) {
+    sum += hist.counts[i];
+    moment += hist.counts[i] * 0.5 * (hist.edges[i] + hist.edges[i + 1]);
+    hist.cdf.push_back(sum);
+  }
+  hist.integral = sum;
+  hist.mean = (sum != 0) ? (moment / sum) : 0;
+  if (sum != 0) {
+    for (auto &c : hist.cdf) {
+      c /= sum;
+    }
+  }
+}
+
+} // namespace
+
+size_t FluxHistogram::nbins() const { return counts.size(); }
+
+double FluxHistogram::density(size_t i) const {
+  return counts[i] / (edges[i + 1] - edges[i]);
+}
+
+FluxHistogram make_FluxHistogram(ProbeFlux const &flux) {
+  bool is_density = false;
+  if (flux.bin_content_type == "count_density") {
+    is_density = true;
+  } else if (flux.bin_content_type != "count") {
+    throw std::runtime_error(fmt::format(
+        "ProbeFlux: {} has bin_content_type: \"{}\", expected count or "
+        "count_density.",
+        flux.source.native(), flux.bin_content_type));
+  }
+
+  if (!flux.independent_vars.size() || !flux.dependent_vars.size()) {
+    throw std::runtime_error(fmt::format(
+        "ProbeFlux: {} has no independent or no dependent variables.",
+        flux.source.native()));
+  }
+
+  auto const &bins = flux.independent_vars[0].values;
+  auto const &values = flux.dependent_vars[0].values;
+  if (bins.size() != values.size()) {
+    throw std::runtime_error(
+        fmt::format("ProbeFlux: {} has {} bins but {} values.",
+                    flux.source.native(), bins.size(), values.size()));
+  }
+
+  std::vector<std::pair<Extent, double>> sorted;
+  for (size_t i = 0; i < bins.size(); ++i) {
+    if ((bins[i].value.index() != 0) || (values[i].value.index() != 1)) {
+      throw std::runtime_error(fmt::format(
+          "ProbeFlux: {} bin {} is not a value in an extent of {}.",
+          flux.source.native(), i, flux.independent_vars[0].name));
+    }
+    auto const &ext = std::get<Extent>(bins[i].value);
+    if (!(ext.high > ext.low)) {
+      throw std::runtime_error(
+          fmt::format("ProbeFlux: {} bin {} has non-positive width: [{}, {}].",
+                      flux.source.native(), i, ext.low, ext.high));
+    }
+    sorted.emplace_back(ext, std::get<double>(values[i].value));
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](auto const &a, auto const &b) {
+              return a.first.low < b.first.low;
+            });
+
+  FluxHistogram hist{};
+  for (auto const &[ext, value] : sorted) {
+    if (!hist.edges.size()) {
+      hist.edges.push_back(ext.low);
+    } else if (ext.low < hist.edges.back()) {
+      throw std::runtime_error(fmt::format(
+          "ProbeFlux: {} has overlapping bins at {} = {}.",
+          flux.source.native(), flux.independent_vars[0].name, ext.low));
+    } else if (ext.low > hist.edges.back()) {
+      hist.counts.push_back(0);
+      hist.edges.push_back(ext.low);
+    }
+    hist.counts.push_back(is_density ? (value * (ext.high - ext.low)) : value);
+    hist.edges.push_back(ext.high);
+  }
+
+  summarise(hist);
+  return hist;
+}
+
+FluxHistogram combine_FluxHistograms(std::vector<FluxHistogram> const &fluxes,
+                                     std::vector<double> const &weights) {
+  if (fluxes.size() != weights.size()) {
+    throw std::runtime_error(
+        fmt::format("combine_FluxHistograms was passed {} fluxes but {} "
+                    "weights.",
+                    fluxes.size(), weights.size()));
+  }
+
+  FluxHistogram combined{};
+  for (auto const &flux : fluxes) {
+    if (!flux.nbins()) {
+      throw std::runtime_error(
+          "combine_FluxHistograms was passed an empty FluxHistogram.");
+    }
+    combined.edges.insert(combined.edges.end(), flux.edges.begin(),
+                          flux.edges.end());
+  }
+  std::sort(combined.edges.begin(), combined.edges.end());
+  combined.edges.erase(
+      std::unique(combined.edges.begin(), combined.edges.end()),
+      combined.edges.end());
+  combined.counts.assign(combined.edges.size() ? combined.edges.size() - 1 : 0,
+                         0);
+
+  // every edge of each flux is a merged edge, so each merged bin lies within a
+  // single bin of a flux, or outside of it entirely
+  for (size_t f = 0; f < fluxes.size(); ++f) {
+    auto const &flux = fluxes[f];
+    size_t j = std::lower_bound(combined.edges.begin(), combined.edges.end(),
+                                flux.edges.front()) -
+               combined.edges.begin();
+    for (size_t i = 0; i < flux.nbins(); ++i) {
+      double scale =
+          weights[f] * flux.counts[i] / (flux.edges[i + 1] - flux.edges[i]);
+      for (; (j < combined.counts.size()) &&
+             (combined.edges[j] < flux.edges[i + 1]);
+           ++j) {
+        combined.counts[j] +=
+            scale * (combined.edges[j + 1] - combined.edges[j]);
+      }
+    }
+  }
+
+  summarise(combined);
+  return combined;
+}
+
+std::vector<FluxHistogram>
+make_combined_probe_fluxes(CrossSectionMeasurement const &xsm) {
+  std::vector<FluxHistogram> combined;
+  for (auto const &group : xsm.probe_fluxes) {
+    std::vector<FluxHistogram> fluxes;
+    std::vector<double> weights;
+    for (auto const &wflux : group) {
+      if (!wflux->histogram.nbins()) {
+        break;
+      }
+      fluxes.push_back(wflux->histogram);
+      weights.push_back(wflux.weight);
+    }
+    if (!fluxes.size() || (fluxes.size() != group.size())) {
+      combined.push_back(FluxHistogram{});
+    } else if (fluxes.size() == 1) {
+      combined.push_back(fluxes.front());
+      for (auto &c : combined.back().counts) {
+        c *= weights.front();
+      }
+      summarise(combined.back());
+    } else {
+      combined.push_back(combine_FluxHistograms(fluxes, weights));
+    }
+  }
+  return combined;
+}
+
+} // namespace nuis::HEPData
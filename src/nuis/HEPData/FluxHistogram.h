@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace nuis::HEPData {
+
+struct ProbeFlux;
+struct CrossSectionMeasurement;
+
+// A probe flux as a one dimensional histogram of the number of probes in
+// each bin, whatever its bin_content_type, with the summaries needed to
+// normalise predictions computed once.
+struct FluxHistogram {
+  // bin i covers [edges[i], edges[i+1])
+  std::vector<double> edges;
+  // the flux integrated over each bin
+  std::vector<double> counts;
+  // cdf[i] is the fraction of the integral below edges[i]
+  std::vector<double> cdf;
+  double integral;
+  // the mean probe energy, taking the flux to be uniform within each bin
+  double mean;
+
+  size_t nbins() const;
+  // counts[i] / (edges[i+1] - edges[i])
+  double density(size_t i) const;
+};
+
+// Built from the first independent variable of flux, which must hold
+// non-overlapping extents, bins are sorted and any gaps between them become
+// empty bins. count_density contents are multiplied by the bin width, count
+// contents are used directly. Throws for any other bin_content_type.
+FluxHistogram make_FluxHistogram(ProbeFlux const &flux);
+
+// The weighted sum of the fluxes on the union of their bin edges, sharing the
+// counts of each bin between the merged bins it covers in proportion to their
+// width.
+FluxHistogram combine_FluxHistograms(std::vector<FluxHistogram> const &fluxes,
+                                     std::vector<double> const &weights);
+
+// The combined flux of each group of probe_fluxes of xsm, weighted as
+// specified. Groups with a flux that has no histogram give an empty
+// FluxHistogram.
+std::vector<FluxHistogram>
+make_combined_probe_fluxes(CrossSectionMeasurement const &xsm);
+
+} // namespace nuis::HEPData
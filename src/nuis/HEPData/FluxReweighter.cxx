@@ -0,0 +1,58 @@
+#include "nuis/HEPData/FluxReweighter.h"
+
+#include "nuis/HEPData/Tables.h"
+
+#include "fmt/core.h"
+
+#include <stdexcept>
+
+namespace nuis::HEPData {
+
+void FluxReweighter::weight(double const *energies, double *event_weights,
+                            size_t n) const {
+  for (size_t i = 0; i < n; ++i) {
+    event_weights[i] = weight(energies[i]);
+  }
+}
+
+std::vector<double>
+FluxReweighter::weight(std::vector<double> const &energies) const {
+  std::vector<double> event_weights(energies.size());
+  weight(energies.data(), event_weights.data(), energies.size());
+  return event_weights;
+}
+
+FluxReweighter make_FluxReweighter(FluxHistogram const &nominal,
+                                   FluxHistogram const &alternate) {
+  if (!nominal.nbins() || !alternate.nbins()) {
+    throw std::runtime_error(
+        "make_FluxReweighter was passed an empty FluxHistogram.");
+  }
+
+  // each flux on the merged binning, the zero-weighted flux only contributes
+  // its edges
+  auto nom = combine_FluxHistograms({nominal, alternate}, {1, 0});
+  auto alt = combine_FluxHistograms({nominal, alternate}, {0, 1});
+
+  FluxReweighter fr{nom.edges, std::vector<double>(nom.nbins() + 2, 0)};
+  for (size_t i = 0; i < nom.nbins(); ++i) {
+    if (nom.counts[i] != 0) {
+      fr.weights[i + 1] = alt.counts[i] / nom.counts[i];
+    }
+  }
+  return fr;
+}
+
+FluxReweighter make_FluxReweighter(ProbeFlux const &nominal,
+                                   ProbeFlux const &alternate) {
+  for (auto const *flux : {&nominal, &alternate}) {
+    if (!flux->histogram.nbins()) {
+      throw std::runtime_error(
+          fmt::format("ProbeFlux: {} has no flux histogram to reweight with.",
+                      flux->source.native()));
+    }
+  }
+  return make_FluxReweighter(nominal.histogram, alternate.histogram);
+}
+
+} // namespace nuis::HEPData
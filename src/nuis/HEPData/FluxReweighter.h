@@ -0,0 +1,50 @@
+#pragma once
+
+#include "nuis/HEPData/FluxHistogram.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace nuis::HEPData {
+
+struct ProbeFlux;
+
+// Event weights that take a sample generated with a nominal flux to an
+// alternate flux, the ratio of the alternate to the nominal flux density in
+// each bin of the union of their binnings.
+//
+// Lookups are a branch-free binary search over the merged edges, so every
+// energy takes the same short sequence of conditional moves and a weighting
+// pass over a large array of energies is bound by memory bandwidth.
+struct FluxReweighter {
+  // merged bin i covers [edges[i], edges[i+1])
+  std::vector<double> edges;
+  // weights[k] is the weight for energies with k edges at or below them, so
+  // weights[i+1] is the weight for merged bin i, and weights.front() and
+  // weights.back() are the weights outside of the binning, which are 0
+  std::vector<double> weights;
+
+  double weight(double energy) const {
+    double const *base = edges.data();
+    size_t n = edges.size();
+    while (n > 1) {
+      size_t half = n / 2;
+      base = (base[half] <= energy) ? (base + half) : base;
+      n -= half;
+    }
+    return weights[size_t(base - edges.data()) + (*base <= energy)];
+  }
+
+  void weight(double const *energies, double *event_weights, size_t n) const;
+  std::vector<double> weight(std::vector<double> const &energies) const;
+};
+
+// Bins where the nominal flux is empty have a weight of 0, as no events can
+// have been generated there.
+FluxReweighter make_FluxReweighter(FluxHistogram const &nominal,
+                                   FluxHistogram const &alternate);
+// Uses the histogram of each flux, throws if either could not be built.
+FluxReweighter make_FluxReweighter(ProbeFlux const &nominal,
+                                   ProbeFlux const &alternate);
+
+} // namespace nuis::HEPData
@@ -0,0 +1,99 @@
+#include "nuis/HEPData/FluxSampler.h"
+
+#include "nuis/HEPData/Tables.h"
+
+#include "fmt/core.h"
+
+#include <stdexcept>
+
+namespace nuis::HEPData {
+
+void FluxSampler::sample(double const *uniforms, double *energies,
+                         size_t n) const {
+  for (size_t i = 0; i < n; ++i) {
+    energies[i] = sample(uniforms[2 * i], uniforms[2 * i + 1]);
+  }
+}
+
+std::vector<double>
+FluxSampler::sample(std::vector<double> const &uniforms) const {
+  if (uniforms.size() % 2) {
+    throw std::runtime_error(
+        fmt::format("FluxSampler::sample uses two uniform numbers per sample, "
+                    "but was passed {}.",
+                    uniforms.size()));
+  }
+  std::vector<double> energies(uniforms.size() / 2);
+  sample(uniforms.data(), energies.data(), energies.size());
+  return energies;
+}
+
+FluxSampler make_FluxSampler(FluxHistogram const &flux) {
+  size_t nbins = flux.nbins();
+  if (!nbins) {
+    throw std::runtime_error(
+        "make_FluxSampler was passed an empty FluxHistogram.");
+  }
+  for (size_t i = 0; i < nbins; ++i) {
+    if (flux.counts[i] < 0) {
+      throw std::runtime_error(fmt::format(
+          "make_FluxSampler was passed a FluxHistogram with negative "
+          "content: {} in bin {}.",
+          flux.counts[i], i));
+    }
+  }
+  if (!(flux.integral > 0)) {
+    throw std::runtime_error(
+        fmt::format("make_FluxSampler was passed a FluxHistogram with "
+                    "integral: {}, which cannot be sampled.",
+                    flux.integral));
+  }
+
+  FluxSampler fs{flux.edges, std::vector<double>(nbins),
+                 std::vector<size_t>(nbins)};
+
+  // Vose's construction: bins with less than the mean probability are each
+  // topped up from a single bin with more than it
+  std::vector<double> scaled(nbins);
+  std::vector<size_t> small, large;
+  for (size_t i = 0; i < nbins; ++i) {
+    scaled[i] = flux.counts[i] * double(nbins) / flux.integral;
+    fs.aliases[i] = i;
+    if (scaled[i] < 1) {
+      small.push_back(i);
+    } else {
+      large.push_back(i);
+    }
+  }
+  while (small.size() && large.size()) {
+    size_t s = small.back(), l = large.back();
+    small.pop_back();
+    fs.acceptance[s] = scaled[s];
+    fs.aliases[s] = l;
+    scaled[l] -= (1 - scaled[s]);
+    if (scaled[l] < 1) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+  // whatever is left is within rounding of the mean probability
+  for (auto i : large) {
+    fs.acceptance[i] = 1;
+  }
+  for (auto i : small) {
+    fs.acceptance[i] = 1;
+  }
+
+  return fs;
+}
+
+FluxSampler make_FluxSampler(ProbeFlux const &flux) {
+  if (!flux.histogram.nbins()) {
+    throw std::runtime_error(
+        fmt::format("ProbeFlux: {} has no flux histogram to sample from.",
+                    flux.source.native()));
+  }
+  return make_FluxSampler(flux.histogram);
+}
+
+} // namespace nuis::HEPData
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "nuis/HEPData/FluxHistogram.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+namespace nuis::HEPData {
+
+struct ProbeFlux;
+
+// Samples probe energies from a FluxHistogram in constant time per sample
+// using Walker's alias method, as constructed by Vose, to choose a bin and a
+// uniform position within it.
+//
+// Each sample uses two uniform numbers in [0, 1). The first is scaled by the
+// number of bins, its integer part picks a bin and its fractional part is
+// compared against the acceptance probability of that bin to choose between
+// the bin and its alias. The second places the energy within the chosen bin.
+struct FluxSampler {
+  // bin i covers [edges[i], edges[i+1])
+  std::vector<double> edges;
+  // the probability of keeping bin i rather than taking aliases[i]
+  std::vector<double> acceptance;
+  std::vector<size_t> aliases;
+
+  double sample(double u1, double u2) const {
+    size_t nbins = acceptance.size();
+    double x = u1 * double(nbins);
+    size_t i = std::min(size_t(x), nbins - 1);
+    if (!((x - double(i)) < acceptance[i])) {
+      i = aliases[i];
+    }
+    return edges[i] + u2 * (edges[i + 1] - edges[i]);
+  }
+
+  // Fills energies[0, n) from the uniforms[0, 2n), which are used in pairs.
+  void sample(double const *uniforms, double *energies, size_t n) const;
+  std::vector<double> sample(std::vector<double> const &uniforms) const;
+
+  // Fills energies[0, n) using uniform numbers drawn from rng in blocks, so
+  // that any standard random number engine can supply the stream.
+  template <typename URBG>
+  void fill(URBG &rng, double *energies, size_t n) const {
+    std::uniform_real_distribution<double> uniform(0, 1);
+    double uniforms[2 * kBlockSize];
+    for (size_t offset = 0; offset < n; offset += kBlockSize) {
+      size_t nblock = std::min(kBlockSize, n - offset);
+      for (size_t i = 0; i < 2 * nblock; ++i) {
+        uniforms[i] = uniform(rng);
+      }
+      sample(uniforms, energies + offset, nblock);
+    }
+  }
+
+  static constexpr size_t kBlockSize = 1024;
+};
+
+// Throws if flux has no bins, any negative counts, or a zero integral. As
+// FluxHistogram counts are the flux integrated over each bin, count and
+// count_density fluxes are both sampled correctly, and
+// CrossSectionMeasurement::combined_probe_fluxes can be used to sample from
+// weighted combinations.
+FluxSampler make_FluxSampler(FluxHistogram const &flux);
+// Uses flux.histogram, throws if it could not be built.
+FluxSampler make_FluxSampler(ProbeFlux const &flux);
+
+} // namespace nuis::HEPData
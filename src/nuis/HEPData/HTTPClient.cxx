@@ -0,0 +1,315 @@
+#include "nuis/HEPData/HTTPClient.h"
+
+#include "cpr/cpr.h"
+
+#include "yaml-cpp/yaml.h"
+
+#include "fmt/core.h"
+#include "spdlog/spdlog.h"
+
+#include <unistd.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nuis::HEPData {
+
+spdlog::logger &refresolv_log();
+
+namespace {
+
+struct Timeouts {
+  std::chrono::milliseconds connect, total;
+};
+
+// A timeout of 0 would mean none at all, so values that don't parse as a
+// positive number of seconds are ignored rather than disabling the timeout.
+std::chrono::milliseconds env_timeout(char const *name,
+                                      std::chrono::milliseconds def) {
+  auto env = std::getenv(name);
+  if (!env) {
+    return def;
+  }
+  char *end = nullptr;
+  double seconds = std::strtod(env, &end);
+  if ((end == env) || *end || !(seconds > 0) || (seconds > 1E9)) {
+    refresolv_log().warn("Ignoring {}={}, which is not a positive number of "
+                         "seconds, using the default of {}s.",
+                         name, env, def.count() / 1000.0);
+    return def;
+  }
+  return std::chrono::milliseconds(long(seconds * 1000));
+}
+
+std::mutex &timeouts_mutex() {
+  static std::mutex mtx;
+  return mtx;
+}
+
+Timeouts &timeouts() {
+  static Timeouts tos{
+      env_timeout("NUISANCEHEPData_HTTP_CONNECT_TIMEOUT",
+                  std::chrono::seconds(10)),
+      env_timeout("NUISANCEHEPData_HTTP_TIMEOUT", std::chrono::minutes(10))};
+  return tos;
+}
+
+// Sessions are not safe to share between threads, so each request borrows an
+// idle session from the pool, or creates a new one, and returns it when done.
+// A session keeps its connections open between requests.
+class PooledSession {
+  std::unique_ptr<cpr::Session> session;
+
+  static std::mutex &pool_mutex() {
+    static std::mutex mtx;
+    return mtx;
+  }
+  static std::vector<std::unique_ptr<cpr::Session>> &pool() {
+    static std::vector<std::unique_ptr<cpr::Session>> sessions;
+    return sessions;
+  }
+
+public:
+  PooledSession() {
+    {
+      std::lock_guard lock(pool_mutex());
+      if (pool().size()) {
+        session = std::move(pool().back());
+        pool().pop_back();
+      }
+    }
+    if (!session) {
+      session = std::make_unique<cpr::Session>();
+    }
+
+    Timeouts tos;
+    {
+      std::lock_guard lock(timeouts_mutex());
+      tos = timeouts();
+    }
+    session->SetConnectTimeout(cpr::ConnectTimeout{tos.connect});
+    session->SetTimeout(cpr::Timeout{tos.total});
+  }
+
+  PooledSession(PooledSession const &) = delete;
+  PooledSession &operator=(PooledSession const &) = delete;
+
+  ~PooledSession() {
+    std::lock_guard lock(pool_mutex());
+    pool().push_back(std::move(session));
+  }
+
+  cpr::Session *operator->() { return session.get(); }
+};
+
+void prepare(PooledSession &session, std::string const &url,
+             std::map<std::string, std::string> const &parameters,
+             cpr::Header const &header) {
+  cpr::Parameters params;
+  for (auto const &[k, v] : parameters) {
+    params.Add(cpr::Parameter{k, v});
+  }
+  session->SetUrl(cpr::Url{url});
+  session->SetParameters(params);
+  session->SetHeader(header);
+}
+
+HTTPResponse to_HTTPResponse(cpr::Response &r) {
+  HTTPResponse resp;
+  resp.status_code = r.status_code;
+  resp.content_type = r.header["content-type"];
+  resp.etag = r.header["etag"];
+  resp.error = r.error.message;
+  resp.total_length = 0;
+
+  // Content-Range: bytes <first>-<last>/<total>
+  auto const &content_range = r.header["content-range"];
+  auto slash = content_range.find('/');
+  if ((r.status_code == 206) && (slash != std::string::npos)) {
+    resp.total_length = std::strtoull(content_range.c_str() + slash + 1,
+                                      nullptr, 10);
+  }
+  resp.revalidated = false;
+  return resp;
+}
+
+struct CachedResponse {
+  std::string etag, last_modified, content_type, body;
+};
+
+// The validators are kept in a small yaml file at cache and the body verbatim
+// alongside it in <cache>.body
+std::filesystem::path body_path(std::filesystem::path cache) {
+  cache += ".body";
+  return cache;
+}
+
+bool read_revalidation_cache(std::filesystem::path const &cache,
+                             std::string const &url, CachedResponse &cached) {
+  if (cache.empty() || !std::filesystem::exists(cache)) {
+    return false;
+  }
+  try {
+    auto doc = YAML::LoadFile(cache.native());
+    if (doc["url"].as<std::string>() != url) {
+      return false;
+    }
+    cached.etag = doc["etag"].as<std::string>();
+    cached.last_modified = doc["last_modified"].as<std::string>();
+    cached.content_type = doc["content_type"].as<std::string>();
+  } catch (YAML::Exception const &e) {
+    refresolv_log().debug(
+        "      * ignoring unreadable revalidation cache {}: {}",
+        cache.native(), e.what());
+    return false;
+  }
+
+  std::ifstream fin(body_path(cache), std::ios::binary);
+  if (!fin) {
+    return false;
+  }
+  cached.body.assign(std::istreambuf_iterator<char>(fin),
+                     std::istreambuf_iterator<char>());
+  return true;
+}
+
+// Each file is written to a temporary and renamed into place so that
+// concurrent readers never see a partial file. The body is replaced first, so
+// a reader can at worst pair a new body with stale validators, which just
+// costs a full response next time.
+void replace_file(std::filesystem::path const &p, std::string const &contents) {
+  auto tmp = p;
+  tmp += fmt::format(".{}.{}", ::getpid(),
+                     std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  {
+    std::ofstream(tmp, std::ios::binary) << contents;
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp, p, ec);
+  if (ec) {
+    std::filesystem::remove(tmp, ec);
+  }
+}
+
+void write_revalidation_cache(std::filesystem::path const &cache,
+                              std::string const &url,
+                              CachedResponse const &cached) {
+  YAML::Emitter out;
+  out << YAML::BeginMap;
+  out << YAML::Key << "url" << YAML::Value << url;
+  out << YAML::Key << "etag" << YAML::Value << cached.etag;
+  out << YAML::Key << "last_modified" << YAML::Value << cached.last_modified;
+  out << YAML::Key << "content_type" << YAML::Value << cached.content_type;
+  out << YAML::EndMap;
+
+  std::error_code ec;
+  std::filesystem::create_directories(cache.parent_path(), ec);
+  replace_file(body_path(cache), cached.body);
+  replace_file(cache, out.c_str());
+}
+
+} // namespace
+
+std::pair<std::chrono::milliseconds, std::chrono::milliseconds>
+get_http_timeouts() {
+  std::lock_guard lock(timeouts_mutex());
+  return {timeouts().connect, timeouts().total};
+}
+
+void set_http_timeouts(std::chrono::milliseconds connect_timeout,
+                       std::chrono::milliseconds total_timeout) {
+  std::lock_guard lock(timeouts_mutex());
+  timeouts() = Timeouts{connect_timeout, total_timeout};
+}
+
+HTTPResponse http_get(std::string const &url,
+                      std::map<std::string, std::string> const &parameters,
+                      std::string &body,
+                      std::filesystem::path const &revalidation_cache) {
+
+  CachedResponse cached;
+  bool have_cached =
+      read_revalidation_cache(revalidation_cache, url, cached);
+
+  cpr::Header header;
+  if (have_cached) {
+    if (cached.etag.size()) {
+      header["If-None-Match"] = cached.etag;
+    }
+    if (cached.last_modified.size()) {
+      header["If-Modified-Since"] = cached.last_modified;
+    }
+  }
+
+  PooledSession session;
+  prepare(session, url, parameters, header);
+  cpr::Response r = session->Get();
+  auto resp = to_HTTPResponse(r);
+
+  if (have_cached && (r.status_code == 304)) {
+    refresolv_log().debug("      * {} not modified, using cached response",
+                          url);
+    resp.status_code = 200;
+    resp.content_type = cached.content_type;
+    resp.revalidated = true;
+    body = std::move(cached.body);
+    return resp;
+  }
+
+  body = std::move(r.text);
+
+  if ((r.status_code == 200) && !revalidation_cache.empty()) {
+    cached.etag = r.header["etag"];
+    cached.last_modified = r.header["last-modified"];
+    if (cached.etag.size() || cached.last_modified.size()) {
+      cached.content_type = resp.content_type;
+      cached.body = body;
+      write_revalidation_cache(revalidation_cache, url, cached);
+    }
+  }
+
+  return resp;
+}
+
+HTTPResponse http_get_range(std::string const &url,
+                            std::map<std::string, std::string> const &parameters,
+                            int64_t offset, uint64_t length, std::string &body,
+                            std::string const &if_range) {
+  cpr::Header header;
+  if (offset < 0) {
+    header["Range"] = fmt::format("bytes=-{}", length);
+  } else {
+    header["Range"] = fmt::format("bytes={}-{}", offset, offset + length - 1);
+  }
+  if (if_range.size()) {
+    header["If-Range"] = if_range;
+  }
+
+  PooledSession session;
+  prepare(session, url, parameters, header);
+  cpr::Response r = session->Get();
+  body = std::move(r.text);
+
+  return to_HTTPResponse(r);
+}
+
+HTTPResponse
+http_download(std::string const &url,
+              std::map<std::string, std::string> const &parameters,
+              std::filesystem::path const &destination) {
+  std::ofstream of(destination, std::ios::binary);
+
+  PooledSession session;
+  prepare(session, url, parameters, cpr::Header{});
+  cpr::Response r = session->Download(of);
+
+  return to_HTTPResponse(r);
+}
+
+} // namespace nuis::HEPData
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <utility>
+
+namespace nuis::HEPData {
+
+// All requests to remote record endpoints go through a pool of persistent
+// sessions, so that connections to the same host are kept alive and reused
+// between requests, including from different threads.
+
+// Requests fail if a connection cannot be established within connect_timeout
+// or if the whole transfer takes longer than total_timeout. A zero duration
+// disables the corresponding timeout. The defaults of 10 s and 10 minutes can
+// be overridden by the NUISANCEHEPData_HTTP_CONNECT_TIMEOUT and
+// NUISANCEHEPData_HTTP_TIMEOUT environment variables, in seconds. Values of
+// those that are not a positive number are ignored with a warning.
+std::pair<std::chrono::milliseconds, std::chrono::milliseconds>
+get_http_timeouts();
+void set_http_timeouts(std::chrono::milliseconds connect_timeout,
+                       std::chrono::milliseconds total_timeout);
+
+struct HTTPResponse {
+  // 0 if the request could not be made at all, see error
+  long status_code;
+  std::string content_type;
+  std::string etag;
+  std::string error;
+
+  // for 206 Partial Content responses, the length of the whole resource
+  uint64_t total_length;
+
+  // true if the server responded 304 Not Modified and the body was restored
+  // from the revalidation cache
+  bool revalidated;
+};
+
+// GETs url and writes the body into body. If revalidation_cache is not empty,
+// the ETag and Last-Modified validators of a successful response are stored
+// there along with the body, and sent with the next request for the same url
+// so that an unchanged resource costs a 304 response rather than a transfer.
+HTTPResponse
+http_get(std::string const &url,
+         std::map<std::string, std::string> const &parameters,
+         std::string &body,
+         std::filesystem::path const &revalidation_cache = {});
+
+// GETs length bytes of url starting from offset, or the last length bytes if
+// offset is negative. Servers that support range requests respond with 206,
+// others may send the whole resource with a 200. If if_range is given, it is
+// sent as an If-Range validator, so a server only sends the range if the
+// resource still matches that ETag.
+HTTPResponse http_get_range(std::string const &url,
+                            std::map<std::string, std::string> const &parameters,
+                            int64_t offset, uint64_t length, std::string &body,
+                            std::string const &if_range = "");
+
+// GETs url and streams the body to destination.
+HTTPResponse
+http_download(std::string const &url,
+              std::map<std::string, std::string> const &parameters,
+              std::filesystem::path const &destination);
+
+} // namespace nuis::HEPData
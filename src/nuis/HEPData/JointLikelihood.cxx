@@ -0,0 +1,151 @@
+#include "nuis/HEPData/JointLikelihood.h"
+
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+#include <utility>
+
+namespace nuis::HEPData {
+
+namespace {
+
+// Splits the dense cross covariance between measurements a and b, which cover
+// blocks [block_offsets[a], block_offsets[a+1]) and likewise for b, along the
+// block boundaries of joint, storing the non-zero blocks below the diagonal.
+void add_cross_blocks(BlockMatrix &joint,
+                      std::vector<size_t> const &block_offsets, size_t a,
+                      size_t b, std::vector<double> const &cross) {
+  bool transpose = a < b;
+  size_t rows = transpose ? b : a, cols = transpose ? a : b;
+  size_t ncols_cross =
+      joint.offsets[block_offsets[b + 1]] - joint.offsets[block_offsets[b]];
+
+  for (size_t bi = block_offsets[rows]; bi < block_offsets[rows + 1]; ++bi) {
+    size_t ni = joint.block_size(bi);
+    size_t oi = joint.offsets[bi] - joint.offsets[block_offsets[rows]];
+    for (size_t bj = block_offsets[cols]; bj < block_offsets[cols + 1]; ++bj) {
+      size_t nj = joint.block_size(bj);
+      size_t oj = joint.offsets[bj] - joint.offsets[block_offsets[cols]];
+
+      std::vector<double> blk(ni * nj);
+      bool nonzero = false;
+      for (size_t i = 0; i < ni; ++i) {
+        for (size_t j = 0; j < nj; ++j) {
+          blk[i * nj + j] = transpose
+                                ? cross[(oj + j) * ncols_cross + (oi + i)]
+                                : cross[(oi + i) * ncols_cross + (oj + j)];
+          nonzero = nonzero || (blk[i * nj + j] != 0);
+        }
+      }
+      if (nonzero) {
+        joint.blocks.emplace(std::make_pair(bi, bj), std::move(blk));
+      }
+    }
+  }
+}
+
+} // namespace
+
+size_t JointLikelihood::size() const { return data.size(); }
+
+double JointLikelihood::chi2(std::vector<double> const &prediction,
+                             size_t nworkers) const {
+  if (prediction.size() != data.size()) {
+    throw std::runtime_error(
+        fmt::format("JointLikelihood has {} bins, but was passed a prediction "
+                    "with {}.",
+                    data.size(), prediction.size()));
+  }
+  std::vector<double> residual(data.size());
+  for (size_t i = 0; i < data.size(); ++i) {
+    residual[i] = prediction[i] - data[i];
+  }
+  return factor.chi2(residual, nworkers);
+}
+
+double
+JointLikelihood::chi2(std::vector<std::vector<double>> const &predictions,
+                      size_t nworkers) const {
+  if (predictions.size() != measurements.size()) {
+    throw std::runtime_error(fmt::format(
+        "JointLikelihood has {} measurements, but was passed {} predictions.",
+        measurements.size(), predictions.size()));
+  }
+  std::vector<double> prediction;
+  prediction.reserve(data.size());
+  for (size_t m = 0; m < measurements.size(); ++m) {
+    if (predictions[m].size() != measurements[m].data.size()) {
+      throw std::runtime_error(
+          fmt::format("Measurement {} of JointLikelihood has {} bins, but was "
+                      "passed a prediction with {}.",
+                      m, measurements[m].data.size(), predictions[m].size()));
+    }
+    prediction.insert(prediction.end(), predictions[m].begin(),
+                      predictions[m].end());
+  }
+  return chi2(prediction, nworkers);
+}
+
+JointLikelihood
+make_JointLikelihood(std::vector<CrossSectionMeasurement> const &measurements,
+                     std::vector<CrossCovariance> const &cross_covariances) {
+  JointLikelihood jl;
+  jl.offsets.push_back(0);
+  jl.covariance.offsets.push_back(0);
+
+  // the first block of each measurement in the joint covariance
+  std::vector<size_t> block_offsets{0};
+  for (auto const &xsm : measurements) {
+    auto jm = flatten_measurement(xsm);
+
+    size_t block_offset = jl.covariance.nblocks();
+    size_t row_offset = jl.covariance.size();
+    for (size_t b = 0; b < jm.covariance.nblocks(); ++b) {
+      jl.covariance.offsets.push_back(row_offset +
+                                      jm.covariance.offsets[b + 1]);
+    }
+    for (auto const &[idx, blk] : jm.covariance.blocks) {
+      jl.covariance.blocks.emplace(std::make_pair(idx.first + block_offset,
+                                                  idx.second + block_offset),
+                                   blk);
+    }
+    block_offsets.push_back(jl.covariance.nblocks());
+
+    jl.data.insert(jl.data.end(), jm.data.begin(), jm.data.end());
+    jl.offsets.push_back(jl.data.size());
+    jl.measurements.push_back(std::move(jm));
+  }
+
+  std::set<std::pair<size_t, size_t>> correlated;
+  for (auto const &cc : cross_covariances) {
+    if ((cc.first >= measurements.size()) ||
+        (cc.second >= measurements.size()) || (cc.first == cc.second)) {
+      throw std::runtime_error(fmt::format(
+          "Invalid cross covariance between measurements {} and {} of {}.",
+          cc.first, cc.second, measurements.size()));
+    }
+    if (!correlated.emplace(std::minmax(cc.first, cc.second)).second) {
+      throw std::runtime_error(fmt::format(
+          "Cross covariance between measurements {} and {} given more than "
+          "once.",
+          cc.first, cc.second));
+    }
+    size_t nrows = jl.measurements[cc.first].data.size();
+    size_t ncols = jl.measurements[cc.second].data.size();
+    if (cc.covariance.size() != (nrows * ncols)) {
+      throw std::runtime_error(fmt::format(
+          "Cross covariance between measurements {} and {} has {} elements, "
+          "expected {}x{}.",
+          cc.first, cc.second, cc.covariance.size(), nrows, ncols));
+    }
+    add_cross_blocks(jl.covariance, block_offsets, cc.first, cc.second,
+                     cc.covariance);
+  }
+
+  jl.factor = factorize(jl.covariance);
+  return jl;
+}
+
+} // namespace nuis::HEPData
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "nuis/HEPData/BlockMatrix.h"
+#include "nuis/HEPData/JointMeasurement.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace nuis::HEPData {
+
+// The covariance between the bins of two measurements of a JointLikelihood,
+// given by their index in the list of measurements. Dense and row-major, with
+// a row for each bin of measurements[first] and a column for each bin of
+// measurements[second], in the order of their flattened data.
+struct CrossCovariance {
+  size_t first;
+  size_t second;
+  std::vector<double> covariance;
+};
+
+// A chi2 test statistic over several measurements, possibly from different
+// records, with optional correlations between them. The joint covariance is
+// factorised once on construction, and only the groups of blocks that are
+// actually correlated are factorised together, so adding uncorrelated
+// measurements costs no more than evaluating them separately.
+struct JointLikelihood {
+  std::vector<JointMeasurement> measurements;
+  // measurements[m] covers data[offsets[m], offsets[m+1])
+  std::vector<size_t> offsets;
+  std::vector<double> data;
+  // blocked by the segments of each measurement in turn
+  BlockMatrix covariance;
+  BlockCholesky factor;
+
+  size_t size() const;
+
+  // The total chi2 for a prediction per measurement, each in the order of
+  // that measurement's flattened data. Independent groups of blocks are
+  // evaluated on up to nworkers threads, 0 uses one thread per hardware core.
+  double chi2(std::vector<std::vector<double>> const &predictions,
+              size_t nworkers = 1) const;
+  // As above, for the predictions concatenated in the order of data.
+  double chi2(std::vector<double> const &prediction, size_t nworkers = 1) const;
+};
+
+// Flattens each measurement with flatten_measurement and factorises their
+// joint covariance, including any cross covariances between them. Throws if
+// a cross covariance has the wrong shape, refers to a measurement that doesn't
+// exist, or is given more than once for the same pair, or if the joint
+// covariance is not positive definite.
+JointLikelihood
+make_JointLikelihood(std::vector<CrossSectionMeasurement> const &measurements,
+                     std::vector<CrossCovariance> const &cross_covariances = {});
+
+} // namespace nuis::HEPData
@@ -0,0 +1,225 @@
+#include "nuis/HEPData/JointMeasurement.h"
+
+#include "fmt/core.h"
+
+#include <map>
+#include <stdexcept>
+
+namespace nuis::HEPData {
+
+namespace {
+
+std::vector<double> data_values(DependentVariable const &var,
+                                std::filesystem::path const &source) {
+  std::vector<double> values;
+  values.reserve(var.values.size());
+  for (auto const &v : var.values) {
+    if (v.value.index() != 1) {
+      throw std::runtime_error(
+          fmt::format("Measurement: {} has a binned dependent variable, "
+                      "expected a value per bin.",
+                      source.native()));
+    }
+    values.push_back(std::get<double>(v.value));
+  }
+  return values;
+}
+
+std::vector<double> total_errors(DependentVariable const &var,
+                                 std::filesystem::path const &source) {
+  std::vector<double> errs;
+  errs.reserve(var.values.size());
+  for (auto const &v : var.values) {
+    if (!v.errors.count("total")) {
+      throw std::runtime_error(
+          fmt::format("Measurement: {} has a bin with no \"total\" error.",
+                      source.native()));
+    }
+    errs.push_back(v.errors.at("total"));
+  }
+  return errs;
+}
+
+// the measurements that make up xsm, depth first. A composite without
+// sub_measurements, such as a target ratio, holds its own data and is a leaf.
+std::vector<CrossSectionMeasurement const *>
+leaves(CrossSectionMeasurement const &xsm) {
+  if (!xsm.is_composite || !xsm.sub_measurements.size()) {
+    return {&xsm};
+  }
+  std::vector<CrossSectionMeasurement const *> simple;
+  for (auto const &sub : xsm.sub_measurements) {
+    auto sub_leaves = leaves(sub);
+    simple.insert(simple.end(), sub_leaves.begin(), sub_leaves.end());
+  }
+  return simple;
+}
+
+// appends the blocks of m to the bottom right of joint
+void append_blocks(BlockMatrix &joint, BlockMatrix const &m) {
+  size_t block_offset = joint.nblocks();
+  size_t row_offset = joint.size();
+  if (!joint.offsets.size()) {
+    joint.offsets.push_back(0);
+  }
+  for (size_t b = 0; b < m.nblocks(); ++b) {
+    joint.offsets.push_back(row_offset + m.offsets[b + 1]);
+  }
+  for (auto const &[idx, blk] : m.blocks) {
+    joint.blocks.emplace(
+        std::make_pair(idx.first + block_offset, idx.second + block_offset),
+        blk);
+  }
+}
+
+BlockMatrix joint_covariance(CrossSectionMeasurement const &xsm) {
+  if (xsm.errors.size()) {
+    if (xsm.errors.size() > 1) {
+      throw std::runtime_error(fmt::format(
+          "Measurement: {} has {} errors tables, a joint covariance needs "
+          "exactly one.",
+          xsm.source.native(), xsm.errors.size()));
+    }
+
+    // a composite's errors refer to the concatenated sub-measurement data
+    DependentVariable data;
+    std::vector<size_t> offsets{0};
+    for (auto leaf : leaves(xsm)) {
+      auto const &vals = leaf->dependent_vars.at(0).values;
+      data.values.insert(data.values.end(), vals.begin(), vals.end());
+      offsets.push_back(data.values.size());
+    }
+
+    return make_BlockMatrix(covariance_matrix(xsm.errors.front(), data),
+                            std::move(offsets));
+  }
+
+  if (!xsm.is_composite || !xsm.sub_measurements.size()) {
+    // uncorrelated total errors
+    auto errs = total_errors(xsm.dependent_vars.at(0), xsm.source);
+    std::vector<double> blk(errs.size() * errs.size(), 0);
+    for (size_t i = 0; i < errs.size(); ++i) {
+      blk[i * errs.size() + i] = errs[i] * errs[i];
+    }
+    BlockMatrix diag{{0, errs.size()}, {}};
+    diag.blocks.emplace(std::make_pair(size_t(0), size_t(0)), std::move(blk));
+    return diag;
+  }
+
+  BlockMatrix cov{{}, {}};
+  for (auto const &sub : xsm.sub_measurements) {
+    append_blocks(cov, joint_covariance(sub));
+  }
+  return cov;
+}
+
+} // namespace
+
+JointMeasurement::Segment const &
+JointMeasurement::segment(std::filesystem::path const &source) const {
+  for (auto const &seg : segments) {
+    if (seg.source == source) {
+      return seg;
+    }
+  }
+  throw std::runtime_error(fmt::format(
+      "JointMeasurement has no segment from: {}", source.native()));
+}
+
+std::vector<double> table_matrix(Table const &tbl, size_t nrows,
+                                 size_t ncols) {
+  auto const &var = tbl.dependent_vars.at(0);
+  if (tbl.independent_vars.size() != 2) {
+    throw std::runtime_error(
+        fmt::format("Table: {} has {} independent variables, expected 2.",
+                    tbl.source.native(), tbl.independent_vars.size()));
+  }
+
+  auto bin_key = [](Value const &v) {
+    return v.value.index() ? std::get<double>(v.value)
+                           : std::get<Extent>(v.value).low;
+  };
+
+  size_t const nbins[2] = {nrows, ncols};
+  std::vector<size_t> indices[2];
+  for (size_t d = 0; d < 2; ++d) {
+    auto const &ivar = tbl.independent_vars[d];
+    if (ivar.values.size() != var.values.size()) {
+      throw std::runtime_error(fmt::format(
+          "Table: {} independent variable {} has {} values, but dependent "
+          "variable {} has {}.",
+          tbl.source.native(), ivar.name, ivar.values.size(), var.name,
+          var.values.size()));
+    }
+    std::map<double, size_t> first_seen;
+    for (auto const &v : ivar.values) {
+      indices[d].push_back(
+          first_seen.emplace(bin_key(v), first_seen.size()).first->second);
+    }
+    if (first_seen.size() != nbins[d]) {
+      throw std::runtime_error(fmt::format(
+          "Table: {} covers {} bins in {}, expected {}.", tbl.source.native(),
+          first_seen.size(), ivar.name, nbins[d]));
+    }
+  }
+
+  std::vector<double> dense(nrows * ncols, 0);
+  for (size_t k = 0; k < var.values.size(); ++k) {
+    if (var.values[k].value.index() != 1) {
+      throw std::runtime_error(fmt::format("Table: {} has binned values.",
+                                           tbl.source.native()));
+    }
+    dense[indices[0][k] * ncols + indices[1][k]] =
+        std::get<double>(var.values[k].value);
+  }
+  return dense;
+}
+
+std::vector<double> covariance_matrix(ErrorTable const &errors,
+                                      DependentVariable const &data) {
+  size_t n = data.values.size();
+  auto matrix = table_matrix(errors, n, n);
+
+  if (errors.error_type == "covariance") {
+    return matrix;
+  } else if (errors.error_type == "inverse_covariance") {
+    auto inv = factorize(make_BlockMatrix(matrix, {0, n})).inverse();
+    return inv.to_dense();
+  } else if (errors.error_type == "fractional_covariance") {
+    auto values = data_values(data, errors.source);
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t j = 0; j < n; ++j) {
+        matrix[i * n + j] *= values[i] * values[j];
+      }
+    }
+    return matrix;
+  } else if (errors.error_type == "correlation") {
+    auto errs = total_errors(data, errors.source);
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t j = 0; j < n; ++j) {
+        matrix[i * n + j] *= errs[i] * errs[j];
+      }
+    }
+    return matrix;
+  }
+
+  throw std::runtime_error(fmt::format(
+      "Cannot build a covariance matrix from error table: {} with "
+      "error_type: {}",
+      errors.source.native(), errors.error_type));
+}
+
+JointMeasurement flatten_measurement(CrossSectionMeasurement const &xsm) {
+  JointMeasurement joint;
+  for (auto leaf : leaves(xsm)) {
+    auto const &var = leaf->dependent_vars.at(0);
+    joint.segments.push_back(JointMeasurement::Segment{
+        leaf->source, leaf->name, joint.data.size(), var.values.size()});
+    auto values = data_values(var, leaf->source);
+    joint.data.insert(joint.data.end(), values.begin(), values.end());
+  }
+  joint.covariance = joint_covariance(xsm);
+  return joint;
+}
+
+} // namespace nuis::HEPData
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "nuis/HEPData/BlockMatrix.h"
+#include "nuis/HEPData/CrossSectionMeasurement.h"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace nuis::HEPData {
+
+// The data of a measurement, or of all the measurements that make up a
+// composite measurement, as a single vector with a joint covariance.
+struct JointMeasurement {
+  // Each simple measurement covers data[offset, offset + size).
+  struct Segment {
+    std::filesystem::path source;
+    std::string name;
+    size_t offset;
+    size_t size;
+  };
+
+  std::vector<Segment> segments;
+  std::vector<double> data;
+  // Blocked by segment, the blocks between segments are only present where a
+  // composite measurement's errors correlate them.
+  BlockMatrix covariance;
+
+  // Throws if no segment comes from source.
+  Segment const &segment(std::filesystem::path const &source) const;
+};
+
+// The dense, row-major, nrows x ncols matrix held by a table with two
+// independent variables giving the global bin numbers of each element, as
+// used by error and smearing tables. Rows and columns are assigned in order of
+// the first appearance of each bin number, elements that are not given are
+// zero. Throws if the table doesn't cover exactly nrows and ncols bins.
+std::vector<double> table_matrix(Table const &tbl, size_t nrows, size_t ncols);
+
+// The covariance described by the error table for a measurement with the
+// given data, converted to an absolute covariance whatever its error_type.
+// Correlation matrices are scaled by the total errors of the data. Universes
+// are not supported.
+std::vector<double> covariance_matrix(ErrorTable const &errors,
+                                      DependentVariable const &data);
+
+// Concatenates the data of the simple measurements that make up xsm, in
+// depth-first order of its sub_measurements. A composite measurement without
+// sub_measurements, such as a target ratio, contributes its own data as a
+// single segment. The covariance is taken from the
+// errors of the outermost measurement that has them, so a composite's errors
+// span all of its sub-measurements and otherwise each sub-measurement
+// contributes its own block. A simple measurement without errors falls back
+// to the squares of its total errors on the diagonal.
+JointMeasurement flatten_measurement(CrossSectionMeasurement const &xsm);
+
+} // namespace nuis::HEPData
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// Internal to the library, not installed.
+
+namespace nuis::HEPData {
+
+// The number of threads that parallel_for runs n tasks on when asked for
+// nworkers, 0 uses one thread per hardware core.
+inline size_t parallel_for_workers(size_t n, size_t nworkers) {
+  if (!nworkers) {
+    nworkers = std::max(1u, std::thread::hardware_concurrency());
+  }
+  return std::max(size_t(1), std::min(nworkers, n));
+}
+
+// Calls f(i, worker) for each i in [0, n) on parallel_for_workers(n, nworkers)
+// threads, one of which is the calling thread. Each thread takes the next i as
+// it finishes the last, so uneven tasks balance out. worker is the index of
+// the calling thread, in [0, parallel_for_workers(n, nworkers)), for keeping
+// per-thread scratch space. Threads are started on every call, which costs
+// tens of microseconds, so only pass nworkers > 1 for enough work to cover it.
+// If f throws, no further tasks are started and the first exception is
+// rethrown once every thread has finished.
+template <typename F>
+void parallel_for(size_t n, size_t nworkers, F const &f) {
+  nworkers = parallel_for_workers(n, nworkers);
+
+  std::atomic<size_t> next{0};
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  auto worker = [&](size_t w) {
+    try {
+      for (size_t i = next++; i < n; i = next++) {
+        f(i, w);
+      }
+    } catch (...) {
+      next = n;
+      std::lock_guard lock(error_mutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  try {
+    for (size_t w = 1; w < nworkers; ++w) {
+      threads.emplace_back(worker, w);
+    }
+  } catch (std::system_error const &) {
+    // the threads that could be started, and this one, do all of the work
+  }
+  worker(0);
+  for (auto &t : threads) {
+    t.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+} // namespace nuis::HEPData
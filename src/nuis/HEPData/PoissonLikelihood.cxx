@@ -0,0 +1,105 @@
+#include "nuis/HEPData/PoissonLikelihood.h"
+
+#include "fmt/core.h"
+
+#include <cmath>
+#include <stdexcept>
+
+namespace nuis::HEPData {
+
+namespace {
+
+void append_counts(CrossSectionMeasurement const &xsm,
+                   std::vector<double> &counts) {
+  if (xsm.is_composite && xsm.sub_measurements.size()) {
+    for (auto const &sub : xsm.sub_measurements) {
+      append_counts(sub, counts);
+    }
+    return;
+  }
+  for (auto const &v : xsm.dependent_vars.at(0).values) {
+    if ((v.value.index() != 1) || !(std::get<double>(v.value) >= 0)) {
+      throw std::runtime_error(
+          fmt::format("Measurement: {} has a bin that is not a non-negative "
+                      "event count.",
+                      xsm.source.native()));
+    }
+    counts.push_back(std::get<double>(v.value));
+  }
+}
+
+} // namespace
+
+size_t PoissonLikelihood::size() const { return counts.size(); }
+
+double PoissonLikelihood::log_likelihood(double const *prediction,
+                                         double *gradient) const {
+  size_t n = counts.size();
+  double const *c = counts.data();
+  double const *shift = zero_shift.data();
+
+  double llh = 0;
+  for (size_t i = 0; i < n; ++i) {
+    llh += c[i] * std::log(prediction[i] + shift[i]) - prediction[i];
+  }
+  if (gradient) {
+    for (size_t i = 0; i < n; ++i) {
+      gradient[i] = c[i] / (prediction[i] + shift[i]) - 1;
+    }
+  }
+  return llh - log_factorials;
+}
+
+double
+PoissonLikelihood::log_likelihood(std::vector<double> const &prediction) const {
+  if (prediction.size() != counts.size()) {
+    throw std::runtime_error(
+        fmt::format("PoissonLikelihood has {} bins, but was passed a "
+                    "prediction with {}.",
+                    counts.size(), prediction.size()));
+  }
+  return log_likelihood(prediction.data());
+}
+
+std::vector<double>
+PoissonLikelihood::log_likelihood_batch(std::vector<double> const &predictions,
+                                        std::vector<double> *gradients) const {
+  size_t n = counts.size();
+  if (!n || (predictions.size() % n)) {
+    throw std::runtime_error(
+        fmt::format("PoissonLikelihood has {} bins, but was passed {} "
+                    "predicted values, which is not a whole number of "
+                    "predictions.",
+                    n, predictions.size()));
+  }
+
+  size_t nbatch = predictions.size() / n;
+  if (gradients) {
+    gradients->resize(predictions.size());
+  }
+  std::vector<double> llhs(nbatch);
+  for (size_t b = 0; b < nbatch; ++b) {
+    llhs[b] = log_likelihood(predictions.data() + b * n,
+                             gradients ? (gradients->data() + b * n) : nullptr);
+  }
+  return llhs;
+}
+
+double PoissonLikelihood::chi2(std::vector<double> const &prediction) const {
+  return -2 * (log_likelihood(prediction) - saturated_log_likelihood);
+}
+
+PoissonLikelihood make_PoissonLikelihood(CrossSectionMeasurement const &xsm) {
+  PoissonLikelihood pl{{}, {}, 0, 0};
+  append_counts(xsm, pl.counts);
+
+  pl.zero_shift.reserve(pl.counts.size());
+  for (auto n : pl.counts) {
+    pl.zero_shift.push_back((n == 0) ? 1 : 0);
+    pl.log_factorials += std::lgamma(n + 1);
+  }
+  pl.saturated_log_likelihood = pl.log_likelihood(pl.counts.data());
+  return pl;
+}
+
+} // namespace nuis::HEPData
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "nuis/HEPData/CrossSectionMeasurement.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace nuis::HEPData {
+
+// The Poisson log-likelihood of the observed counts of an event_rate
+// measurement given a prediction of the expected counts in each bin,
+//   ln L = sum_i n_i ln(mu_i) - mu_i - ln(n_i!).
+// Everything that depends only on the data, including the ln(n_i!), is
+// computed once on construction, so each evaluation is a single branch-free
+// pass over the prediction. That pass makes one std::log call per bin, which
+// compilers do not vectorise without relaxed floating point semantics, so it
+// runs at the speed of the scalar log.
+struct PoissonLikelihood {
+  std::vector<double> counts;
+  // 1 for the bins with no observed events, so that n ln(mu + shift) is 0
+  // there even when mu is 0, and 0 elsewhere
+  std::vector<double> zero_shift;
+  // sum_i ln(n_i!)
+  double log_factorials;
+  // ln L evaluated at mu = n
+  double saturated_log_likelihood;
+
+  size_t size() const;
+
+  // ln L for the size() expected counts at prediction. If gradient is not
+  // null, d ln L / d mu_i is written to gradient[i].
+  double log_likelihood(double const *prediction,
+                        double *gradient = nullptr) const;
+  double log_likelihood(std::vector<double> const &prediction) const;
+  // ln L for each of the predictions.size()/size() predictions laid out one
+  // after the other, gradients, if requested, are laid out in the same way.
+  std::vector<double>
+  log_likelihood_batch(std::vector<double> const &predictions,
+                       std::vector<double> *gradients = nullptr) const;
+
+  // -2 ln(L/L_saturated), which is asymptotically chi2 distributed and is
+  // the value used for the poisson_pdf test_statistic.
+  double chi2(std::vector<double> const &prediction) const;
+};
+
+// Built from the data of each simple measurement making up xsm, concatenated
+// in the same order as flatten_measurement. Throws if any count is negative
+// or is not a single value.
+PoissonLikelihood make_PoissonLikelihood(CrossSectionMeasurement const &xsm);
+
+} // namespace nuis::HEPData
@@ -0,0 +1,135 @@
+#include "nuis/HEPData/PredictionValidation.h"
+
+#include "nuis/HEPData/ParallelFor.h"
+#include "nuis/HEPData/RecordIndex.h"
+#include "nuis/HEPData/TableFactory.h"
+#include "nuis/HEPData/TestStatistic.h"
+
+#include "fmt/core.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+namespace nuis::HEPData {
+
+spdlog::logger &verify_log() {
+  static std::shared_ptr<spdlog::logger> verify_logger = []() {
+    auto logger = spdlog::stdout_color_mt("NHPD-Verify");
+    logger->set_pattern("[NHPD    Verify:%L]: %v");
+    return logger;
+  }();
+  return *verify_logger;
+}
+
+namespace {
+
+// make_PredictionTable's value when there is no expected_test_statistic
+constexpr double kNoExpectedTestStatistic = 0xdeadbeef;
+
+} // namespace
+
+std::string to_string(PredictionCheck::Status status) {
+  switch (status) {
+  case PredictionCheck::Status::kPassed:
+    return "passed";
+  case PredictionCheck::Status::kFailed:
+    return "failed";
+  case PredictionCheck::Status::kNoExpectation:
+    return "no_expectation";
+  case PredictionCheck::Status::kError:
+    return "error";
+  }
+  return "unknown";
+}
+
+std::vector<PredictionCheck> verify_predictions(Record const &record,
+                                                double tolerance) {
+  std::vector<PredictionCheck> checks;
+
+  for (auto const &xsm : record.measurements) {
+    for (auto const &pred : xsm.predictions) {
+      PredictionCheck check;
+      check.record_ref = record.record_ref.str();
+      check.measurement = xsm.source;
+      check.prediction = pred.source;
+      check.prediction_name =
+          pred.dependent_vars.size() ? pred.dependent_vars[0].name : "";
+      check.label = pred.label;
+      check.test_statistic = xsm.test_statistic;
+      check.pre_smeared = pred.pre_smeared;
+      check.expected = pred.expected_test_statistic;
+      check.computed = 0;
+
+      try {
+        check.computed = evaluate_test_statistic(xsm, pred);
+        if (check.expected == kNoExpectedTestStatistic) {
+          check.status = PredictionCheck::Status::kNoExpectation;
+        } else {
+          check.status = (std::abs(check.computed - check.expected) <=
+                          (tolerance * std::max(1.0, std::abs(check.expected))))
+                             ? PredictionCheck::Status::kPassed
+                             : PredictionCheck::Status::kFailed;
+        }
+      } catch (std::exception const &e) {
+        check.status = PredictionCheck::Status::kError;
+        check.error = e.what();
+      }
+
+      verify_log().debug("{} {}:{} for {}: {} = {}, expected {}",
+                         to_string(check.status), check.prediction.native(),
+                         check.prediction_name, check.measurement.native(),
+                         check.test_statistic, check.computed, check.expected);
+      checks.push_back(std::move(check));
+    }
+  }
+
+  return checks;
+}
+
+std::vector<PredictionCheck>
+verify_predictions(std::vector<ResourceReference> const &refs,
+                   std::filesystem::path const &local_cache_root,
+                   double tolerance, size_t nworkers) {
+
+  std::vector<std::vector<PredictionCheck>> record_checks(refs.size());
+
+  verify_log().debug("+ Verifying predictions of {} records on {} threads",
+                     refs.size(), parallel_for_workers(refs.size(), nworkers));
+
+  parallel_for(refs.size(), nworkers, [&](size_t i, size_t) {
+    try {
+      record_checks[i] = verify_predictions(
+          make_Record(refs[i], local_cache_root), tolerance);
+    } catch (std::exception const &e) {
+      PredictionCheck check{};
+      check.record_ref = refs[i].str();
+      check.status = PredictionCheck::Status::kError;
+      check.error = e.what();
+      record_checks[i].push_back(std::move(check));
+    } catch (...) {
+      PredictionCheck check{};
+      check.record_ref = refs[i].str();
+      check.status = PredictionCheck::Status::kError;
+      check.error = "unknown exception raised while loading record";
+      record_checks[i].push_back(std::move(check));
+    }
+  });
+
+  std::vector<PredictionCheck> checks;
+  for (auto &rc : record_checks) {
+    std::move(rc.begin(), rc.end(), std::back_inserter(checks));
+  }
+  return checks;
+}
+
+std::vector<PredictionCheck>
+verify_all_predictions(std::filesystem::path const &local_cache_root,
+                       double tolerance, size_t nworkers) {
+  return verify_predictions(list_local_records(local_cache_root),
+                            local_cache_root, tolerance, nworkers);
+}
+
+} // namespace nuis::HEPData
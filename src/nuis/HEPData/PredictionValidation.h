@@ -0,0 +1,62 @@
+#pragma once
+
+#include "nuis/HEPData/Record.h"
+#include "nuis/HEPData/ResourceReference.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace nuis::HEPData {
+
+// The result of recomputing the test statistic between a measurement and one
+// of the predictions attached to it.
+struct PredictionCheck {
+  enum class Status {
+    kPassed,
+    kFailed,
+    // the prediction has no expected_test_statistic to compare to
+    kNoExpectation,
+    // the test statistic could not be computed, or the record could not be
+    // loaded, see error
+    kError
+  };
+
+  std::string record_ref;
+  std::filesystem::path measurement;
+  std::filesystem::path prediction;
+  std::string prediction_name;
+  std::string label;
+  std::string test_statistic;
+  bool pre_smeared;
+  double expected;
+  double computed;
+  Status status;
+  std::string error;
+};
+
+std::string to_string(PredictionCheck::Status status);
+
+// Recomputes the declared test_statistic for every prediction attached to a
+// measurement of record, see evaluate_test_statistic. A check passes if
+//   |computed - expected| <= tolerance * max(1, |expected|).
+std::vector<PredictionCheck> verify_predictions(Record const &record,
+                                                double tolerance = 1E-3);
+
+// Loads and verifies each referenced record on up to nworkers threads,
+// nworkers = 0 uses one thread per hardware core. A record that fails to load
+// gives a single kError check with an empty measurement. Checks are returned
+// in the order of refs.
+std::vector<PredictionCheck>
+verify_predictions(std::vector<ResourceReference> const &refs,
+                   std::filesystem::path const &local_cache_root = ".",
+                   double tolerance = 1E-3, size_t nworkers = 0);
+
+// Verifies every record with a directory under local_cache_root, including
+// those missing from the record index, such as records fetched incrementally.
+std::vector<PredictionCheck>
+verify_all_predictions(std::filesystem::path const &local_cache_root = ".",
+                       double tolerance = 1E-3, size_t nworkers = 0);
+
+} // namespace nuis::HEPData
@@ -0,0 +1,199 @@
+#include "nuis/HEPData/Rebinning.h"
+
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+
+namespace nuis::HEPData {
+
+namespace {
+
+Extent extent(Value const &v) {
+  return v.value.index() ? Extent{std::get<double>(v.value),
+                                  std::get<double>(v.value)}
+                         : std::get<Extent>(v.value);
+}
+
+size_t nbins(Table const &tbl) {
+  if (!tbl.independent_vars.size()) {
+    throw std::runtime_error(fmt::format(
+        "Table: {} has no independent variables to define a binning.",
+        tbl.source.native()));
+  }
+  size_t n = tbl.independent_vars.front().values.size();
+  for (auto const &var : tbl.independent_vars) {
+    if (var.values.size() != n) {
+      throw std::runtime_error(fmt::format(
+          "Table: {} independent variable {} has {} values, expected {}.",
+          tbl.source.native(), var.name, var.values.size(), n));
+    }
+  }
+  return n;
+}
+
+size_t axis_index(Table const &tbl, std::string const &name) {
+  for (size_t d = 0; d < tbl.independent_vars.size(); ++d) {
+    if (tbl.independent_vars[d].name == name) {
+      return d;
+    }
+  }
+  throw std::runtime_error(
+      fmt::format("Table: {} has no independent variable named {}.",
+                  tbl.source.native(), name));
+}
+
+// the fraction of src that overlaps tgt along one axis
+double overlap(Extent const &src, Extent const &tgt) {
+  double width = src.high - src.low;
+  if (width <= 0) {
+    return ((src.low >= tgt.low) &&
+            ((src.low < tgt.high) || (src.low == tgt.low)))
+               ? 1
+               : 0;
+  }
+  return std::max(0.0, std::min(src.high, tgt.high) -
+                           std::max(src.low, tgt.low)) /
+         width;
+}
+
+} // namespace
+
+std::vector<double> Rebinner::apply(std::vector<double> const &histogram) const {
+  if (histogram.size() != nsource) {
+    throw std::runtime_error(
+        fmt::format("Rebinner expects histograms with {} bins, but was passed "
+                    "one with {}.",
+                    nsource, histogram.size()));
+  }
+  return apply_batch(histogram);
+}
+
+std::vector<double>
+Rebinner::apply_batch(std::vector<double> const &histograms) const {
+  if (!nsource || (histograms.size() % nsource)) {
+    throw std::runtime_error(
+        fmt::format("Rebinner expects histograms with {} bins, but was passed "
+                    "{} values, which is not a whole number of histograms.",
+                    nsource, histograms.size()));
+  }
+
+  size_t nbatch = histograms.size() / nsource;
+  std::vector<double> rebinned(nbatch * ntarget, 0);
+  for (size_t b = 0; b < nbatch; ++b) {
+    double const *src = histograms.data() + b * nsource;
+    double *tgt = rebinned.data() + b * ntarget;
+    for (size_t j = 0; j < ntarget; ++j) {
+      double sum = 0;
+      for (size_t k = row_offsets[j]; k < row_offsets[j + 1]; ++k) {
+        sum += fractions[k] * src[columns[k]];
+      }
+      tgt[j] = sum;
+    }
+  }
+  return rebinned;
+}
+
+std::vector<double> Rebinner::to_dense() const {
+  std::vector<double> dense(ntarget * nsource, 0);
+  for (size_t j = 0; j < ntarget; ++j) {
+    for (size_t k = row_offsets[j]; k < row_offsets[j + 1]; ++k) {
+      dense[j * nsource + columns[k]] = fractions[k];
+    }
+  }
+  return dense;
+}
+
+Rebinner make_Rebinner(Table const &from, Table const &to) {
+  Rebinner rb{nbins(from), nbins(to), {0}, {}, {}};
+
+  // the source axis compared with each target axis
+  std::vector<size_t> axes;
+  for (auto const &var : to.independent_vars) {
+    axes.push_back(axis_index(from, var.name));
+  }
+
+  // Source bins sorted by their low edge in the first compared axis. Only
+  // those with a low edge in [target low - widest source bin, target high)
+  // can overlap a target bin, which keeps construction close to linear for
+  // regular binnings.
+  auto const &src0 = from.independent_vars[axes[0]].values;
+  std::vector<size_t> order(rb.nsource);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return extent(src0[a]).low < extent(src0[b]).low;
+  });
+  std::vector<double> lows;
+  double max_width = 0;
+  for (auto i : order) {
+    auto e = extent(src0[i]);
+    lows.push_back(e.low);
+    max_width = std::max(max_width, e.high - e.low);
+  }
+
+  std::vector<std::pair<size_t, double>> row;
+  for (size_t j = 0; j < rb.ntarget; ++j) {
+    auto tgt0 = extent(to.independent_vars[0].values[j]);
+    auto first = std::lower_bound(lows.begin(), lows.end(),
+                                  tgt0.low - max_width) -
+                 lows.begin();
+
+    row.clear();
+    for (size_t s = first; (s < lows.size()) && (lows[s] <= tgt0.high); ++s) {
+      size_t i = order[s];
+      double fraction = 1;
+      for (size_t d = 0; (d < axes.size()) && (fraction > 0); ++d) {
+        fraction *= overlap(extent(from.independent_vars[axes[d]].values[i]),
+                            extent(to.independent_vars[d].values[j]));
+      }
+      if (fraction > 0) {
+        row.emplace_back(i, fraction);
+      }
+    }
+
+    std::sort(row.begin(), row.end());
+    for (auto const &[i, fraction] : row) {
+      rb.columns.push_back(i);
+      rb.fractions.push_back(fraction);
+    }
+    rb.row_offsets.push_back(rb.columns.size());
+  }
+
+  return rb;
+}
+
+Table projected_binning(Table const &binning,
+                        std::vector<std::string> const &axes) {
+  size_t n = nbins(binning);
+
+  Table projected;
+  projected.source = binning.source;
+  std::vector<size_t> indices;
+  for (auto const &name : axes) {
+    indices.push_back(axis_index(binning, name));
+    auto const &var = binning.independent_vars[indices.back()];
+    projected.independent_vars.push_back(Variable{{}, var.name, var.units});
+  }
+
+  std::map<std::vector<std::pair<double, double>>, size_t> seen;
+  for (size_t i = 0; i < n; ++i) {
+    std::vector<std::pair<double, double>> key;
+    for (auto d : indices) {
+      auto e = extent(binning.independent_vars[d].values[i]);
+      key.emplace_back(e.low, e.high);
+    }
+    if (!seen.emplace(key, seen.size()).second) {
+      continue;
+    }
+    for (size_t d = 0; d < indices.size(); ++d) {
+      projected.independent_vars[d].values.push_back(
+          Value{binning.independent_vars[indices[d]].values[i].value, {}});
+    }
+  }
+
+  return projected;
+}
+
+} // namespace nuis::HEPData
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "nuis/HEPData/Tables.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace nuis::HEPData {
+
+// A linear map from histograms in the binning of one table to histograms in
+// the binning of another, where each bin is the hyper-rectangle given by its
+// extents in each independent variable. Source bin i contributes
+//   fraction(j, i) = |source_i & target_j| / |source_i|
+// of its content to target bin j, so bin contents are treated as counts, or
+// integrals, that are shared out in proportion to the overlapping volume.
+//
+// The fractions are computed once and stored as a sparse matrix with a row
+// per target bin. Only the independent variables of the target are compared,
+// source bins are integrated over any others, which gives projections and
+// marginalisations of multi-dimensional histograms.
+struct Rebinner {
+  size_t nsource;
+  size_t ntarget;
+
+  // target bin j receives fractions[k] of source bin columns[k] for k in
+  // [row_offsets[j], row_offsets[j+1])
+  std::vector<size_t> row_offsets;
+  std::vector<size_t> columns;
+  std::vector<double> fractions;
+
+  std::vector<double> apply(std::vector<double> const &histogram) const;
+  // For histograms.size()/nsource histograms laid out one after the other,
+  // the results are laid out in the same way.
+  std::vector<double> apply_batch(std::vector<double> const &histograms) const;
+
+  // the dense, row-major, ntarget x nsource matrix of fractions
+  std::vector<double> to_dense() const;
+};
+
+// Independent variables are matched by name, every independent variable of to
+// must also be one of from. Independent variables with single values rather
+// than extents are treated as zero-width bins, which fall entirely into the
+// target bin that contains them.
+Rebinner make_Rebinner(Table const &from, Table const &to);
+
+// A table with the independent variables of binning named in axes, with a bin
+// for each distinct hyper-rectangle in those variables in order of first
+// appearance. make_Rebinner(binning, projected_binning(binning, axes))
+// projects histograms onto axes.
+Table projected_binning(Table const &binning,
+                        std::vector<std::string> const &axes);
+
+} // namespace nuis::HEPData
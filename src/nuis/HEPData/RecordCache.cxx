@@ -0,0 +1,460 @@
+#include "nuis/HEPData/RecordCache.h"
+
+#include "fmt/core.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace nuis::HEPData {
+
+spdlog::logger &cache_log() {
+  static std::shared_ptr<spdlog::logger> cache_logger = []() {
+    auto logger = spdlog::stdout_color_mt("NHPD-Cache");
+    logger->set_pattern("[NHPD     Cache:%L]: %v");
+    return logger;
+  }();
+  return *cache_logger;
+}
+
+namespace {
+
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+// XXH64 is defined on little-endian reads
+template <typename T> uint64_t read_le(char const *p) {
+  uint64_t v = 0;
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    v |= uint64_t(uint8_t(p[i])) << (8 * i);
+  }
+  return v;
+}
+
+uint64_t xxh_round(uint64_t acc, uint64_t input) {
+  acc += input * kPrime2;
+  acc = rotl(acc, 31);
+  return acc * kPrime1;
+}
+
+uint64_t xxh_merge_round(uint64_t acc, uint64_t val) {
+  acc ^= xxh_round(0, val);
+  return acc * kPrime1 + kPrime4;
+}
+
+std::atomic<bool> &deduplicate_records_enabled() {
+  static std::atomic<bool> enabled = []() {
+    auto env = std::getenv("NUISANCEHEPData_DEDUPLICATE_RECORDS");
+    return env && (std::string(env) != "0") && (std::string(env) != "");
+  }();
+  return enabled;
+}
+
+std::filesystem::path objects_root(std::filesystem::path const &local_cache_root) {
+  return local_cache_root / ".objects";
+}
+
+std::string read_file(std::filesystem::path const &p) {
+  std::ifstream fin(p, std::ios::binary);
+  if (!fin) {
+    throw std::runtime_error(fmt::format("Failed to read: {}", p.native()));
+  }
+  return std::string{std::istreambuf_iterator<char>(fin),
+                     std::istreambuf_iterator<char>()};
+}
+
+// Files are identified by inode so that hard links into several records, or
+// into the object store, are only counted once
+using FileID = std::pair<dev_t, ino_t>;
+
+struct StoredFile {
+  uintmax_t size;
+  // links from records and snapshots that have not been evicted
+  size_t links;
+  std::filesystem::path object;
+};
+
+struct CacheEntry {
+  std::filesystem::path path;
+  std::filesystem::file_time_type last_access;
+  std::vector<FileID> files;
+  bool is_record;
+};
+
+char const *kLastAccessMarker = ".last-access";
+
+// Adds each regular file under p to files and returns their ids.
+std::vector<FileID> scan_files(std::filesystem::path const &p,
+                               std::map<FileID, StoredFile> &files) {
+  std::vector<FileID> ids;
+  auto add = [&](std::filesystem::path const &f) {
+    struct stat st;
+    if ((::lstat(f.c_str(), &st) != 0) || !S_ISREG(st.st_mode)) {
+      return;
+    }
+    FileID id{st.st_dev, st.st_ino};
+    auto &file = files[id];
+    file.size = st.st_size;
+    ids.push_back(id);
+  };
+
+  std::error_code ec;
+  if (!std::filesystem::is_directory(p, ec)) {
+    add(p);
+    return ids;
+  }
+  for (auto it = std::filesystem::recursive_directory_iterator{p, ec};
+       it != std::filesystem::recursive_directory_iterator{};
+       it.increment(ec)) {
+    if (ec) {
+      break;
+    }
+    add(it->path());
+  }
+  return ids;
+}
+
+std::filesystem::file_time_type
+record_last_access(std::filesystem::path const &record_location) {
+  std::error_code ec;
+  auto t = std::filesystem::last_write_time(
+      record_location / kLastAccessMarker, ec);
+  if (ec) {
+    // never accessed since it was fetched, or fetched by an older version
+    t = std::filesystem::last_write_time(record_location, ec);
+  }
+  return t;
+}
+
+// Moves p out of the database in one step before deleting it, so that nobody
+// can observe it half deleted.
+void evict(std::filesystem::path const &p,
+           std::filesystem::path const &local_cache_root) {
+  static std::atomic<size_t> counter{0};
+  auto trash = local_cache_root / ".trash";
+  std::error_code ec;
+  std::filesystem::create_directories(trash, ec);
+  auto tomb = trash / fmt::format("{}.{}.{}", p.filename().native(),
+                                  ::getpid(), counter++);
+  std::filesystem::rename(p, tomb, ec);
+  if (ec) {
+    cache_log().warn("Failed to evict {}: {}", p.native(), ec.message());
+    return;
+  }
+  std::filesystem::remove_all(tomb, ec);
+}
+
+} // namespace
+
+uint64_t content_hash(std::string_view data) {
+  char const *p = data.data();
+  char const *end = p + data.size();
+  uint64_t h;
+
+  if (data.size() >= 32) {
+    uint64_t v1 = kPrime1 + kPrime2, v2 = kPrime2, v3 = 0, v4 = -kPrime1;
+    for (; (p + 32) <= end; p += 32) {
+      v1 = xxh_round(v1, read_le<uint64_t>(p));
+      v2 = xxh_round(v2, read_le<uint64_t>(p + 8));
+      v3 = xxh_round(v3, read_le<uint64_t>(p + 16));
+      v4 = xxh_round(v4, read_le<uint64_t>(p + 24));
+    }
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = xxh_merge_round(h, v1);
+    h = xxh_merge_round(h, v2);
+    h = xxh_merge_round(h, v3);
+    h = xxh_merge_round(h, v4);
+  } else {
+    h = kPrime5;
+  }
+
+  h += data.size();
+
+  for (; (p + 8) <= end; p += 8) {
+    h ^= xxh_round(0, read_le<uint64_t>(p));
+    h = rotl(h, 27) * kPrime1 + kPrime4;
+  }
+  if ((p + 4) <= end) {
+    h ^= read_le<uint32_t>(p) * kPrime1;
+    h = rotl(h, 23) * kPrime2 + kPrime3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    h ^= uint8_t(*p) * kPrime5;
+    h = rotl(h, 11) * kPrime1;
+  }
+
+  h ^= h >> 33;
+  h *= kPrime2;
+  h ^= h >> 29;
+  h *= kPrime3;
+  h ^= h >> 32;
+  return h;
+}
+
+bool get_deduplicate_records() { return deduplicate_records_enabled(); }
+void set_deduplicate_records(bool enabled) {
+  deduplicate_records_enabled() = enabled;
+}
+
+uintmax_t deduplicate_file(std::filesystem::path const &file,
+                           std::filesystem::path const &local_cache_root) {
+  std::error_code ec;
+  // already shared with the store
+  if (std::filesystem::hard_link_count(file, ec) > 1) {
+    return 0;
+  }
+
+  auto contents = read_file(file);
+  auto hash = content_hash(contents);
+  auto object = objects_root(local_cache_root) /
+                fmt::format("{:02x}", hash >> 56) / fmt::format("{:016x}", hash);
+
+  if (!std::filesystem::exists(object)) {
+    std::filesystem::create_directories(object.parent_path());
+    std::filesystem::create_hard_link(file, object, ec);
+    if (ec && !std::filesystem::exists(object)) {
+      // e.g. the store is on a different file system, nothing to share
+      cache_log().debug("   * failed to add {} to the object store: {}",
+                        file.native(), ec.message());
+    }
+    return 0;
+  }
+
+  if (std::filesystem::equivalent(file, object, ec)) {
+    return 0;
+  }
+
+  // never link different contents that happen to share a hash
+  if (read_file(object) != contents) {
+    cache_log().warn("Content hash collision between {} and {}, not "
+                     "deduplicating",
+                     file.native(), object.native());
+    return 0;
+  }
+
+  // swap the link in atomically so concurrent readers always see the file
+  auto tmp = file;
+  tmp += fmt::format(".dedup{}", ::getpid());
+  std::filesystem::create_hard_link(object, tmp, ec);
+  if (ec) {
+    cache_log().debug("   * failed to link {} to {}: {}", file.native(),
+                      object.native(), ec.message());
+    return 0;
+  }
+  std::filesystem::rename(tmp, file);
+
+  cache_log().debug("   * {} -> {}", file.native(), object.native());
+  return contents.size();
+}
+
+uintmax_t deduplicate_record(std::filesystem::path const &record_location,
+                             std::filesystem::path const &local_cache_root) {
+  uintmax_t saved = 0;
+  for (auto const &entry :
+       std::filesystem::recursive_directory_iterator{record_location}) {
+    // dot files hold per-record state that is never shared
+    if (!entry.is_regular_file() ||
+        (entry.path().filename().native().front() == '.')) {
+      continue;
+    }
+    saved += deduplicate_file(entry.path(), local_cache_root);
+  }
+  return saved;
+}
+
+uintmax_t deduplicate_records(std::filesystem::path const &local_cache_root) {
+  uintmax_t saved = 0;
+  for (auto const &reftype_dir : {"hepdata", "hepdata-sandbox", "INSPIREHEP"}) {
+    auto dir = local_cache_root / reftype_dir;
+    if (std::filesystem::is_directory(dir)) {
+      saved += deduplicate_record(dir, local_cache_root);
+    }
+  }
+  cache_log().debug("Deduplicated records in {}, saved {} bytes",
+                    local_cache_root.native(), saved);
+  return saved;
+}
+
+void record_access(std::filesystem::path const &record_location) {
+  static std::mutex mtx;
+  static std::map<std::filesystem::path, std::chrono::steady_clock::time_point>
+      last_marked;
+
+  auto now = std::chrono::steady_clock::now();
+  {
+    std::lock_guard lock(mtx);
+    auto marked = last_marked.find(record_location);
+    if ((marked != last_marked.end()) &&
+        ((now - marked->second) < std::chrono::minutes(10))) {
+      return;
+    }
+    last_marked[record_location] = now;
+  }
+
+  std::error_code ec;
+  auto marker = record_location / kLastAccessMarker;
+  std::filesystem::last_write_time(
+      marker, std::filesystem::file_time_type::clock::now(), ec);
+  if (ec && std::filesystem::is_directory(record_location, ec)) {
+    std::ofstream{marker};
+  }
+}
+
+CacheGCResult cache_gc(std::filesystem::path const &local_cache_root,
+                       uintmax_t max_size, std::chrono::seconds min_age) {
+
+  std::map<FileID, StoredFile> files;
+  std::vector<CacheEntry> entries;
+
+  std::error_code ec;
+  for (auto const &reftype_dir : {"hepdata", "hepdata-sandbox", "INSPIREHEP"}) {
+    auto dir = local_cache_root / reftype_dir;
+    if (!std::filesystem::is_directory(dir, ec)) {
+      continue;
+    }
+    for (auto const &id_dir : std::filesystem::directory_iterator{dir}) {
+      if (!id_dir.is_directory()) {
+        continue;
+      }
+      // INSPIREHEP/<id> is the record, HEPData records are versioned below
+      // <id>, next to the version check caches
+      if (std::string(reftype_dir) == "INSPIREHEP") {
+        entries.push_back(CacheEntry{id_dir.path(),
+                                     record_last_access(id_dir.path()),
+                                     scan_files(id_dir.path(), files), true});
+        continue;
+      }
+      for (auto const &vers_dir :
+           std::filesystem::directory_iterator{id_dir.path()}) {
+        if (vers_dir.is_directory()) {
+          entries.push_back(
+              CacheEntry{vers_dir.path(), record_last_access(vers_dir.path()),
+                         scan_files(vers_dir.path(), files), true});
+        }
+      }
+    }
+  }
+
+  // snapshots are looked up by content, so each one is its own entry, touched
+  // whenever it is used
+  auto snapshots = objects_root(local_cache_root) / "tables";
+  if (std::filesystem::is_directory(snapshots, ec)) {
+    for (auto const &snapshot :
+         std::filesystem::recursive_directory_iterator{snapshots}) {
+      if (snapshot.is_regular_file()) {
+        entries.push_back(
+            CacheEntry{snapshot.path(), snapshot.last_write_time(),
+                       scan_files(snapshot.path(), files), false});
+      }
+    }
+  }
+
+  for (auto const &entry : entries) {
+    for (auto const &id : entry.files) {
+      files[id].links++;
+    }
+  }
+
+  // objects that are no longer linked into any record are freed below along
+  // with the last record that used them
+  std::vector<std::filesystem::path> orphans;
+  auto objects = objects_root(local_cache_root);
+  if (std::filesystem::is_directory(objects, ec)) {
+    for (auto const &shard : std::filesystem::directory_iterator{objects}) {
+      if (!shard.is_directory() || (shard.path() == snapshots)) {
+        continue;
+      }
+      for (auto const &object : std::filesystem::directory_iterator{shard}) {
+        auto ids = scan_files(object.path(), files);
+        for (auto const &id : ids) {
+          if (files[id].links) {
+            files[id].object = object.path();
+          } else {
+            orphans.push_back(object.path());
+          }
+        }
+      }
+    }
+  }
+
+  // anything else under the root, e.g. in .trash, is counted but can't be
+  // evicted
+  scan_files(local_cache_root, files);
+
+  CacheGCResult result{0, 0, 0, 0};
+  for (auto const &[id, file] : files) {
+    result.size_before += file.size;
+  }
+  result.size_after = result.size_before;
+
+  for (auto const &orphan : orphans) {
+    auto size = std::filesystem::file_size(orphan, ec);
+    if (std::filesystem::remove(orphan, ec) && !ec) {
+      result.size_after -= size;
+    }
+  }
+
+  std::sort(entries.begin(), entries.end(),
+            [](CacheEntry const &a, CacheEntry const &b) {
+              return a.last_access < b.last_access;
+            });
+
+  auto cutoff = std::filesystem::file_time_type::clock::now() - min_age;
+  for (auto const &entry : entries) {
+    if ((result.size_after <= max_size) || (entry.last_access > cutoff)) {
+      break;
+    }
+
+    cache_log().debug("   * evicting {}", entry.path.native());
+    evict(entry.path, local_cache_root);
+    if (std::filesystem::exists(entry.path, ec)) {
+      continue;
+    }
+    (entry.is_record ? result.records_evicted : result.snapshots_evicted)++;
+
+    for (auto const &id : entry.files) {
+      auto &file = files[id];
+      if (--file.links) {
+        continue;
+      }
+      if (!file.object.empty()) {
+        std::filesystem::remove(file.object, ec);
+      }
+      result.size_after -= file.size;
+    }
+  }
+
+  cache_log().debug("Collected garbage in {}, {} -> {} bytes, evicted {} "
+                    "records and {} table snapshots",
+                    local_cache_root.native(), result.size_before,
+                    result.size_after, result.records_evicted,
+                    result.snapshots_evicted);
+  return result;
+}
+
+std::filesystem::path
+table_snapshot_path(std::filesystem::path const &local_cache_root,
+                    uint64_t content, std::string_view selection) {
+  auto key = content_hash(fmt::format("{:016x}:{}", content, selection));
+  return objects_root(local_cache_root) / "tables" /
+         fmt::format("{:02x}", key >> 56) / fmt::format("{:016x}.bin", key);
+}
+
+} // namespace nuis::HEPData
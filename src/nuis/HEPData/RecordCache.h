@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+namespace nuis::HEPData {
+
+// The 64 bit XXH64 hash of data, used to identify file contents in the local
+// record database.
+uint64_t content_hash(std::string_view data);
+
+// When enabled, files of records fetched into the local database are stored
+// once per distinct content under <local_cache_root>/.objects and hard linked
+// into each record directory that contains them, so tables that are identical
+// between versions of a record take no extra space. Tables parsed from records
+// in the database are also kept as binary snapshots keyed by their content,
+// so identical tables are only parsed once. Off by default, can be enabled by
+// setting the NUISANCEHEPData_DEDUPLICATE_RECORDS environment variable to 1.
+bool get_deduplicate_records();
+void set_deduplicate_records(bool enabled);
+
+// Replaces file with a hard link to the stored object with the same content,
+// or adds it to the store if it is new. Returns the number of bytes saved.
+uintmax_t deduplicate_file(std::filesystem::path const &file,
+                           std::filesystem::path const &local_cache_root);
+
+// Deduplicates every file in a record directory, or in every record in the
+// database, e.g. for a database filled before deduplication was enabled.
+// Returns the number of bytes saved.
+uintmax_t deduplicate_record(std::filesystem::path const &record_location,
+                             std::filesystem::path const &local_cache_root);
+uintmax_t deduplicate_records(std::filesystem::path const &local_cache_root);
+
+// Marks the record at record_location as used now, for cache_gc. Cheap
+// enough to call on every access: the mark on disk is refreshed at most every
+// few minutes by each process.
+void record_access(std::filesystem::path const &record_location);
+
+struct CacheGCResult {
+  uintmax_t size_before;
+  uintmax_t size_after;
+  size_t records_evicted;
+  size_t snapshots_evicted;
+};
+
+// Evicts the least recently used records, and table snapshots, from the
+// database until it takes up no more than max_size bytes, counting files that
+// are hard linked into several records once. Records used within min_age are
+// never evicted, so that processes still reading them are not disturbed, even
+// if the database then stays over max_size. A record is moved out of place
+// atomically before it is deleted, so readers see either all of it or none, in
+// which case it is fetched again.
+//
+// Records are only ever evicted whole. Files in a record directory that no
+// table refers to, such as large additional resources, stay until their
+// record is evicted, as a record missing some of its files is not fetched
+// again and would stay broken.
+CacheGCResult cache_gc(std::filesystem::path const &local_cache_root,
+                       uintmax_t max_size,
+                       std::chrono::seconds min_age = std::chrono::hours(1));
+
+// Where the parsed snapshot of a table with the given content hash, decoded
+// with the given selection, is kept.
+std::filesystem::path
+table_snapshot_path(std::filesystem::path const &local_cache_root,
+                    uint64_t content, std::string_view selection);
+
+} // namespace nuis::HEPData
@@ -0,0 +1,341 @@
+#include "nuis/HEPData/RecordIndex.h"
+
+#include "nuis/HEPData/BinarySerialization.h"
+#include "nuis/HEPData/ReferenceResolver.h"
+#include "nuis/HEPData/YAMLConverters.h"
+
+#include "yaml-cpp/yaml.h"
+
+#include "fmt/core.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+namespace nuis::HEPData {
+
+spdlog::logger &index_log() {
+  static std::shared_ptr<spdlog::logger> index_logger = []() {
+    auto logger = spdlog::stdout_color_mt("NHPD-Index");
+    logger->set_pattern("[NHPD     Index:%L]: %v");
+    return logger;
+  }();
+  return *index_logger;
+}
+
+namespace {
+
+// the names in a comma-separated list of specs with optional [weight]s
+std::vector<std::string> spec_names(std::string const &specs) {
+  std::vector<std::string> names;
+  size_t pos = 0;
+  while (pos <= specs.size()) {
+    auto comma = std::min(specs.find(',', pos), specs.size());
+    auto name = specs.substr(pos, comma - pos);
+    name = name.substr(0, name.find('['));
+    if (name.size()) {
+      names.push_back(name);
+    }
+    pos = comma + 1;
+  }
+  return names;
+}
+
+std::vector<std::string>
+indexed_qualifier_values(std::string const &key,
+                         std::map<std::string, std::string> const &quals) {
+  std::vector<std::string> values;
+  for (size_t i = 0;; ++i) {
+    auto key_idx = fmt::format("{}[{}]", key, i);
+    if (quals.count(key_idx)) {
+      values.push_back(quals.at(key_idx));
+    } else if ((i == 0) && quals.count(key)) {
+      values.push_back(quals.at(key));
+    } else {
+      return values;
+    }
+  }
+}
+
+template <typename T>
+void add_unique(std::vector<T> &vec, T const &el) {
+  if (std::find(vec.begin(), vec.end(), el) == vec.end()) {
+    vec.push_back(el);
+  }
+}
+
+// Serializes read-modify-write cycles on the index between processes. Readers
+// don't need it, the index is always replaced atomically.
+class IndexLock {
+  int fd;
+
+public:
+  explicit IndexLock(std::filesystem::path const &local_cache_root) {
+    auto lock_path = record_index_path(local_cache_root);
+    lock_path += ".lock";
+    fd = ::open(lock_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if ((fd < 0) || (::flock(fd, LOCK_EX) != 0)) {
+      throw std::runtime_error(fmt::format("Failed to lock the record index: {}",
+                                           lock_path.native()));
+    }
+  }
+  ~IndexLock() { ::close(fd); }
+
+  IndexLock(IndexLock const &) = delete;
+  IndexLock &operator=(IndexLock const &) = delete;
+};
+
+void write_record_index(std::filesystem::path const &local_cache_root,
+                        RecordIndex const &index) {
+  auto path = record_index_path(local_cache_root);
+  auto tmp = path;
+  tmp += fmt::format(".{}", ::getpid());
+  {
+    std::ofstream(tmp, std::ios::binary) << to_binary(index);
+  }
+  std::filesystem::rename(tmp, path);
+}
+
+bool matches(IndexEntry const &entry, std::string const &key,
+             std::string const &value) {
+  auto contains = [&](std::vector<std::string> const &vec) {
+    return std::find(vec.begin(), vec.end(), value) != vec.end();
+  };
+
+  if (key == "record") {
+    return (entry.record_ref == value) ||
+           ((entry.record_ref.size() > value.size()) &&
+            (entry.record_ref.compare(0, value.size(), value) == 0) &&
+            (entry.record_ref[value.size()] == 'v'));
+  } else if (key == "table") {
+    return entry.table == value;
+  } else if (key == "resource") {
+    return entry.resource == value;
+  } else if (key == "name") {
+    return entry.dependent_var == value;
+  } else if (key == "variable_type") {
+    return entry.variable_type == value;
+  } else if (key == "target") {
+    return contains(entry.targets);
+  } else if (key == "probe_particle") {
+    return contains(entry.probe_particles);
+  } else if (key == "measurement_type") {
+    return entry.measurement_type == value;
+  } else if (key == "test_statistic") {
+    return entry.test_statistic == value;
+  }
+  auto qual = entry.qualifiers.find(key);
+  return (qual != entry.qualifiers.end()) && (qual->second == value);
+}
+
+} // namespace
+
+std::string IndexEntry::ref() const {
+  return fmt::format("{}/{}:{}", record_ref, resource, dependent_var);
+}
+
+std::filesystem::path
+record_index_path(std::filesystem::path const &local_cache_root) {
+  return local_cache_root / ".index";
+}
+
+RecordIndex read_record_index(std::filesystem::path const &local_cache_root) {
+  auto path = record_index_path(local_cache_root);
+  std::ifstream fin(path, std::ios::binary);
+  if (!fin) {
+    return RecordIndex{};
+  }
+  try {
+    return from_binary<RecordIndex>(std::string{
+        std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>()});
+  } catch (std::exception const &e) {
+    index_log().warn("Ignoring unreadable record index {}: {}", path.native(),
+                     e.what());
+    return RecordIndex{};
+  }
+}
+
+std::vector<IndexEntry>
+index_record(ResourceReference const &ref,
+             std::filesystem::path const &local_cache_root) {
+
+  auto record_ref = resolve_version(ref, local_cache_root).record_ref();
+  auto submission = resolve_reference(record_ref, local_cache_root);
+  auto record_root = submission.parent_path();
+
+  index_log().debug("+ Indexing record: {}", record_ref.str());
+
+  std::vector<IndexEntry> entries;
+  std::map<std::filesystem::path, Table> tables;
+
+  auto load_metadata = [&](std::filesystem::path const &location)
+      -> Table const & {
+    auto tbl = tables.find(location);
+    if (tbl == tables.end()) {
+      tbl = tables.emplace(location, load_Table_metadata(location)).first;
+    }
+    return tbl->second;
+  };
+
+  for (auto const &doc : YAML::LoadAll(read_resource(submission))) {
+    if (!doc["data_file"]) {
+      continue;
+    }
+    auto data_file = doc["data_file"].as<std::string>();
+    if (data_file.find("://") != std::string::npos) {
+      continue;
+    }
+    auto location = record_root / data_file;
+
+    for (auto const &dv : load_metadata(location).dependent_vars) {
+      IndexEntry entry;
+      entry.record_ref = record_ref.str();
+      entry.table = doc["name"] ? doc["name"].as<std::string>() : data_file;
+      entry.resource = data_file;
+      entry.dependent_var = dv.name;
+      entry.location = location;
+      entry.qualifiers = dv.qualifiers;
+      if (dv.qualifiers.count("variable_type")) {
+        entry.variable_type = dv.qualifiers.at("variable_type");
+      }
+      entries.push_back(std::move(entry));
+    }
+  }
+
+  // measurements get the same defaults as make_CrossSectionMeasurement gives
+  // them, and the probe particles of their fluxes
+  for (auto &entry : entries) {
+    if ((entry.variable_type != "cross_section_measurement") &&
+        (entry.variable_type != "composite_cross_section_measurement")) {
+      continue;
+    }
+    auto const &quals = entry.qualifiers;
+
+    for (auto const &tgts : indexed_qualifier_values("target", quals)) {
+      for (auto const &tgt : spec_names(tgts)) {
+        add_unique(entry.targets, tgt);
+      }
+    }
+
+    entry.measurement_type = quals.count("measurement_type")
+                                 ? quals.at("measurement_type")
+                                 : "flux_averaged_differential_cross_section";
+    entry.test_statistic =
+        quals.count("test_statistic") ? quals.at("test_statistic") : "chi2";
+
+    for (auto const &fluxes : indexed_qualifier_values("probe_flux", quals)) {
+      for (auto const &flux : spec_names(fluxes)) {
+        try {
+          ResourceReference flux_ref(flux, ResourceReference(entry.ref()));
+          auto const &tbl =
+              load_metadata(resolve_reference(flux_ref, local_cache_root));
+          for (auto const &dv : tbl.dependent_vars) {
+            if ((flux_ref.qualifier.size() && (dv.name != flux_ref.qualifier)) ||
+                !dv.qualifiers.count("probe_particle")) {
+              continue;
+            }
+            add_unique(entry.probe_particles,
+                       dv.qualifiers.at("probe_particle"));
+            break;
+          }
+        } catch (std::exception const &e) {
+          index_log().debug("  + failed to read probe flux {} of {}: {}", flux,
+                            entry.ref(), e.what());
+        }
+      }
+    }
+  }
+
+  index_log().debug("  +-> indexed {} dependent variables", entries.size());
+  return entries;
+}
+
+void update_record_index(ResourceReference const &ref,
+                         std::filesystem::path const &local_cache_root) {
+  auto record_ref = resolve_version(ref, local_cache_root).record_ref();
+  auto entries = index_record(record_ref, local_cache_root);
+
+  IndexLock lock(local_cache_root);
+  auto index = read_record_index(local_cache_root);
+  index.records[record_ref.str()] = std::move(entries);
+  write_record_index(local_cache_root, index);
+}
+
+std::vector<ResourceReference>
+list_local_records(std::filesystem::path const &local_cache_root) {
+  std::vector<ResourceReference> refs;
+
+  for (auto const &[reftype, reftype_dir] :
+       std::vector<std::pair<std::string, std::string>>{
+           {"hepdata", "hepdata"},
+           {"hepdata-sandbox", "hepdata-sandbox"},
+           {"inspirehep", "INSPIREHEP"}}) {
+    auto dir = local_cache_root / reftype_dir;
+    if (!std::filesystem::is_directory(dir)) {
+      continue;
+    }
+    for (auto const &id_dir : std::filesystem::directory_iterator{dir}) {
+      if (!id_dir.is_directory()) {
+        continue;
+      }
+      auto id = id_dir.path().filename().native();
+      if (reftype == "inspirehep") {
+        refs.emplace_back(fmt::format("{}:{}", reftype, id));
+        continue;
+      }
+      // HEPData-<id>-v<vers>
+      auto prefix = fmt::format("HEPData-{}-v", id);
+      for (auto const &vers_dir :
+           std::filesystem::directory_iterator{id_dir.path()}) {
+        auto name = vers_dir.path().filename().native();
+        if (vers_dir.is_directory() && (name.rfind(prefix, 0) == 0)) {
+          refs.emplace_back(fmt::format("{}:{}v{}", reftype, id,
+                                        name.substr(prefix.size())));
+        }
+      }
+    }
+  }
+  return refs;
+}
+
+RecordIndex rebuild_record_index(std::filesystem::path const &local_cache_root) {
+  RecordIndex index;
+  for (auto const &ref : list_local_records(local_cache_root)) {
+    try {
+      index.records[ref.str()] = index_record(ref, local_cache_root);
+    } catch (std::exception const &e) {
+      index_log().warn("Failed to index {}: {}", ref.str(), e.what());
+    }
+  }
+
+  IndexLock lock(local_cache_root);
+  write_record_index(local_cache_root, index);
+  index_log().debug("Indexed {} records in {}", index.records.size(),
+                    local_cache_root.native());
+  return index;
+}
+
+std::vector<IndexEntry> query_record_index(
+    RecordIndex const &index,
+    std::vector<std::pair<std::string, std::string>> const &conditions) {
+  std::vector<IndexEntry> results;
+  for (auto const &[record_ref, entries] : index.records) {
+    for (auto const &entry : entries) {
+      if (std::all_of(conditions.begin(), conditions.end(),
+                      [&](auto const &cond) {
+                        return matches(entry, cond.first, cond.second);
+                      })) {
+        results.push_back(entry);
+      }
+    }
+  }
+  return results;
+}
+
+} // namespace nuis::HEPData
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "nuis/HEPData/ResourceReference.h"
+
+#include <filesystem>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace nuis::HEPData {
+
+// A dependent variable of a table in a record in the local database, with
+// enough of its metadata to find it without reading any tables.
+struct IndexEntry {
+  // e.g. hepdata:12345v2
+  std::string record_ref;
+  // the table name and data_file given in submission.yaml
+  std::string table;
+  std::string resource;
+  std::string dependent_var;
+  std::filesystem::path location;
+
+  std::string variable_type;
+  std::map<std::string, std::string> qualifiers;
+
+  // only filled for cross section measurements. targets are the target names
+  // as written in the target qualifiers, without weights. probe_particles are
+  // read from the probe flux tables that the measurement refers to.
+  std::vector<std::string> targets;
+  std::vector<std::string> probe_particles;
+  std::string measurement_type;
+  std::string test_statistic;
+
+  // A reference to this dependent variable, e.g. to pass to make_Record or
+  // make_CrossSectionMeasurement.
+  std::string ref() const;
+};
+
+// Entries keyed by record_ref.
+struct RecordIndex {
+  std::map<std::string, std::vector<IndexEntry>> records;
+};
+
+// The index is kept in a single file at <local_cache_root>/.index. Records
+// are added to it as they are fetched, except for those fetched
+// incrementally, as indexing them would fetch every table. Records that are
+// later evicted by cache_gc stay in the index, their references remain valid
+// and fetch the record again when resolved.
+std::filesystem::path
+record_index_path(std::filesystem::path const &local_cache_root);
+
+// Returns an empty index if there is none yet, or it can't be read.
+RecordIndex read_record_index(std::filesystem::path const &local_cache_root);
+
+// Reads the metadata of every table in the record referred to by ref, only
+// the table headers are parsed.
+std::vector<IndexEntry>
+index_record(ResourceReference const &ref,
+             std::filesystem::path const &local_cache_root);
+
+// Replaces the entries for the record referred to by ref in the index.
+// Concurrent updates, including from other processes, are serialized.
+void update_record_index(ResourceReference const &ref,
+                         std::filesystem::path const &local_cache_root);
+
+// References to every record with a directory in the database, whether or
+// not it is in the index.
+std::vector<ResourceReference>
+list_local_records(std::filesystem::path const &local_cache_root);
+
+// Indexes every record in the database from scratch.
+RecordIndex rebuild_record_index(std::filesystem::path const &local_cache_root);
+
+// Returns the entries that satisfy every condition. Each condition is a key
+// and value, where the key is one of record, table, resource, name,
+// variable_type, target, probe_particle, measurement_type, or
+// test_statistic, or else is compared to the qualifier with that key. A
+// record condition matches the record_ref with or without its version.
+std::vector<IndexEntry> query_record_index(
+    RecordIndex const &index,
+    std::vector<std::pair<std::string, std::string>> const &conditions);
+
+} // namespace nuis::HEPData
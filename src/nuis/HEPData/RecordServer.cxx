@@ -0,0 +1,572 @@
+#include "nuis/HEPData/RecordServer.h"
+#include "nuis/HEPData/BinarySerialization.h"
+#include "nuis/HEPData/TableFactory.h"
+
+#include "fmt/core.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace nuis::HEPData {
+
+spdlog::logger &serve_log() {
+  static std::shared_ptr<spdlog::logger> serve_logger = []() {
+    auto logger = spdlog::stdout_color_mt("NHPD-Serve");
+    logger->set_pattern("[NHPD     Serve:%L]: %v");
+    return logger;
+  }();
+  return *serve_logger;
+}
+
+namespace {
+
+// Every message in either direction is a one byte tag followed by a 64 bit
+// payload length and the payload. Requests are tagged with a RequestType and
+// their payload is a one byte ServerTransport followed by the reference
+// string, responses are tagged with a ResponseStatus and carry either the
+// encoded object, the location of the shared memory holding it, or an error
+// message.
+enum class RequestType : uint8_t {
+  kRecord = 1,
+  kCrossSectionMeasurement,
+  kStop
+};
+
+enum class ResponseStatus : uint8_t { kOK = 0, kError };
+
+struct FileDescriptor {
+  int fd;
+  explicit FileDescriptor(int fd_) : fd{fd_} {}
+  FileDescriptor(FileDescriptor const &) = delete;
+  FileDescriptor &operator=(FileDescriptor const &) = delete;
+  ~FileDescriptor() {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+};
+
+std::runtime_error errno_error(std::string const &what) {
+  return std::runtime_error(fmt::format("{}: {}", what, std::strerror(errno)));
+}
+
+void write_all(int fd, void const *data, size_t n) {
+  auto p = static_cast<char const *>(data);
+  while (n) {
+    auto nw = ::send(fd, p, n, MSG_NOSIGNAL);
+    if (nw < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw errno_error("failed to write to record server socket");
+    }
+    p += nw;
+    n -= size_t(nw);
+  }
+}
+
+// returns false if the connection was closed before any bytes were read
+bool read_all(int fd, void *data, size_t n) {
+  auto p = static_cast<char *>(data);
+  size_t nread = 0;
+  while (nread < n) {
+    auto nr = ::recv(fd, p + nread, n - nread, 0);
+    if (nr < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw errno_error("failed to read from record server socket");
+    }
+    if (nr == 0) {
+      if (nread == 0) {
+        return false;
+      }
+      throw std::runtime_error(
+          "record server connection closed part way through a message");
+    }
+    nread += size_t(nr);
+  }
+  return true;
+}
+
+void send_message(int fd, uint8_t tag, std::string_view payload) {
+  uint64_t len = payload.size();
+  write_all(fd, &tag, sizeof(tag));
+  write_all(fd, &len, sizeof(len));
+  write_all(fd, payload.data(), payload.size());
+}
+
+// Requests only carry a transport byte and a reference string, anything longer
+// is not a request and is refused before allocating for it.
+constexpr uint64_t kMaxRequestLength = 64 * 1024;
+
+// throws if the payload is longer than max_len
+bool recv_message(int fd, uint8_t &tag, std::string &payload,
+                  uint64_t max_len = UINT64_MAX) {
+  if (!read_all(fd, &tag, sizeof(tag))) {
+    return false;
+  }
+  uint64_t len;
+  if (!read_all(fd, &len, sizeof(len))) {
+    throw std::runtime_error(
+        "record server connection closed part way through a message");
+  }
+  if (len > max_len) {
+    throw std::runtime_error(
+        fmt::format("record server message of {} bytes exceeds the limit of "
+                    "{} bytes",
+                    len, max_len));
+  }
+  payload.resize(len);
+  if (len && !read_all(fd, payload.data(), len)) {
+    throw std::runtime_error(
+        "record server connection closed part way through a message");
+  }
+  return true;
+}
+
+sockaddr_un make_address(std::filesystem::path const &socket_path) {
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socket_path.native().size() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error(
+        fmt::format("record server socket path: {} is too long, it must be "
+                    "shorter than {} characters.",
+                    socket_path.native(), sizeof(addr.sun_path)));
+  }
+  std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+  return addr;
+}
+
+// returns -1 if nothing is listening at socket_path
+int connect_to(std::filesystem::path const &socket_path) {
+  auto addr = make_address(socket_path);
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    throw errno_error("failed to create socket");
+  }
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// references are sent as ResourceReference::str(), path-type references do not
+// round trip through the ResourceReference constructor so are rebuilt here
+ResourceReference parse_wire_refstr(std::string const &refstr) {
+  if (refstr.rfind("path:", 0) == 0) {
+    return PathResourceReference(refstr.substr(5));
+  }
+  return ResourceReference(refstr);
+}
+
+std::filesystem::path shared_memory_dir() {
+  std::filesystem::path shm = "/dev/shm";
+  std::error_code ec;
+  if (std::filesystem::is_directory(shm, ec)) {
+    return shm;
+  }
+  return std::filesystem::temp_directory_path();
+}
+
+struct ServedObject {
+  std::string encoding;
+
+  std::once_flag shm_written;
+  std::filesystem::path shm_path;
+};
+
+struct ServerState {
+  std::filesystem::path local_cache_root;
+  std::atomic<bool> stopping{false};
+
+  std::mutex objects_mutex;
+  std::map<std::pair<RequestType, std::string>,
+           std::shared_future<std::shared_ptr<ServedObject>>>
+      objects;
+
+  std::mutex shm_mutex;
+  std::vector<std::filesystem::path> shm_paths;
+
+  explicit ServerState(std::filesystem::path const &root)
+      : local_cache_root{root} {}
+
+  ~ServerState() {
+    for (auto const &p : shm_paths) {
+      std::error_code ec;
+      std::filesystem::remove(p, ec);
+    }
+  }
+
+  std::shared_ptr<ServedObject> load(RequestType type,
+                                     std::string const &refstr) {
+    auto ref = parse_wire_refstr(refstr);
+    auto obj = std::make_shared<ServedObject>();
+    if (type == RequestType::kRecord) {
+      serve_log().info("Loading record: {}", refstr);
+      obj->encoding = to_binary(make_Record(ref, local_cache_root));
+    } else {
+      serve_log().info("Loading measurement: {}", refstr);
+      obj->encoding =
+          to_binary(make_CrossSectionMeasurement(ref, local_cache_root));
+    }
+    return obj;
+  }
+
+  // Concurrent first requests for the same object wait on a single load. A
+  // failed load is forgotten so that a later request can retry it.
+  std::shared_ptr<ServedObject> get(RequestType type,
+                                    std::string const &refstr) {
+    auto key = std::make_pair(type, refstr);
+    std::promise<std::shared_ptr<ServedObject>> promise;
+    std::shared_future<std::shared_ptr<ServedObject>> future;
+    bool is_loader = false;
+    {
+      std::lock_guard lock(objects_mutex);
+      auto it = objects.find(key);
+      if (it == objects.end()) {
+        future = promise.get_future().share();
+        objects.emplace(key, future);
+        is_loader = true;
+      } else {
+        future = it->second;
+      }
+    }
+
+    if (is_loader) {
+      try {
+        promise.set_value(load(type, refstr));
+      } catch (...) {
+        promise.set_exception(std::current_exception());
+        std::lock_guard lock(objects_mutex);
+        objects.erase(key);
+      }
+    }
+    return future.get();
+  }
+
+  // A segment that fails to be written in full is removed and the error
+  // thrown, which leaves obj.shm_written unset so that a later request tries
+  // again rather than being handed a truncated segment.
+  std::filesystem::path const &shared_memory_path(ServedObject &obj) {
+    std::call_once(obj.shm_written, [&]() {
+      static std::atomic<size_t> nsegments{0};
+      auto p = shared_memory_dir() /
+               fmt::format("nuis-hepdata-{}-{}", ::getpid(), nsegments++);
+
+      FileDescriptor seg(
+          ::open(p.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600));
+      if (seg.fd < 0) {
+        throw errno_error(fmt::format(
+            "failed to create shared memory segment {}", p.native()));
+      }
+
+      char const *data = obj.encoding.data();
+      size_t n = obj.encoding.size();
+      while (n) {
+        auto nw = ::write(seg.fd, data, n);
+        if (nw < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          auto err = errno_error(fmt::format(
+              "failed to write shared memory segment {}", p.native()));
+          ::unlink(p.c_str());
+          throw err;
+        }
+        data += nw;
+        n -= size_t(nw);
+      }
+
+      std::lock_guard lock(shm_mutex);
+      shm_paths.push_back(p);
+      obj.shm_path = p;
+    });
+    return obj.shm_path;
+  }
+
+  void handle(int fd) {
+    FileDescriptor conn(fd);
+    uint8_t tag;
+    std::string payload;
+    try {
+      while (recv_message(fd, tag, payload, kMaxRequestLength)) {
+        auto type = RequestType(tag);
+        if (type == RequestType::kStop) {
+          serve_log().info("Received stop request.");
+          stopping = true;
+          send_message(fd, uint8_t(ResponseStatus::kOK), "");
+          continue;
+        }
+
+        try {
+          if (((type != RequestType::kRecord) &&
+               (type != RequestType::kCrossSectionMeasurement)) ||
+              payload.empty()) {
+            throw std::runtime_error(
+                fmt::format("malformed request with tag {}", tag));
+          }
+          auto transport = ServerTransport(payload[0]);
+          auto obj = get(type, payload.substr(1));
+          if (transport == ServerTransport::kSharedMemory) {
+            send_message(fd, uint8_t(ResponseStatus::kOK),
+                         shared_memory_path(*obj).native());
+          } else {
+            send_message(fd, uint8_t(ResponseStatus::kOK), obj->encoding);
+          }
+        } catch (std::exception const &e) {
+          send_message(fd, uint8_t(ResponseStatus::kError), e.what());
+        }
+      }
+    } catch (std::exception const &e) {
+      serve_log().warn("Dropped client connection: {}", e.what());
+    }
+  }
+};
+
+template <typename T>
+T fetch_served(RequestType type, ResourceReference const &ref,
+               std::filesystem::path const &socket_path,
+               ServerTransport transport) {
+  FileDescriptor conn(connect_to(socket_path));
+  if (conn.fd < 0) {
+    throw std::runtime_error(fmt::format(
+        "No record server is listening at {}.", socket_path.native()));
+  }
+
+  auto refstr = ref.str();
+  send_message(conn.fd, uint8_t(type),
+               std::string(1, char(transport)) + refstr);
+
+  uint8_t status;
+  std::string payload;
+  if (!recv_message(conn.fd, status, payload)) {
+    throw std::runtime_error(
+        fmt::format("Record server at {} closed the connection before "
+                    "responding to a request for {}.",
+                    socket_path.native(), refstr));
+  }
+  if (ResponseStatus(status) != ResponseStatus::kOK) {
+    throw std::runtime_error(
+        fmt::format("Record server at {} failed to serve {}: {}",
+                    socket_path.native(), refstr, payload));
+  }
+
+  if (transport == ServerTransport::kSocket) {
+    return from_binary<T>(payload);
+  }
+
+  FileDescriptor shm(::open(payload.c_str(), O_RDONLY));
+  if (shm.fd < 0) {
+    throw errno_error(
+        fmt::format("failed to open shared memory segment {}", payload));
+  }
+  struct stat st;
+  if (::fstat(shm.fd, &st) != 0) {
+    throw errno_error(
+        fmt::format("failed to stat shared memory segment {}", payload));
+  }
+  auto size = size_t(st.st_size);
+  void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, shm.fd, 0);
+  if (mapping == MAP_FAILED) {
+    throw errno_error(
+        fmt::format("failed to map shared memory segment {}", payload));
+  }
+  try {
+    auto obj = from_binary<T>(
+        std::string_view(static_cast<char const *>(mapping), size));
+    ::munmap(mapping, size);
+    return obj;
+  } catch (...) {
+    ::munmap(mapping, size);
+    throw;
+  }
+}
+
+// Owns the connection handler threads of a server and, however serve_Records
+// exits, joins them before the ServerState they use is destroyed and removes
+// the socket.
+struct ServerConnections {
+  struct Connection {
+    std::thread thread;
+    std::shared_ptr<std::atomic<bool>> done;
+  };
+
+  std::filesystem::path socket_path;
+  std::list<Connection> connections;
+
+  explicit ServerConnections(std::filesystem::path const &path)
+      : socket_path{path} {}
+  ServerConnections(ServerConnections const &) = delete;
+  ServerConnections &operator=(ServerConnections const &) = delete;
+
+  // takes ownership of conn, which is closed if no thread can be started
+  void start(ServerState &state, int conn) {
+    auto done = std::make_shared<std::atomic<bool>>(false);
+    try {
+      connections.push_back(Connection{std::thread([&state, conn, done]() {
+                                         state.handle(conn);
+                                         *done = true;
+                                       }),
+                                       done});
+    } catch (...) {
+      ::close(conn);
+      throw;
+    }
+  }
+
+  // joins the threads of connections that have been closed
+  void reap() {
+    for (auto it = connections.begin(); it != connections.end();) {
+      if (*it->done) {
+        it->thread.join();
+        it = connections.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  void close() {
+    std::error_code ec;
+    std::filesystem::remove(socket_path, ec);
+    for (auto &c : connections) {
+      c.thread.join();
+    }
+    connections.clear();
+  }
+
+  ~ServerConnections() { close(); }
+};
+
+} // namespace
+
+void serve_Records(std::filesystem::path const &socket_path,
+                   std::filesystem::path const &local_cache_root,
+                   std::vector<ResourceReference> const &preload,
+                   std::atomic<bool> const *stop) {
+
+  ServerState state(local_cache_root);
+
+  {
+    // refuse to take over a socket with a live server behind it, but clean
+    // up one left behind by a server that did not exit cleanly
+    FileDescriptor existing(connect_to(socket_path));
+    if (existing.fd >= 0) {
+      throw std::runtime_error(fmt::format(
+          "A record server is already listening at {}.", socket_path.native()));
+    }
+    std::error_code ec;
+    std::filesystem::remove(socket_path, ec);
+  }
+
+  for (auto const &ref : preload) {
+    state.get(RequestType::kRecord, ref.record_ref().str());
+  }
+
+  FileDescriptor listener(::socket(AF_UNIX, SOCK_STREAM, 0));
+  if (listener.fd < 0) {
+    throw errno_error("failed to create record server socket");
+  }
+  auto addr = make_address(socket_path);
+  if (::bind(listener.fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) !=
+      0) {
+    throw errno_error(fmt::format("failed to bind record server socket to {}",
+                                  socket_path.native()));
+  }
+  // declared after state so that it is destroyed first
+  ServerConnections connections(socket_path);
+
+  if (::listen(listener.fd, SOMAXCONN) != 0) {
+    throw errno_error("failed to listen on record server socket");
+  }
+
+  serve_log().info("Serving {} preloaded records on {}", preload.size(),
+                   socket_path.native());
+
+  while (!state.stopping && !(stop && *stop)) {
+    connections.reap();
+
+    pollfd pfd{listener.fd, POLLIN, 0};
+    int npoll = ::poll(&pfd, 1, 200);
+    if (npoll < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw errno_error("failed to poll record server socket");
+    }
+    if (npoll == 0) {
+      continue;
+    }
+
+    int conn = ::accept(listener.fd, nullptr, nullptr);
+    if (conn < 0) {
+      if ((errno == EINTR) || (errno == ECONNABORTED)) {
+        continue;
+      }
+      throw errno_error("failed to accept record server connection");
+    }
+
+    // don't let an idle client hold up shutdown indefinitely
+    timeval timeout{30, 0};
+    ::setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    connections.start(state, conn);
+  }
+
+  connections.close();
+  serve_log().info("Record server at {} stopped.", socket_path.native());
+}
+
+Record fetch_served_Record(ResourceReference const &ref,
+                           std::filesystem::path const &socket_path,
+                           ServerTransport transport) {
+  return fetch_served<Record>(RequestType::kRecord, ref.record_ref(),
+                              socket_path, transport);
+}
+
+CrossSectionMeasurement
+fetch_served_CrossSectionMeasurement(ResourceReference const &ref,
+                                     std::filesystem::path const &socket_path,
+                                     ServerTransport transport) {
+  return fetch_served<CrossSectionMeasurement>(
+      RequestType::kCrossSectionMeasurement, ref, socket_path, transport);
+}
+
+void stop_server(std::filesystem::path const &socket_path) {
+  FileDescriptor conn(connect_to(socket_path));
+  if (conn.fd < 0) {
+    throw std::runtime_error(fmt::format(
+        "No record server is listening at {}.", socket_path.native()));
+  }
+  send_message(conn.fd, uint8_t(RequestType::kStop), "");
+  uint8_t status;
+  std::string payload;
+  recv_message(conn.fd, status, payload);
+}
+
+} // namespace nuis::HEPData
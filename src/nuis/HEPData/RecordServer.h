@@ -0,0 +1,44 @@
+#pragma once
+
+#include "nuis/HEPData/Record.h"
+#include "nuis/HEPData/ResourceReference.h"
+
+#include <atomic>
+#include <filesystem>
+#include <vector>
+
+namespace nuis::HEPData {
+
+// How a served object is handed to a client. kSocket streams the binary
+// encoding (see BinarySerialization.h) over the connection, kSharedMemory
+// sends the location of a memory-backed file holding the encoding, which the
+// client maps read-only. Each encoding is written to shared memory at most
+// once per server, however many clients ask for it.
+enum class ServerTransport { kSocket, kSharedMemory };
+
+// Listens on the Unix domain socket at socket_path and answers requests for
+// Records and CrossSectionMeasurements. Each object is loaded with the
+// make_* factories on first request and kept encoded in memory for the
+// lifetime of the server. The records in preload are loaded before the socket
+// starts accepting connections. Connections are handled concurrently.
+//
+// Returns after a client calls stop_server, or once stop is set if given.
+void serve_Records(std::filesystem::path const &socket_path,
+                   std::filesystem::path const &local_cache_root = ".",
+                   std::vector<ResourceReference> const &preload = {},
+                   std::atomic<bool> const *stop = nullptr);
+
+// Client API, all of these throw if no server is listening on socket_path or
+// the server failed to load the requested object.
+Record
+fetch_served_Record(ResourceReference const &ref,
+                    std::filesystem::path const &socket_path,
+                    ServerTransport transport = ServerTransport::kSocket);
+
+CrossSectionMeasurement fetch_served_CrossSectionMeasurement(
+    ResourceReference const &ref, std::filesystem::path const &socket_path,
+    ServerTransport transport = ServerTransport::kSocket);
+
+void stop_server(std::filesystem::path const &socket_path);
+
+} // namespace nuis::HEPData
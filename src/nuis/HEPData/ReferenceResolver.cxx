@@ -1,25 +1,43 @@
 #include "nuis/HEPData/ReferenceResolver.h"
 
+#include "nuis/HEPData/HTTPClient.h"
+#include "nuis/HEPData/RecordCache.h"
+#include "nuis/HEPData/RecordIndex.h"
+#include "nuis/HEPData/ZipArchive.h"
+
 #include "cpr/cpr.h"
 
 #include "yaml-cpp/yaml.h"
 
 #include "fmt/core.h"
+#include "fmt/ranges.h"
 #include "spdlog/sinks/stdout_color_sinks.h"
 #include "spdlog/spdlog.h"
 
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <vector>
 
 namespace nuis::HEPData {
 
-static std::shared_ptr<spdlog::logger> refresolv_logger = nullptr;
-
 spdlog::logger &refresolv_log() {
-  if (!refresolv_logger) {
-    refresolv_logger = spdlog::stdout_color_mt("NHPD-RefResolv");
-    refresolv_logger->set_pattern("[NHPD RefResolv:%L]: %v");
-  }
+  static std::shared_ptr<spdlog::logger> refresolv_logger = []() {
+    auto logger = spdlog::stdout_color_mt("NHPD-RefResolv");
+    logger->set_pattern("[NHPD RefResolv:%L]: %v");
+    return logger;
+  }();
   return *refresolv_logger;
 }
 
@@ -58,8 +76,57 @@ get_expected_resource_location(ResourceReference const &ref,
   return expected_location;
 }
 
-cpr::Url get_record_endpoint(ResourceReference const &ref) {
-  cpr::Url Endpoint{"https://www.hepdata.net/record/"};
+static std::mutex &record_endpoints_mutex() {
+  static std::mutex endpoints_mutex;
+  return endpoints_mutex;
+}
+
+static std::vector<std::string> &record_endpoints() {
+  static std::vector<std::string> endpoints = []() {
+    std::vector<std::string> eps;
+    auto env = std::getenv("NUISANCEHEPData_RECORD_ENDPOINTS");
+    if (env) {
+      std::stringstream ss(env);
+      std::string ep;
+      while (std::getline(ss, ep, ',')) {
+        auto first = ep.find_first_not_of(" \t");
+        if (first == std::string::npos) {
+          continue;
+        }
+        eps.push_back(ep.substr(first, ep.find_last_not_of(" \t") - first + 1));
+      }
+    }
+    if (eps.empty()) {
+      eps.push_back("https://www.hepdata.net/record/");
+    }
+    return eps;
+  }();
+  return endpoints;
+}
+
+std::vector<std::string> get_record_endpoints() {
+  std::lock_guard lock(record_endpoints_mutex());
+  return record_endpoints();
+}
+
+void set_record_endpoints(std::vector<std::string> const &endpoints) {
+  if (endpoints.empty()) {
+    throw std::runtime_error("set_record_endpoints passed an empty list.");
+  }
+  std::lock_guard lock(record_endpoints_mutex());
+  record_endpoints() = endpoints;
+}
+
+static bool is_file_endpoint(std::string const &endpoint) {
+  return endpoint.rfind("file://", 0) == 0;
+}
+
+cpr::Url get_record_endpoint(ResourceReference const &ref,
+                             std::string base_url) {
+  if (base_url.empty() || (base_url.back() != '/')) {
+    base_url += '/';
+  }
+  cpr::Url Endpoint{base_url};
 
   if (ref.reftype == "hepdata") {
     Endpoint += fmt::format("{}", ref.recordid);
@@ -72,6 +139,550 @@ cpr::Url get_record_endpoint(ResourceReference const &ref) {
   return Endpoint;
 }
 
+// file:// mirrors are laid out like a local record database, so the record
+// can be copied directly into place
+static void fetch_record_file(ResourceReference const &ref,
+                              std::filesystem::path const &mirror_root,
+                              std::filesystem::path const &record_location) {
+  auto mirror_location = get_expected_record_location(ref, mirror_root);
+
+  refresolv_log().debug("       * COPY {} -> {} ", mirror_location.native(),
+                        record_location.native());
+
+  if (!std::filesystem::is_directory(mirror_location)) {
+    throw std::runtime_error(fmt::format("mirror has no record directory: {}",
+                                         mirror_location.native()));
+  }
+
+  std::filesystem::copy(mirror_location, record_location,
+                        std::filesystem::copy_options::recursive);
+}
+
+static void unzip_record_archive(std::filesystem::path const &record_location) {
+  std::string redir = ">/dev/null 2>&1";
+  if (refresolv_log().level() <= spdlog::level::debug) {
+    redir = "";
+  }
+
+  // -o as an incrementally fetched record may already hold some of the files
+  auto unzip_command = fmt::format("cd {} && unzip -o submission.zip {}",
+                                   record_location.native(), redir);
+
+  refresolv_log().debug("     * unzipping: system({})", unzip_command);
+
+  auto errc = std::system(unzip_command.c_str());
+  if (errc) {
+    throw std::runtime_error(
+        fmt::format("unzip command reported error: {}", errc));
+  }
+  std::filesystem::remove(record_location / "submission.zip");
+}
+
+static void
+download_record_archive(std::string const &url,
+                        std::filesystem::path const &record_location,
+                        bool unpack = true) {
+  std::filesystem::path download_location = record_location / "submission.zip";
+
+  refresolv_log().debug("       * GET {} -> {} ", url,
+                        download_location.native());
+
+  auto r = http_download(url, {{"format", "original"}}, download_location);
+
+  refresolv_log().debug("       * http response code: {} ", r.status_code);
+
+  if (r.status_code != 200) {
+    throw std::runtime_error(
+        r.status_code ? fmt::format("GET response code: {}", r.status_code)
+                      : fmt::format("GET failed: {}", r.error));
+  }
+
+  if (r.content_type != "application/zip") {
+    throw std::runtime_error(fmt::format(
+        "GET response content-type: {}, expected \"application/zip\"",
+        r.content_type));
+  }
+
+  if (unpack) {
+    unzip_record_archive(record_location);
+  }
+}
+
+static void fetch_record_http(ResourceReference const &ref,
+                              std::string const &base_url,
+                              std::filesystem::path const &record_location) {
+  if (ref.reftype == "inspirehep") {
+    throw std::runtime_error(
+        "Cannot yet fetch non-local inspirehep-type resources.");
+  }
+
+  download_record_archive(get_record_endpoint(ref, base_url).str(),
+                          record_location, !get_archive_records());
+}
+
+static void write_record_file(std::filesystem::path const &p,
+                              std::string_view contents) {
+  std::filesystem::create_directories(p.parent_path());
+  auto tmp = p;
+  tmp += fmt::format(".part{}", ::getpid());
+  {
+    std::ofstream out(tmp, std::ios::binary);
+    out.write(contents.data(), contents.size());
+    if (!out) {
+      throw std::runtime_error(
+          fmt::format("failed to write: {}", tmp.native()));
+    }
+  }
+  std::filesystem::rename(tmp, p);
+}
+
+// Records kept as archives are opened once per process, resources are then
+// read directly from the mapped archive.
+static std::atomic<bool> &archive_records_enabled() {
+  static std::atomic<bool> enabled = []() {
+    auto env = std::getenv("NUISANCEHEPData_ARCHIVE_RECORDS");
+    return env && (std::string(env) != "0") && (std::string(env) != "");
+  }();
+  return enabled;
+}
+
+bool get_archive_records() { return archive_records_enabled(); }
+void set_archive_records(bool enabled) { archive_records_enabled() = enabled; }
+
+static std::mutex &record_archives_mutex() {
+  static std::mutex archives_mutex;
+  return archives_mutex;
+}
+
+static std::map<std::filesystem::path, std::shared_ptr<ZipArchiveFile const>> &
+record_archives() {
+  static std::map<std::filesystem::path, std::shared_ptr<ZipArchiveFile const>>
+      archives;
+  return archives;
+}
+
+// returns nullptr if the record at record_location is not kept as an archive
+static std::shared_ptr<ZipArchiveFile const>
+open_record_archive(std::filesystem::path const &record_location,
+                    bool check_disk = true) {
+  std::lock_guard lock(record_archives_mutex());
+  auto found = record_archives().find(record_location);
+  if (found != record_archives().end()) {
+    return found->second;
+  }
+
+  auto archive_path = record_location / "submission.zip";
+  if (!check_disk || !std::filesystem::exists(archive_path)) {
+    return nullptr;
+  }
+
+  refresolv_log().debug("   * opening record archive: {}",
+                        archive_path.native());
+  auto archive = std::make_shared<ZipArchiveFile const>(archive_path);
+  record_archives()[record_location] = archive;
+  return archive;
+}
+
+// Writes the member called name of the archive of the record at
+// record_location to where it would be if the archive were unpacked, unless it
+// is already there.
+static void extract_archive_member(ZipArchiveFile const &archive,
+                                   std::string const &name,
+                                   std::filesystem::path const &record_location) {
+  auto rel = std::filesystem::path(name).lexically_normal();
+  if (rel.empty() || rel.is_absolute() || (*rel.begin() == "..")) {
+    throw std::runtime_error(
+        fmt::format("refusing to extract zip member outside of the record "
+                    "directory: {}",
+                    name));
+  }
+
+  // write_record_file names its temporary file by process
+  static std::mutex extract_mutex;
+  std::lock_guard lock(extract_mutex);
+  if (std::filesystem::exists(record_location / rel)) {
+    return;
+  }
+  refresolv_log().debug("   * extracting archive member: {}", name);
+  write_record_file(record_location / rel, archive.extract_member(name));
+}
+
+// Tables are read through read_resource, so only the other files that a
+// reference resolves to, such as prediction function sources, are extracted.
+static std::filesystem::path
+resolve_archived_resource(ResourceReference const &ref,
+                          ZipArchiveFile const &archive,
+                          std::filesystem::path const &record_location,
+                          std::filesystem::path const &expected_location) {
+  auto name =
+      expected_location.lexically_relative(record_location).generic_string();
+
+  if (archive.has_member(name)) {
+    refresolv_log().debug("   *-> resolved to archive member: {}",
+                          expected_location.native());
+    if (expected_location.extension() != ".yaml") {
+      extract_archive_member(archive, name, record_location);
+    }
+    return expected_location;
+  }
+  if (archive.has_member(name + ".yaml")) {
+    auto expected_location_yaml = expected_location;
+    expected_location_yaml += ".yaml";
+    refresolv_log().debug("   *-> resolved to archive member: {}",
+                          expected_location_yaml.native());
+    return expected_location_yaml;
+  }
+
+  std::stringstream members;
+  for (auto const &[member_name, member] : archive.cd.members) {
+    members << "  " << member_name << '\n';
+  }
+
+  throw std::runtime_error(fmt::format(
+      "Failed to resolve reference: {} to a file in the record archive: {}, "
+      "with members:\n{}\n\nIs the resourcename, {}, correct?",
+      ref.str(), archive.path.native(), members.str(), ref.resourcename));
+}
+
+// finds the record archive that path would be in if it were unpacked, and the
+// name of the member
+static std::pair<std::shared_ptr<ZipArchiveFile const>, std::string>
+find_archived_resource(std::filesystem::path const &path, bool check_disk) {
+  for (auto dir = path.parent_path(); dir.has_relative_path();
+       dir = dir.parent_path()) {
+    auto archive = open_record_archive(dir, check_disk);
+    if (archive) {
+      auto name = path.lexically_relative(dir).generic_string();
+      if (archive->has_member(name)) {
+        return {archive, name};
+      }
+    }
+  }
+  return {nullptr, ""};
+}
+
+std::string read_resource(std::filesystem::path const &path) {
+  // archives resolved in this process are known without touching the disk
+  auto [archive, name] = find_archived_resource(path, false);
+  if (archive) {
+    return archive->extract_member(name);
+  }
+
+  std::ifstream fin(path, std::ios::binary);
+  if (fin) {
+    return std::string{std::istreambuf_iterator<char>(fin),
+                       std::istreambuf_iterator<char>()};
+  }
+
+  std::tie(archive, name) = find_archived_resource(path, true);
+  if (archive) {
+    return archive->extract_member(name);
+  }
+
+  throw std::runtime_error(
+      fmt::format("Failed to read resource: {}", path.native()));
+}
+
+std::filesystem::path extract_resource(std::filesystem::path const &path) {
+  if (std::filesystem::exists(path)) {
+    return path;
+  }
+  for (bool check_disk : {false, true}) {
+    auto [archive, name] = find_archived_resource(path, check_disk);
+    if (archive) {
+      auto record_location = archive->path.parent_path();
+      extract_archive_member(*archive, name, record_location);
+      return path;
+    }
+  }
+  throw std::runtime_error(
+      fmt::format("Failed to find resource: {}", path.native()));
+}
+
+bool resource_exists(std::filesystem::path const &path) {
+  return find_archived_resource(path, false).first ||
+         std::filesystem::exists(path) ||
+         find_archived_resource(path, true).first;
+}
+
+// Records fetched incrementally keep the url and central directory of their
+// archive in the record directory. Members of the archive are then fetched
+// with range requests as they are first referenced.
+static std::string const incremental_state_name = ".incremental-fetch.yaml";
+static std::string const incremental_cd_name = ".incremental-fetch.cd";
+
+struct IncrementalRecord {
+  std::string url, etag;
+  ZipCentralDirectory cd;
+};
+
+static std::atomic<bool> &incremental_fetch_enabled() {
+  static std::atomic<bool> enabled = []() {
+    auto env = std::getenv("NUISANCEHEPData_INCREMENTAL_FETCH");
+    return env && (std::string(env) != "0") && (std::string(env) != "");
+  }();
+  return enabled;
+}
+
+bool get_incremental_fetch() { return incremental_fetch_enabled(); }
+void set_incremental_fetch(bool enabled) {
+  incremental_fetch_enabled() = enabled;
+}
+
+static bool is_incremental_record(std::filesystem::path const &record_location) {
+  return std::filesystem::exists(record_location / incremental_state_name);
+}
+
+static std::string get_archive_range(IncrementalRecord const &rec,
+                                     uint64_t offset, uint64_t length) {
+  refresolv_log().debug("       * GET {} bytes {}-{}", rec.url, offset,
+                        offset + length - 1);
+  std::string body;
+  auto r = http_get_range(rec.url, {{"format", "original"}}, int64_t(offset),
+                          length, body, rec.etag);
+  if (r.status_code != 206) {
+    throw std::runtime_error(fmt::format(
+        "range request for {} bytes at {} answered with: {}", length, offset,
+        r.status_code ? std::to_string(r.status_code) : r.error));
+  }
+  return body;
+}
+
+// returns false if the archive has no member called name
+static bool fetch_record_member(IncrementalRecord const &rec,
+                                std::string const &name,
+                                std::filesystem::path const &record_location) {
+  auto member = rec.cd.members.find(name);
+  if (member == rec.cd.members.end()) {
+    return false;
+  }
+  auto const &m = member->second;
+
+  auto rel = std::filesystem::path(name).lexically_normal();
+  if (rel.empty() || rel.is_absolute() || (*rel.begin() == "..")) {
+    throw std::runtime_error(
+        fmt::format("refusing to extract zip member outside of the record "
+                    "directory: {}",
+                    name));
+  }
+
+  // members are stored before the central directory, don't ask for more
+  auto offset = m.local_header_offset;
+  auto bytes = get_archive_range(
+      rec, offset,
+      std::min(zip_member_extent(m), rec.cd.offset - m.local_header_offset));
+  auto extent = zip_member_extent(m, bytes);
+  if (bytes.size() < extent) {
+    bytes += get_archive_range(rec, offset + bytes.size(),
+                               extent - bytes.size());
+  }
+
+  write_record_file(record_location / rel, extract_zip_member(m, bytes));
+  return true;
+}
+
+static IncrementalRecord
+read_incremental_record(std::filesystem::path const &record_location) {
+  auto state = YAML::LoadFile((record_location / incremental_state_name).native());
+
+  std::ifstream fin(record_location / incremental_cd_name, std::ios::binary);
+  std::string cd_bytes{std::istreambuf_iterator<char>(fin),
+                       std::istreambuf_iterator<char>()};
+
+  return IncrementalRecord{
+      state["url"].as<std::string>(), state["etag"].as<std::string>(),
+      read_zip_central_directory(
+          cd_bytes, state["central_directory_offset"].as<uint64_t>())};
+}
+
+static void
+fetch_record_http_incremental(ResourceReference const &ref,
+                              std::string const &base_url,
+                              std::filesystem::path const &record_location) {
+  if (ref.reftype == "inspirehep") {
+    throw std::runtime_error(
+        "Cannot yet fetch non-local inspirehep-type resources.");
+  }
+
+  IncrementalRecord rec;
+  rec.url = get_record_endpoint(ref, base_url).str();
+
+  refresolv_log().debug("       * GET {} last {} bytes", rec.url,
+                        kZipMaxTailLength);
+
+  std::string tail;
+  auto r = http_get_range(rec.url, {{"format", "original"}}, -1,
+                          kZipMaxTailLength, tail);
+
+  refresolv_log().debug("       * http response code: {} ", r.status_code);
+
+  if (((r.status_code == 200) || (r.status_code == 206)) &&
+      (r.content_type != "application/zip")) {
+    throw std::runtime_error(fmt::format(
+        "GET response content-type: {}, expected \"application/zip\"",
+        r.content_type));
+  }
+
+  if (r.status_code == 200) {
+    refresolv_log().debug(
+        "       * server ignored the range request and sent the whole "
+        "archive");
+    write_record_file(record_location / "submission.zip", tail);
+    unzip_record_archive(record_location);
+    return;
+  }
+
+  if ((r.status_code != 206) || !r.total_length) {
+    throw std::runtime_error(
+        r.status_code ? fmt::format("GET response code: {}", r.status_code)
+                      : fmt::format("GET failed: {}", r.error));
+  }
+  rec.etag = r.etag;
+
+  auto [cd_offset, cd_size] =
+      locate_zip_central_directory(tail, r.total_length);
+  uint64_t tail_offset = r.total_length - tail.size();
+
+  std::string cd_bytes = (cd_offset >= tail_offset)
+                             ? tail.substr(cd_offset - tail_offset, cd_size)
+                             : get_archive_range(rec, cd_offset, cd_size);
+  rec.cd = read_zip_central_directory(cd_bytes, cd_offset);
+
+  if (!fetch_record_member(rec, "submission.yaml", record_location)) {
+    throw std::runtime_error("record archive contains no submission.yaml");
+  }
+
+  YAML::Emitter state;
+  state << YAML::BeginMap;
+  state << YAML::Key << "url" << YAML::Value << rec.url;
+  state << YAML::Key << "etag" << YAML::Value << rec.etag;
+  state << YAML::Key << "central_directory_offset" << YAML::Value << cd_offset;
+  state << YAML::EndMap;
+
+  write_record_file(record_location / incremental_cd_name, cd_bytes);
+  write_record_file(record_location / incremental_state_name, state.c_str());
+}
+
+// newly fetched files are added to the object store if deduplication is
+// enabled, failing to do so is not an error
+static void deduplicate_fetched(std::filesystem::path const &fetched,
+                                std::filesystem::path const &local_cache_root) {
+  if (!get_deduplicate_records()) {
+    return;
+  }
+  try {
+    if (std::filesystem::is_directory(fetched)) {
+      deduplicate_record(fetched, local_cache_root);
+    } else {
+      deduplicate_file(fetched, local_cache_root);
+    }
+  } catch (std::exception const &e) {
+    refresolv_log().warn("Failed to deduplicate {}: {}", fetched.native(),
+                         e.what());
+  }
+}
+
+// fetches the member of an incrementally fetched record that expected_location
+// refers to. If the archive cannot be read piecewise any more, falls back to
+// fetching the whole thing.
+static std::filesystem::path
+resolve_incremental_resource(ResourceReference const &ref,
+                             std::filesystem::path const &record_location,
+                             std::filesystem::path const &expected_location,
+                             std::filesystem::path const &local_cache_root) {
+  auto name =
+      expected_location.lexically_relative(record_location).generic_string();
+
+  auto expected_location_yaml = expected_location;
+  expected_location_yaml += ".yaml";
+
+  auto rec = read_incremental_record(record_location);
+
+  try {
+    if (fetch_record_member(rec, name, record_location)) {
+      refresolv_log().debug("   *-> fetched archive member: {}",
+                            expected_location.native());
+      deduplicate_fetched(expected_location, local_cache_root);
+      return expected_location;
+    }
+    if (fetch_record_member(rec, name + ".yaml", record_location)) {
+      refresolv_log().debug("   *-> fetched archive member: {}",
+                            expected_location_yaml.native());
+      deduplicate_fetched(expected_location_yaml, local_cache_root);
+      return expected_location_yaml;
+    }
+  } catch (std::exception const &e) {
+    refresolv_log().warn("Failed to fetch {} from the archive at {}: {}, "
+                         "fetching the whole archive instead",
+                         name, rec.url, e.what());
+
+    download_record_archive(rec.url, record_location);
+    std::filesystem::remove(record_location / incremental_state_name);
+    std::filesystem::remove(record_location / incremental_cd_name);
+    deduplicate_fetched(record_location, local_cache_root);
+
+    if (std::filesystem::exists(expected_location)) {
+      return expected_location;
+    }
+    if (std::filesystem::exists(expected_location_yaml)) {
+      return expected_location_yaml;
+    }
+  }
+
+  std::stringstream members;
+  for (auto const &[member_name, member] : rec.cd.members) {
+    members << "  " << member_name << '\n';
+  }
+
+  throw std::runtime_error(fmt::format(
+      "Failed to resolve reference: {} to a file in the record archive: {}, "
+      "with members:\n{}\n\nIs the resourcename, {}, correct?",
+      ref.str(), rec.url, members.str(), ref.resourcename));
+}
+
+// Indexing a record resolves references into it, so records are only indexed
+// once the lock they were fetched under has been released.
+static std::mutex &unindexed_records_mutex() {
+  static std::mutex mtx;
+  return mtx;
+}
+static std::set<std::filesystem::path> &unindexed_records() {
+  static std::set<std::filesystem::path> records;
+  return records;
+}
+
+static void index_fetched(ResourceReference const &ref,
+                          std::filesystem::path const &record_location,
+                          std::filesystem::path const &local_cache_root) {
+  {
+    std::lock_guard lock(unindexed_records_mutex());
+    if (!unindexed_records().erase(record_location)) {
+      return;
+    }
+  }
+  try {
+    update_record_index(ref.record_ref(), local_cache_root);
+  } catch (std::exception const &e) {
+    refresolv_log().warn("Failed to add {} to the record index: {}",
+                         ref.record_ref().str(), e.what());
+  }
+}
+
+// References into the same record may be resolved concurrently, fetching is
+// serialized per record so that it is only downloaded and unpacked once.
+static std::mutex &
+record_fetch_mutex(std::filesystem::path const &record_location) {
+  static std::mutex map_mutex;
+  static std::map<std::filesystem::path, std::unique_ptr<std::mutex>> mutexes;
+
+  std::lock_guard lock(map_mutex);
+  auto &m = mutexes[record_location];
+  if (!m) {
+    m = std::make_unique<std::mutex>();
+  }
+  return *m;
+}
+
 std::filesystem::path
 ensure_local_path(ResourceReference const &ref,
                   std::filesystem::path const &local_cache_root) {
@@ -87,6 +698,13 @@ ensure_local_path(ResourceReference const &ref,
   refresolv_log().debug(R"(   * expected resource location = {}{})",
                         expected_location.native(), yaml_opt);
 
+  auto record_location = get_expected_record_location(ref, local_cache_root);
+
+  if (auto archive = open_record_archive(record_location, false)) {
+    return resolve_archived_resource(ref, *archive, record_location,
+                                     expected_location);
+  }
+
   if (std::filesystem::exists(expected_location)) {
     refresolv_log().debug("   *-> expected resource location exists: {}",
                           expected_location.native());
@@ -103,13 +721,31 @@ ensure_local_path(ResourceReference const &ref,
     return expected_location_yaml;
   }
 
-  auto record_location = get_expected_record_location(ref, local_cache_root);
+  std::lock_guard fetch_lock(record_fetch_mutex(record_location));
+
+  // another thread may have fetched the record while we waited
+  if (std::filesystem::exists(expected_location)) {
+    return expected_location;
+  }
+  if (std::filesystem::exists(expected_location_yaml)) {
+    return expected_location_yaml;
+  }
 
   refresolv_log().debug(
       "   * Failed to directly resolve to a resource, checking "
       "expected record location: {}",
       record_location.native());
 
+  if (auto archive = open_record_archive(record_location)) {
+    return resolve_archived_resource(ref, *archive, record_location,
+                                     expected_location);
+  }
+
+  if (is_incremental_record(record_location)) {
+    return resolve_incremental_resource(ref, record_location,
+                                        expected_location, local_cache_root);
+  }
+
   // if the submission exists, then it is likely that this resource is mispelled
   if (std::filesystem::exists(record_location)) {
     std::stringstream dir_contents;
@@ -126,56 +762,66 @@ ensure_local_path(ResourceReference const &ref,
         ref.resourcename));
   }
 
-  if (ref.reftype == "inspirehep") {
-    throw std::runtime_error(
-        "Cannot yet fetch non-local inspirehep-type resources.");
-  }
-
-  std::filesystem::path download_location = record_location / "submission.zip";
-
-  std::filesystem::create_directories(record_location);
-
-  std::ofstream of(download_location, std::ios::binary);
-
-  cpr::Url Endpoint = get_record_endpoint(ref);
-
   refresolv_log().debug("   * No local copy of the record found");
-  refresolv_log().debug("     * Try to fetch remote reference:");
-  refresolv_log().debug("       * GET {} -> {} ", Endpoint.str(),
-                        download_location.native());
 
-  cpr::Response r =
-      cpr::Download(of, Endpoint, cpr::Parameters{{"format", "original"}});
-
-  refresolv_log().debug("       * http response code: {} ", r.status_code);
-
-  if (r.status_code != 200) {
-    throw std::runtime_error(
-        fmt::format("GET response code: {}", r.status_code));
+  std::vector<std::string> failures;
+  auto endpoints = get_record_endpoints();
+  for (size_t i = 0; i < endpoints.size(); ++i) {
+    auto const &endpoint = endpoints[i];
+    refresolv_log().debug("     * Try to fetch remote reference from: {}",
+                          endpoint);
+    try {
+      std::filesystem::create_directories(record_location);
+      if (is_file_endpoint(endpoint)) {
+        fetch_record_file(ref, endpoint.substr(7), record_location);
+      } else if (get_incremental_fetch() && !get_archive_records()) {
+        try {
+          fetch_record_http_incremental(ref, endpoint, record_location);
+        } catch (std::exception const &e) {
+          refresolv_log().debug("     * incremental fetch failed: {}, "
+                                "fetching the whole archive",
+                                e.what());
+          std::filesystem::remove_all(record_location);
+          std::filesystem::create_directories(record_location);
+          fetch_record_http(ref, endpoint, record_location);
+        }
+      } else {
+        fetch_record_http(ref, endpoint, record_location);
+      }
+      failures.clear();
+      deduplicate_fetched(record_location, local_cache_root);
+      // indexing an incrementally fetched record would fetch all of it
+      if (!is_incremental_record(record_location)) {
+        std::lock_guard lock(unindexed_records_mutex());
+        unindexed_records().insert(record_location);
+      }
+      break;
+    } catch (std::exception const &e) {
+      if ((i + 1) < endpoints.size()) {
+        refresolv_log().warn("Failed to fetch {} from {}: {}, trying {}",
+                             ref.str(), endpoint, e.what(), endpoints[i + 1]);
+      }
+      failures.push_back(fmt::format("  {}: {}", endpoint, e.what()));
+      std::filesystem::remove_all(record_location);
+    }
   }
 
-  if (r.header["content-type"] != "application/zip") {
-    throw std::runtime_error(fmt::format(
-        "GET response content-type: {}, expected \"application/zip\"",
-        r.header["content-type"]));
+  if (failures.size()) {
+    throw std::runtime_error(
+        fmt::format("Failed to fetch reference: {} from any record "
+                    "endpoint:\n{}",
+                    ref.str(), fmt::join(failures, "\n")));
   }
 
-  std::string redir = "&>/dev/null";
-  if (refresolv_log().level() <= spdlog::level::debug) {
-    redir = "";
+  if (auto archive = open_record_archive(record_location)) {
+    return resolve_archived_resource(ref, *archive, record_location,
+                                     expected_location);
   }
 
-  auto unzip_command = fmt::format("cd {} && unzip submission.zip {}",
-                                   record_location.native(), redir);
-
-  refresolv_log().debug("     * unzipping: system({})", unzip_command);
-
-  auto errc = std::system(unzip_command.c_str());
-  if (errc) {
-    throw std::runtime_error(
-        fmt::format("unzip command reported error: {}", errc));
+  if (is_incremental_record(record_location)) {
+    return resolve_incremental_resource(ref, record_location,
+                                        expected_location, local_cache_root);
   }
-  std::filesystem::remove(download_location);
 
   if (std::filesystem::exists(expected_location)) {
     refresolv_log().debug("   *-> resolved to newly downloaded file: {}",
@@ -205,37 +851,117 @@ ensure_local_path(ResourceReference const &ref,
       ref.resourcename));
 }
 
-ResourceReference resolve_version(ResourceReference ref) {
+static int latest_version_file(ResourceReference const &ref,
+                               std::filesystem::path const &mirror_root) {
+  // the version directories sit alongside each other in the mirror
+  auto record_dir =
+      get_expected_record_location(ref, mirror_root).parent_path();
+  auto prefix = fmt::format("HEPData-{}-v", ref.recordid);
+
+  refresolv_log().debug("      * LIST {}", record_dir.native());
+
+  int latest = 0;
+  if (std::filesystem::is_directory(record_dir)) {
+    for (auto const &dir_entry :
+         std::filesystem::directory_iterator{record_dir}) {
+      auto name = dir_entry.path().filename().native();
+      if (name.rfind(prefix, 0) == 0) {
+        latest = std::max(latest, std::atoi(name.c_str() + prefix.size()));
+      }
+    }
+  }
+
+  if (!latest) {
+    throw std::runtime_error(fmt::format(
+        "mirror has no versions of the record in: {}", record_dir.native()));
+  }
+  return latest;
+}
+
+// The last version response for each record and endpoint is kept next to the
+// record's version directories, so that repeat checks can be revalidated.
+static std::filesystem::path
+version_revalidation_cache(ResourceReference ref, std::string const &url,
+                           std::filesystem::path const &local_cache_root) {
+  if (local_cache_root.empty()) {
+    return {};
+  }
+  ref.recordvers = 0;
+  return get_expected_record_location(ref, local_cache_root).parent_path() /
+         fmt::format(".version-{:016x}.yaml", std::hash<std::string>{}(url));
+}
+
+static int
+latest_version_http(ResourceReference const &ref, std::string const &base_url,
+                    std::filesystem::path const &local_cache_root) {
+  cpr::Url Endpoint = get_record_endpoint(ref, base_url);
+
+  refresolv_log().debug("      * GET {}", Endpoint.str());
+
+  std::string body;
+  auto r = http_get(
+      Endpoint.str(), {{"format", "json"}}, body,
+      version_revalidation_cache(ref, Endpoint.str(), local_cache_root));
+
+  refresolv_log().debug("      * http response --> {}{}", r.status_code,
+                        r.revalidated ? " (not modified)" : "");
+
+  if (r.status_code != 200) {
+    throw std::runtime_error(
+        r.status_code ? fmt::format("GET response code: {}", r.status_code)
+                      : fmt::format("GET failed: {}", r.error));
+  }
+
+  if (r.content_type != "application/json") {
+    throw std::runtime_error(fmt::format(
+        "GET response content-type: {}, expected \"application/json\"",
+        r.content_type));
+  }
+
+  auto respdoc = YAML::Load(body);
+
+  return respdoc["version"].as<int>();
+}
+
+ResourceReference resolve_version(ResourceReference ref,
+                                  std::filesystem::path const &local_cache_root) {
   if (ref.reftype == "path") {
     return ref;
   }
 
   if (!ref.recordvers) { // unqualified version, check what the latest version
                          // is
-    cpr::Url Endpoint = get_record_endpoint(ref);
-
     refresolv_log().debug(
         "    * Checking latest version for unversioned ref={}", ref.str());
-    refresolv_log().debug("      * GET {}", Endpoint.str());
-
-    cpr::Response r = cpr::Get(Endpoint, cpr::Parameters{{"format", "json"}});
 
-    refresolv_log().debug("      * http response --> {} ", r.status_code);
-
-    if (r.status_code != 200) {
-      throw std::runtime_error(
-          fmt::format("GET response code: {}", r.status_code));
+    std::vector<std::string> failures;
+    auto endpoints = get_record_endpoints();
+    for (size_t i = 0; i < endpoints.size(); ++i) {
+      auto const &endpoint = endpoints[i];
+      try {
+        if (is_file_endpoint(endpoint)) {
+          ref.recordvers = latest_version_file(ref, endpoint.substr(7));
+        } else {
+          ref.recordvers = latest_version_http(ref, endpoint, local_cache_root);
+        }
+        break;
+      } catch (std::exception const &e) {
+        if ((i + 1) < endpoints.size()) {
+          refresolv_log().warn("Failed to check the latest version of {} at "
+                               "{}: {}, trying {}",
+                               ref.str(), endpoint, e.what(), endpoints[i + 1]);
+        }
+        failures.push_back(fmt::format("  {}: {}", endpoint, e.what()));
+      }
     }
 
-    if (r.header["content-type"] != "application/json") {
-      throw std::runtime_error(fmt::format(
-          "GET response content-type: {}, expected \"application/json\"",
-          r.header["content-type"]));
+    if (!ref.recordvers) {
+      throw std::runtime_error(
+          fmt::format("Failed to check the latest version of reference: {} "
+                      "at any record endpoint:\n{}",
+                      ref.str(), fmt::join(failures, "\n")));
     }
 
-    auto respdoc = YAML::Load(r.text);
-
-    ref.recordvers = respdoc["version"].as<int>();
     refresolv_log().debug(
         "    *-> resolved reference with concrete version to: {}", ref.str());
   }
@@ -252,12 +978,19 @@ resolve_reference_HEPData(ResourceReference ref,
   if (ref.reftype == "inspirehep") {
     refresolv_log().debug(
         R"(  * inspirehep type reference must exist in local cache)");
-    return ensure_local_path(ref, local_cache_root);
+    auto local_path = ensure_local_path(ref, local_cache_root);
+    record_access(get_expected_record_location(ref, local_cache_root));
+    return local_path;
   }
 
-  ref = resolve_version(ref);
+  ref = resolve_version(ref, local_cache_root);
 
-  return ensure_local_path(ref, local_cache_root);
+  auto local_path = ensure_local_path(ref, local_cache_root);
+  auto record_location = get_expected_record_location(ref, local_cache_root);
+  // keeps the record from being garbage collected while it is in use
+  record_access(record_location);
+  index_fetched(ref, record_location, local_cache_root);
+  return local_path;
 }
 
 std::filesystem::path
@@ -3,10 +3,58 @@
 #include "nuis/HEPData/ResourceReference.h"
 
 #include <filesystem>
+#include <string>
+#include <vector>
 
 namespace nuis::HEPData {
 
-ResourceReference resolve_version(ResourceReference ref);
+// The locations that records missing from the local cache are fetched from,
+// tried in order until one succeeds. Each is either the base URL of a
+// HEPData-like server, e.g. https://www.hepdata.net/record/, or a file://
+// URL of a directory laid out like a local record database. The default list
+// can be overridden by a comma-separated list in the
+// NUISANCEHEPData_RECORD_ENDPOINTS environment variable, or with
+// set_record_endpoints.
+std::vector<std::string> get_record_endpoints();
+void set_record_endpoints(std::vector<std::string> const &endpoints);
+
+// When enabled, records missing from the local cache are fetched from http(s)
+// endpoints incrementally: only submission.yaml and the index of the record
+// archive are fetched at first, and each further file as it is referenced,
+// using HTTP range requests. Falls back to fetching the whole archive if the
+// endpoint does not support range requests. Off by default, can be enabled by
+// setting the NUISANCEHEPData_INCREMENTAL_FETCH environment variable to 1.
+bool get_incremental_fetch();
+void set_incremental_fetch(bool enabled);
+
+// When enabled, records fetched from http(s) endpoints are kept in the local
+// cache as their single submission.zip archive rather than unpacked, and
+// resources are read directly from the archive, which is memory mapped and
+// indexed once per process. Records already in the cache as archives are
+// always read this way. Takes precedence over incremental fetching. Off by
+// default, can be enabled by setting the NUISANCEHEPData_ARCHIVE_RECORDS
+// environment variable to 1.
+bool get_archive_records();
+void set_archive_records(bool enabled);
+
+// Tables that resolve_reference finds in records kept as archives are left in
+// the archive, the returned path is where the table would be if the archive
+// were unpacked and does not exist on disk. Any other file is extracted into
+// the record directory when it is first resolved. These read the resource at
+// such a path, or any ordinary file.
+std::string read_resource(std::filesystem::path const &path);
+bool resource_exists(std::filesystem::path const &path);
+// Extracts the resource at such a path from its archive if it isn't on disk
+// already, for handing paths on to code that opens them itself. Returns path,
+// throws if there is no resource there.
+std::filesystem::path extract_resource(std::filesystem::path const &path);
+
+// Returns ref with an unqualified record version replaced by the latest
+// version available from the record endpoints. If local_cache_root is given,
+// the responses are cached there and revalidated on subsequent checks.
+ResourceReference
+resolve_version(ResourceReference ref,
+                std::filesystem::path const &local_cache_root = {});
 
 std::filesystem::path
 resolve_reference(ResourceReference const &ref,
@@ -8,13 +8,12 @@
 
 namespace nuis::HEPData {
 
-static std::shared_ptr<spdlog::logger> ref_logger = nullptr;
-
 spdlog::logger &ref_log() {
-  if (!ref_logger) {
-    ref_logger = spdlog::stdout_color_mt("NHPD-Ref");
-    ref_logger->set_pattern("[NHPD       Ref:%L]: %v");
-  }
+  static std::shared_ptr<spdlog::logger> ref_logger = []() {
+    auto logger = spdlog::stdout_color_mt("NHPD-Ref");
+    logger->set_pattern("[NHPD       Ref:%L]: %v");
+    return logger;
+  }();
   return *ref_logger;
 }
 
@@ -1,5 +1,8 @@
 #include "nuis/HEPData/TableFactory.h"
+#include "nuis/HEPData/BinarySerialization.h"
 #include "nuis/HEPData/CrossSectionMeasurement.h"
+#include "nuis/HEPData/ParallelFor.h"
+#include "nuis/HEPData/RecordCache.h"
 #include "nuis/HEPData/ReferenceResolver.h"
 #include "nuis/HEPData/YAMLConverters.h"
 
@@ -10,94 +13,143 @@
 #include "spdlog/sinks/stdout_color_sinks.h"
 #include "spdlog/spdlog.h"
 
-namespace nuis::HEPData {
+#include <unistd.h>
+
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <thread>
 
-static std::shared_ptr<spdlog::logger> rec_logger = nullptr;
+namespace nuis::HEPData {
 
 spdlog::logger &rec_log() {
-  if (!rec_logger) {
-    rec_logger = spdlog::stdout_color_mt("NHPD-RecFact");
-    rec_logger->set_pattern("[NHPD   RecFact:%L]: %v");
-  }
+  static std::shared_ptr<spdlog::logger> rec_logger = []() {
+    auto logger = spdlog::stdout_color_mt("NHPD-RecFact");
+    logger->set_pattern("[NHPD   RecFact:%L]: %v");
+    return logger;
+  }();
   return *rec_logger;
 }
 
-ProbeFlux make_ProbeFlux(ResourceReference ref,
-                         std::filesystem::path const &local_cache_root) {
+// Decodes the first dependent variable of the table that ref resolves to that
+// has one of the accepted variable_types and, if ref is qualified, a matching
+// name, directly into obj along with the independent variables. The values of
+// other dependent variables are never decoded.
+static void
+decode_selected_table(Table &obj, ResourceReference const &ref,
+                      std::filesystem::path const &local_cache_root,
+                      std::set<std::string> const &variable_types,
+                      std::string const &tblname) {
 
   auto source = resolve_reference(ref, local_cache_root);
-  auto tbl = YAML::LoadFile(source).as<Table>();
+  auto doc = read_resource(source);
+
+  // tables in the record database are parsed once per distinct content and
+  // selection, whichever record version they appear in
+  std::filesystem::path snapshot;
+  if (get_deduplicate_records() && (ref.reftype != "path")) {
+    snapshot = table_snapshot_path(
+        local_cache_root, content_hash(doc),
+        fmt::format("{}:{}", fmt::join(variable_types, ","), ref.qualifier));
+
+    if (std::filesystem::exists(snapshot)) {
+      try {
+        std::ifstream fin(snapshot, std::ios::binary);
+        obj = from_binary<Table>(std::string{std::istreambuf_iterator<char>(fin),
+                                             std::istreambuf_iterator<char>()});
+        obj.source = source;
+        rec_log().debug("  + read {} from snapshot: {}", source.native(),
+                        snapshot.native());
+        // the snapshot's age is its last use for cache_gc
+        std::error_code ec;
+        std::filesystem::last_write_time(
+            snapshot, std::filesystem::file_time_type::clock::now(), ec);
+        return;
+      } catch (std::exception const &e) {
+        rec_log().debug("  + ignoring unreadable snapshot {}: {}",
+                        snapshot.native(), e.what());
+      }
+    }
+  }
 
-  ProbeFlux obj;
   obj.source = source;
 
-  for (auto const &dv : tbl.dependent_vars) {
-
-    if (!dv.qualifiers.count("variable_type") ||
-        (dv.qualifiers.at("variable_type") != "probe_flux")) {
-      continue;
-    }
-
-    if (ref.qualifier.size()) {
-      if (dv.name == ref.qualifier) {
-        obj.independent_vars = tbl.independent_vars;
-        obj.dependent_vars.push_back(dv);
-        break;
-      }
-    } else {
-      obj.independent_vars = tbl.independent_vars;
-      obj.dependent_vars.push_back(dv);
-      break;
-    }
+  if (!decode_Table_selected(
+          YAML::Load(doc), obj, [&](DependentVariable const &dv) {
+            if (!dv.qualifiers.count("variable_type") ||
+                !variable_types.count(dv.qualifiers.at("variable_type"))) {
+              return false;
+            }
+            return !ref.qualifier.size() || (dv.name == ref.qualifier);
+          })) {
+    throw std::runtime_error(
+        fmt::format("When parsing {} from ref: \"{}\" file: {} is not a "
+                    "valid HEPData table.",
+                    tblname, ref.str(), source.native()));
   }
 
   if (!obj.dependent_vars.size()) {
     throw std::runtime_error(
-        fmt::format("When parsing ProbeFlux from ref: \"{}\" failed to find a "
+        fmt::format("When parsing {} from ref: \"{}\" failed to find a "
                     "valid dependent variable.",
-                    ref.str()));
+                    tblname, ref.str()));
+  }
+
+  if (!snapshot.empty()) {
+    try {
+      std::filesystem::create_directories(snapshot.parent_path());
+      auto bytes = to_binary(obj);
+      // unique per thread, as records loaded concurrently can share tables
+      auto tmp = snapshot;
+      tmp += fmt::format(
+          ".{}.{}", ::getpid(),
+          std::hash<std::thread::id>{}(std::this_thread::get_id()));
+      std::ofstream fout(tmp, std::ios::binary);
+      fout << bytes;
+      fout.close();
+      std::error_code ec;
+      if (!fout) {
+        std::filesystem::remove(tmp, ec);
+        throw std::runtime_error(
+            fmt::format("failed to write {}", tmp.native()));
+      }
+      std::filesystem::rename(tmp, snapshot, ec);
+      if (ec) {
+        auto msg = ec.message();
+        std::filesystem::remove(tmp, ec);
+        throw std::runtime_error(msg);
+      }
+    } catch (std::exception const &e) {
+      rec_log().warn("Failed to write table snapshot {}: {}",
+                     snapshot.native(), e.what());
+    }
   }
+}
+
+ProbeFlux make_ProbeFlux(ResourceReference ref,
+                         std::filesystem::path const &local_cache_root) {
+
+  ProbeFlux obj;
+  decode_selected_table(obj, ref, local_cache_root,
+                        {"probe_flux"}, "ProbeFlux");
 
   obj.probe_particle = obj.dependent_vars[0].qualifiers["probe_particle"];
   obj.bin_content_type = obj.dependent_vars[0].qualifiers["bin_content_type"];
+  try {
+    obj.histogram = make_FluxHistogram(obj);
+  } catch (std::exception const &e) {
+    rec_log().warn("ProbeFlux from ref: \"{}\" has no flux histogram: {}",
+                   ref.str(), e.what());
+  }
   return obj;
 }
 
 ErrorTable make_ErrorTable(ResourceReference ref,
                            std::filesystem::path const &local_cache_root) {
 
-  auto source = resolve_reference(ref, local_cache_root);
-  auto tbl = YAML::LoadFile(source).as<Table>();
-
   ErrorTable obj;
-  obj.source = source;
-
-  for (auto const &dv : tbl.dependent_vars) {
-
-    if (!dv.qualifiers.count("variable_type") ||
-        (dv.qualifiers.at("variable_type") != "error_table")) {
-      continue;
-    }
-
-    if (ref.qualifier.size()) {
-      if (dv.name == ref.qualifier) {
-        obj.independent_vars = tbl.independent_vars;
-        obj.dependent_vars.push_back(dv);
-        break;
-      }
-    } else {
-      obj.independent_vars = tbl.independent_vars;
-      obj.dependent_vars.push_back(dv);
-      break;
-    }
-  }
-
-  if (!obj.dependent_vars.size()) {
-    throw std::runtime_error(
-        fmt::format("When parsing ErrorTable from ref: \"{}\" failed to find a "
-                    "valid dependent variable.",
-                    ref.str()));
-  }
+  decode_selected_table(obj, ref, local_cache_root,
+                        {"error_table"}, "ErrorTable");
 
   obj.error_type = obj.dependent_vars[0].qualifiers["error_type"];
 
@@ -117,38 +169,9 @@ ErrorTable make_ErrorTable(ResourceReference ref,
 SmearingTable
 make_SmearingTable(ResourceReference ref,
                    std::filesystem::path const &local_cache_root) {
-  auto source = resolve_reference(ref, local_cache_root);
-  auto tbl = YAML::LoadFile(source).as<Table>();
-
   SmearingTable obj;
-  obj.source = source;
-
-  for (auto const &dv : tbl.dependent_vars) {
-
-    if (!dv.qualifiers.count("variable_type") ||
-        (dv.qualifiers.at("variable_type") != "smearing_table")) {
-      continue;
-    }
-
-    if (ref.qualifier.size()) {
-      if (dv.name == ref.qualifier) {
-        obj.independent_vars = tbl.independent_vars;
-        obj.dependent_vars.push_back(dv);
-        break;
-      }
-    } else {
-      obj.independent_vars = tbl.independent_vars;
-      obj.dependent_vars.push_back(dv);
-      break;
-    }
-  }
-
-  if (!obj.dependent_vars.size()) {
-    throw std::runtime_error(fmt::format(
-        "When parsing SmearingTable from ref: \"{}\" failed to find a "
-        "valid dependent variable.",
-        ref.str()));
-  }
+  decode_selected_table(obj, ref, local_cache_root,
+                        {"smearing_table"}, "SmearingTable");
 
   obj.smearing_type = obj.dependent_vars[0].qualifiers["smearing_type"];
 
@@ -158,38 +181,9 @@ make_SmearingTable(ResourceReference ref,
 PredictionTable
 make_PredictionTable(ResourceReference ref,
                      std::filesystem::path const &local_cache_root) {
-  auto source = resolve_reference(ref, local_cache_root);
-  auto tbl = YAML::LoadFile(source).as<Table>();
-
   PredictionTable obj;
-  obj.source = source;
-
-  for (auto const &dv : tbl.dependent_vars) {
-
-    if (!dv.qualifiers.count("variable_type") ||
-        (dv.qualifiers.at("variable_type") != "cross_section_prediction")) {
-      continue;
-    }
-
-    if (ref.qualifier.size()) {
-      if (dv.name == ref.qualifier) {
-        obj.independent_vars = tbl.independent_vars;
-        obj.dependent_vars.push_back(dv);
-        break;
-      }
-    } else {
-      obj.independent_vars = tbl.independent_vars;
-      obj.dependent_vars.push_back(dv);
-      break;
-    }
-  }
-
-  if (!obj.dependent_vars.size()) {
-    throw std::runtime_error(fmt::format(
-        "When parsing PredictionTable from ref: \"{}\" failed to find a "
-        "valid dependent variable.",
-        ref.str()));
-  }
+  decode_selected_table(obj, ref, local_cache_root,
+                        {"cross_section_prediction"}, "PredictionTable");
 
   auto const &quals = obj.dependent_vars[0].qualifiers;
 
@@ -400,43 +394,12 @@ CrossSectionMeasurement
 make_CrossSectionMeasurement(ResourceReference ref,
                              std::filesystem::path const &local_cache_root) {
 
-  auto source = resolve_reference(ref, local_cache_root);
-  auto tbl = YAML::LoadFile(source).as<Table>();
-
   CrossSectionMeasurement obj;
-  obj.source = source;
+  decode_selected_table(obj, ref, local_cache_root,
+                        valid_variable_types, "CrossSectionMeasurement");
 
-  for (auto const &dv : tbl.dependent_vars) {
-
-    if (!dv.qualifiers.count("variable_type") ||
-        (!valid_variable_types.count(dv.qualifiers.at("variable_type")))) {
-      continue;
-    }
-
-    if (ref.qualifier.size()) {
-      if (dv.name == ref.qualifier) {
-        obj.independent_vars = tbl.independent_vars;
-        obj.dependent_vars.push_back(dv);
-        obj.is_composite = (dv.qualifiers.at("variable_type") ==
-                            "composite_cross_section_measurement");
-        break;
-      }
-    } else {
-      obj.independent_vars = tbl.independent_vars;
-      obj.dependent_vars.push_back(dv);
-      obj.is_composite = (dv.qualifiers.at("variable_type") ==
-                          "composite_cross_section_measurement");
-      break;
-    }
-  }
-
-  if (!obj.dependent_vars.size()) {
-    throw std::runtime_error(
-        fmt::format("When parsing CrossSectionMeasurement from ref: "
-                    "\"{}\" failed to find a "
-                    "valid dependent variable.",
-                    ref.str()));
-  }
+  obj.is_composite = (obj.dependent_vars[0].qualifiers.at("variable_type") ==
+                      "composite_cross_section_measurement");
 
   auto const &quals = obj.dependent_vars[0].qualifiers;
 
@@ -473,6 +436,7 @@ make_CrossSectionMeasurement(ResourceReference ref,
     obj.probe_fluxes.push_back(
         parse_probe_fluxes(probe_flux_spec, ref, local_cache_root));
   }
+  obj.combined_probe_fluxes = make_combined_probe_fluxes(obj);
 
   for (auto const &errors_spec :
        get_indexed_qualifier_values("errors", quals)) {
@@ -512,6 +476,14 @@ make_CrossSectionMeasurement(ResourceReference ref,
       obj.cross_section_units.insert(u);
     }
   }
+  try {
+    obj.normalisation = make_CrossSectionNormalisation(obj);
+  } catch (std::exception const &e) {
+    rec_log().warn("Measurement from ref: \"{}\" has no cross section "
+                   "normalisation: {}",
+                   ref.str(), e.what());
+    obj.normalisation = CrossSectionNormalisation{};
+  }
 
   obj.test_statistic = "chi2";
   if (quals.count("test_statistic")) {
@@ -529,13 +501,29 @@ make_CrossSectionMeasurement(ResourceReference ref,
   return obj;
 }
 
+// An incrementally fetched record may not hold all of the files listed in its
+// submission.yaml yet, resolving them as resources fetches them if needed.
+static std::filesystem::path
+ensure_record_file(Record const &rec, std::string const &location,
+                   std::filesystem::path const &local_cache_root) {
+  auto expected_location = rec.record_root / location;
+  // path records and links to external resources can't be fetched
+  if (resource_exists(expected_location) ||
+      (rec.record_ref.reftype == "path") ||
+      (location.find("://") != std::string::npos)) {
+    return expected_location;
+  }
+  return resolve_reference(ResourceReference(location, rec.record_ref),
+                           local_cache_root);
+}
+
 Record make_Record(ResourceReference ref,
                    std::filesystem::path const &local_cache_root) {
   Record obj;
 
   rec_log().debug("+ Parse record from reference: {}", ref.str());
 
-  ref = resolve_version(ref);
+  ref = resolve_version(ref, local_cache_root);
 
   obj.record_ref = ref.record_ref();
   auto submission = resolve_reference(obj.record_ref, local_cache_root);
@@ -545,7 +533,7 @@ Record make_Record(ResourceReference ref,
 
   std::vector<PredictionTable> predictions;
 
-  auto docs = YAML::LoadAllFromFile(submission.native());
+  auto docs = YAML::LoadAll(read_resource(submission));
 
   int doc_i = -1;
   for (auto const &doc : docs) {
@@ -554,8 +542,10 @@ Record make_Record(ResourceReference ref,
 
     if (doc["data_file"]) {
       auto data_file_path =
-          obj.record_root / doc["data_file"].as<std::string>();
-      auto tbl = YAML::LoadFile(data_file_path.native()).as<Table>();
+          ensure_record_file(obj, doc["data_file"].as<std::string>(),
+                             local_cache_root);
+      // only the metadata is needed to triage the dependent variables
+      auto tbl = load_Table_metadata(data_file_path);
 
       rec_log().debug("    + loading data_file: {}", data_file_path.native());
 
@@ -590,10 +580,15 @@ Record make_Record(ResourceReference ref,
     }
 
     for (auto const &addres : doc["additional_resources"]) {
-      auto expected_location =
-          obj.record_root / addres["location"].as<std::string>();
-      if (std::filesystem::exists(expected_location)) {
-        obj.additional_resources.push_back(expected_location);
+      // additional resources are optional, skip any that can't be found
+      try {
+        auto location = ensure_record_file(
+            obj, addres["location"].as<std::string>(), local_cache_root);
+        // they are for the user to open, so must be extracted from an archive
+        if (resource_exists(location)) {
+          obj.additional_resources.push_back(extract_resource(location));
+        }
+      } catch (std::exception const &) {
       }
     }
   }
@@ -619,4 +614,24 @@ Record make_Record(std::filesystem::path const &location,
   return make_Record(PathResourceReference(location), local_cache_root);
 }
 
+std::vector<std::variant<Record, std::exception_ptr>>
+make_Records(std::vector<ResourceReference> const &refs,
+             std::filesystem::path const &local_cache_root, size_t nworkers) {
+
+  std::vector<std::variant<Record, std::exception_ptr>> records(refs.size());
+
+  rec_log().debug("+ Loading {} records on {} threads", refs.size(),
+                  parallel_for_workers(refs.size(), nworkers));
+
+  parallel_for(refs.size(), nworkers, [&](size_t i, size_t) {
+    try {
+      records[i] = make_Record(refs[i], local_cache_root);
+    } catch (...) {
+      records[i] = std::current_exception();
+    }
+  });
+
+  return records;
+}
+
 } // namespace nuis::HEPData
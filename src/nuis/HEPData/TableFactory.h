@@ -3,7 +3,10 @@
 #include "nuis/HEPData/Record.h"
 #include "nuis/HEPData/ResourceReference.h"
 
+#include <exception>
 #include <filesystem>
+#include <variant>
+#include <vector>
 
 namespace nuis::HEPData {
 
@@ -30,4 +33,13 @@ Record make_Record(std::filesystem::path const &location,
 Record make_Record(ResourceReference ref,
                    std::filesystem::path const &local_cache_root = ".");
 
+// Loads each referenced record with make_Record on up to nworkers threads,
+// nworkers = 0 uses one thread per hardware core. The result for each
+// reference is either the Record or the exception thrown while loading it, in
+// the same order as refs.
+std::vector<std::variant<Record, std::exception_ptr>>
+make_Records(std::vector<ResourceReference> const &refs,
+             std::filesystem::path const &local_cache_root = ".",
+             size_t nworkers = 0);
+
 } // namespace nuis::HEPData
\ No newline at end of file
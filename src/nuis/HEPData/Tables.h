@@ -1,5 +1,6 @@
 #pragma once
 
+#include "nuis/HEPData/FluxHistogram.h"
 #include "nuis/HEPData/Variables.h"
 
 #include <filesystem>
@@ -16,6 +17,8 @@ struct Table {
 struct ProbeFlux : public Table {
   std::string probe_particle;
   std::string bin_content_type;
+  // the flux as a histogram of counts, empty if it could not be built
+  FluxHistogram histogram;
 };
 
 struct ErrorTable : public Table {
@@ -0,0 +1,116 @@
+#include "nuis/HEPData/TestStatistic.h"
+
+#include "nuis/HEPData/JointMeasurement.h"
+#include "nuis/HEPData/PoissonLikelihood.h"
+
+#include "fmt/core.h"
+
+#include <numeric>
+#include <stdexcept>
+
+namespace nuis::HEPData {
+
+namespace {
+
+std::vector<double> prediction_values(PredictionTable const &pred) {
+  std::vector<double> values;
+  for (auto const &v : pred.dependent_vars.at(0).values) {
+    if (v.value.index() != 1) {
+      throw std::runtime_error(
+          fmt::format("Prediction: {} has a binned dependent variable, "
+                      "expected a value per bin.",
+                      pred.source.native()));
+    }
+    values.push_back(std::get<double>(v.value));
+  }
+  return values;
+}
+
+double sum(std::vector<double> const &v) {
+  return std::accumulate(v.begin(), v.end(), 0.0);
+}
+
+} // namespace
+
+std::vector<double> smear_prediction(CrossSectionMeasurement const &xsm,
+                                     std::vector<double> const &truth) {
+  auto const &smearing = xsm.get_single_smearing();
+  if (smearing.smearing_type != "smearing_matrix") {
+    throw std::runtime_error(
+        fmt::format("Smearing table: {} has unsupported smearing_type: {}",
+                    smearing.source.native(), smearing.smearing_type));
+  }
+
+  size_t nsmeared = xsm.dependent_vars.at(0).values.size();
+  size_t ntrue = truth.size();
+  auto S = table_matrix(smearing, nsmeared, ntrue);
+
+  std::vector<double> smeared(nsmeared, 0);
+  for (size_t i = 0; i < nsmeared; ++i) {
+    for (size_t j = 0; j < ntrue; ++j) {
+      smeared[i] += S[i * ntrue + j] * truth[j];
+    }
+  }
+  return smeared;
+}
+
+double evaluate_test_statistic(CrossSectionMeasurement const &xsm,
+                               std::vector<double> const &prediction) {
+  auto const &test_statistic = xsm.test_statistic;
+
+  if (test_statistic == "poisson_pdf") {
+    return make_PoissonLikelihood(xsm).chi2(prediction);
+  }
+
+  auto jm = flatten_measurement(xsm);
+  if (prediction.size() != jm.data.size()) {
+    throw std::runtime_error(
+        fmt::format("Measurement: {} has {} bins, but the prediction has {}.",
+                    xsm.source.native(), jm.data.size(), prediction.size()));
+  }
+  auto chol = factorize(jm.covariance);
+
+  auto chi2 = [&](double scale) {
+    std::vector<double> r(prediction.size());
+    for (size_t i = 0; i < r.size(); ++i) {
+      r[i] = scale * prediction[i] - jm.data[i];
+    }
+    return chol.chi2(r);
+  };
+
+  if (test_statistic == "chi2") {
+    return chi2(1);
+  }
+
+  double data_sum = sum(jm.data), pred_sum = sum(prediction);
+  if (pred_sum == 0) {
+    throw std::runtime_error(fmt::format(
+        "Cannot evaluate {} for measurement: {} with a prediction that sums "
+        "to 0.",
+        test_statistic, xsm.source.native()));
+  }
+  double shape = chi2(data_sum / pred_sum);
+
+  if (test_statistic == "shape_only_chi2") {
+    return shape;
+  } else if (test_statistic == "shape_plus_norm_chi2") {
+    std::vector<double> ones(jm.data.size(), 1);
+    double norm_var = sum(jm.covariance.multiply(ones));
+    return shape + (pred_sum - data_sum) * (pred_sum - data_sum) / norm_var;
+  }
+
+  throw std::runtime_error(
+      fmt::format("Measurement: {} has unsupported test_statistic: {}",
+                  xsm.source.native(), test_statistic));
+}
+
+double evaluate_test_statistic(CrossSectionMeasurement const &xsm,
+                               PredictionTable const &pred) {
+  auto values = prediction_values(pred);
+  if (xsm.smearings.size() && !pred.pre_smeared) {
+    values = smear_prediction(xsm, values);
+  }
+  return evaluate_test_statistic(xsm, values);
+}
+
+} // namespace nuis::HEPData
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "nuis/HEPData/CrossSectionMeasurement.h"
+
+#include <vector>
+
+namespace nuis::HEPData {
+
+// Applies the smearing matrix of xsm to a prediction in the true binning. The
+// first independent variable of the smearing table gives the smeared bin and
+// the second the true bin, so smeared_i = sum_j S_ij truth_j. Throws if xsm
+// doesn't have exactly one smearing, or if the matrix doesn't map truth onto
+// the bins of the measurement.
+std::vector<double> smear_prediction(CrossSectionMeasurement const &xsm,
+                                     std::vector<double> const &truth);
+
+// The test_statistic declared by xsm between its data, flattened as by
+// flatten_measurement, and a prediction in the same binning.
+//   chi2: r^T C^-1 r, with r = prediction - data.
+//   shape_only_chi2: the chi2 after scaling the prediction to the same sum
+//     as the data.
+//   shape_plus_norm_chi2: the shape_only_chi2 plus ((P - D)/sigma)^2, where
+//     P and D are the prediction and data sums and sigma^2 is the sum of all
+//     elements of C.
+//   poisson_pdf: -2 ln(L/L_saturated), see PoissonLikelihood.
+double evaluate_test_statistic(CrossSectionMeasurement const &xsm,
+                               std::vector<double> const &prediction);
+
+// As above for a prediction table attached to xsm, which is smeared first if
+// xsm has a smearing and the prediction is not pre_smeared.
+double evaluate_test_statistic(CrossSectionMeasurement const &xsm,
+                               PredictionTable const &pred);
+
+} // namespace nuis::HEPData
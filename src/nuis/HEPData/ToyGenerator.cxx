@@ -0,0 +1,177 @@
+#include "nuis/HEPData/ToyGenerator.h"
+
+#include "nuis/HEPData/ParallelFor.h"
+
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+namespace nuis::HEPData {
+
+namespace {
+
+// Philox4x32-10 from Salmon et al., "Parallel random numbers: as easy as
+// 1, 2, 3", SC11.
+std::array<std::uint32_t, 4> philox(std::array<std::uint32_t, 4> ctr,
+                                    std::array<std::uint32_t, 2> key) {
+  constexpr std::uint64_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+  constexpr std::uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+  for (int round = 0; round < 10; ++round) {
+    std::uint64_t p0 = M0 * ctr[0], p1 = M1 * ctr[2];
+    ctr = {std::uint32_t(p1 >> 32) ^ ctr[1] ^ key[0], std::uint32_t(p1),
+           std::uint32_t(p0 >> 32) ^ ctr[3] ^ key[1], std::uint32_t(p0)};
+    key[0] += W0;
+    key[1] += W1;
+  }
+  return ctr;
+}
+
+// a uniform number in (0, 1) from the top 53 bits of x
+double open_uniform(std::uint64_t x) {
+  return (double(x >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+double sum(std::vector<double> const &v) {
+  return std::accumulate(v.begin(), v.end(), 0.0);
+}
+
+// Calls f(i, work) for each i in [0, n) on up to nworkers threads, each thread
+// has its own work vector.
+template <typename F> void for_each_toy(size_t n, size_t nworkers, F const &f) {
+  std::vector<std::vector<double>> work(parallel_for_workers(n, nworkers));
+  parallel_for(n, nworkers, [&](size_t i, size_t w) { f(i, work[w]); });
+}
+
+// toy = mean + L z, z must have room for the normals of the toy
+void throw_toy(ToyGenerator const &tg, size_t i, double *toy, double *z) {
+  tg.normals(i, z);
+  for (auto const &group : tg.factor.groups) {
+    size_t ng = group.indices.size();
+    for (size_t r = 0; r < ng; ++r) {
+      double const *Lr = group.L.data() + r * ng;
+      double s = 0;
+      for (size_t k = 0; k <= r; ++k) {
+        s += Lr[k] * z[group.indices[k]];
+      }
+      toy[group.indices[r]] = tg.mean[group.indices[r]] + s;
+    }
+  }
+}
+
+} // namespace
+
+size_t ToyGenerator::size() const { return mean.size(); }
+
+void ToyGenerator::normals(size_t i, double *z) const {
+  std::array<std::uint32_t, 2> key = {std::uint32_t(seed),
+                                      std::uint32_t(seed >> 32)};
+  std::uint64_t toy = i;
+  size_t n = size();
+  // each block of the counter gives two 64 bit uniforms, which Box-Muller
+  // turns into two normals
+  for (std::uint64_t block = 0; (2 * block) < n; ++block) {
+    auto bits = philox({std::uint32_t(block), std::uint32_t(block >> 32),
+                        std::uint32_t(toy), std::uint32_t(toy >> 32)},
+                       key);
+    double u1 = open_uniform((std::uint64_t(bits[0]) << 32) | bits[1]);
+    double u2 = open_uniform((std::uint64_t(bits[2]) << 32) | bits[3]);
+    double radius = std::sqrt(-2 * std::log(u1));
+    double angle = 6.283185307179586 * u2;
+    z[2 * block] = radius * std::cos(angle);
+    if ((2 * block + 1) < n) {
+      z[2 * block + 1] = radius * std::sin(angle);
+    }
+  }
+}
+
+std::vector<double> ToyGenerator::generate(size_t first, size_t ntoys,
+                                           size_t nworkers) const {
+  size_t n = size();
+  std::vector<double> toys(ntoys * n);
+  for_each_toy(ntoys, nworkers, [&](size_t t, std::vector<double> &work) {
+    work.resize(n);
+    throw_toy(*this, first + t, toys.data() + t * n, work.data());
+  });
+  return toys;
+}
+
+std::vector<double> ToyGenerator::test_statistics(size_t first, size_t ntoys,
+                                                  size_t nworkers) const {
+  size_t n = size();
+  std::vector<double> stats(ntoys);
+
+  // the toy residuals are L z, so the chi2 is just z^T z
+  if (test_statistic == "chi2") {
+    for_each_toy(ntoys, nworkers, [&](size_t t, std::vector<double> &work) {
+      work.resize(n);
+      normals(first + t, work.data());
+      double chi2 = 0;
+      for (auto z : work) {
+        chi2 += z * z;
+      }
+      stats[t] = chi2;
+    });
+    return stats;
+  }
+
+  bool with_norm = false;
+  if (test_statistic == "shape_plus_norm_chi2") {
+    with_norm = true;
+  } else if (test_statistic != "shape_only_chi2") {
+    throw std::runtime_error(
+        fmt::format("Cannot generate toy test statistics for test_statistic: "
+                    "{}, only chi2, shape_only_chi2, and shape_plus_norm_chi2 "
+                    "are supported.",
+                    test_statistic));
+  }
+
+  double pred_sum = sum(mean);
+  if (pred_sum == 0) {
+    throw std::runtime_error(fmt::format(
+        "Cannot generate toy {} distributions about a prediction that sums "
+        "to 0.",
+        test_statistic));
+  }
+  double norm_var =
+      with_norm ? sum(measurement.covariance.multiply(
+                      std::vector<double>(n, 1)))
+                : 0;
+
+  for_each_toy(ntoys, nworkers, [&](size_t t, std::vector<double> &work) {
+    work.resize(2 * n);
+    double *toy = work.data() + n;
+    throw_toy(*this, first + t, toy, work.data());
+    double data_sum = std::accumulate(toy, toy + n, 0.0);
+    double scale = data_sum / pred_sum;
+    for (size_t i = 0; i < n; ++i) {
+      toy[i] = scale * mean[i] - toy[i];
+    }
+    stats[t] = factor.chi2(std::vector<double>(toy, toy + n));
+    if (with_norm) {
+      stats[t] += (pred_sum - data_sum) * (pred_sum - data_sum) / norm_var;
+    }
+  });
+  return stats;
+}
+
+ToyGenerator make_ToyGenerator(CrossSectionMeasurement const &xsm,
+                               std::uint64_t seed,
+                               std::vector<double> const &prediction) {
+  auto jm = flatten_measurement(xsm);
+  if (prediction.size() && (prediction.size() != jm.data.size())) {
+    throw std::runtime_error(
+        fmt::format("Measurement: {} has {} bins, but the prediction has {}.",
+                    xsm.source.native(), jm.data.size(), prediction.size()));
+  }
+
+  auto chol = factorize(jm.covariance);
+  auto mean = prediction.size() ? prediction : jm.data;
+  return ToyGenerator{std::move(jm), std::move(chol), std::move(mean),
+                      xsm.test_statistic, seed};
+}
+
+} // namespace nuis::HEPData
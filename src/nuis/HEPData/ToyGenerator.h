@@ -0,0 +1,55 @@
+#pragma once
+
+#include "nuis/HEPData/BlockMatrix.h"
+#include "nuis/HEPData/JointMeasurement.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nuis::HEPData {
+
+// Throws toy data, x = mean + L z, from the covariance C = L L^T of a
+// measurement, flattened as by flatten_measurement, for calibrating its test
+// statistic. The covariance is factorised once when the generator is made.
+//
+// The standard normals z of toy i are drawn from the Philox4x32-10
+// counter-based generator keyed on seed with a counter of (i, element), so
+// each toy depends only on the seed and its index. Any range of toys can be
+// generated on any number of threads and give the same values.
+struct ToyGenerator {
+  JointMeasurement measurement;
+  BlockCholesky factor;
+  // the centre of the toys, either the data or a prediction
+  std::vector<double> mean;
+  std::string test_statistic;
+  std::uint64_t seed;
+
+  size_t size() const;
+
+  // The n standard normals of toy i.
+  void normals(size_t i, double *z) const;
+
+  // Toys [first, first + ntoys) laid out one after the other, toys are
+  // generated on up to nworkers threads, 0 uses one thread per hardware core.
+  std::vector<double> generate(size_t first, size_t ntoys,
+                               size_t nworkers = 1) const;
+
+  // The test_statistic of the measurement between each of toys
+  // [first, first + ntoys) as the data and mean as the prediction, which is
+  // the distribution of the test statistic if mean were the truth. Only the
+  // chi2, shape_only_chi2, and shape_plus_norm_chi2 test statistics are
+  // supported, as toys are thrown from the covariance.
+  std::vector<double> test_statistics(size_t first, size_t ntoys,
+                                      size_t nworkers = 1) const;
+};
+
+// Toys are centred on prediction, which must have a value for each bin of the
+// flattened measurement, or on the data of xsm if prediction is empty.
+// Throws if the covariance of xsm is not positive definite.
+ToyGenerator make_ToyGenerator(CrossSectionMeasurement const &xsm,
+                               std::uint64_t seed,
+                               std::vector<double> const &prediction = {});
+
+} // namespace nuis::HEPData
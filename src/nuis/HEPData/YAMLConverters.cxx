@@ -1,8 +1,16 @@
 #include "nuis/HEPData/YAMLConverters.h"
 #include "nuis/HEPData/Record.h"
+#include "nuis/HEPData/ReferenceResolver.h"
 
+#include "yaml-cpp/eventhandler.h"
 #include "yaml-cpp/yaml.h"
 
+#include "fmt/core.h"
+
+#include <optional>
+#include <sstream>
+#include <string_view>
+
 using namespace nuis;
 
 namespace YAML {
@@ -39,8 +47,13 @@ bool convert<HEPData::Value>::decode(const Node &node, HEPData::Value &val) {
   return true;
 }
 
-bool convert<HEPData::Variable>::decode(const Node &node,
-                                        HEPData::Variable &var) {
+} // namespace YAML
+
+namespace nuis::HEPData {
+
+// The header is decoded separately from the values so that metadata can be
+// inspected before committing to converting every value of a variable.
+static bool decode_Variable_header(YAML::Node const &node, Variable &var) {
   if (!node.IsMap() || !node["values"] || !node["header"]["name"]) {
     return false;
   }
@@ -50,35 +63,302 @@ bool convert<HEPData::Variable>::decode(const Node &node,
     var.units = node["header"]["units"].as<std::string>();
   }
 
-  for (auto const &val : node["values"]) {
-    var.values.push_back(val.as<HEPData::Value>());
+  return true;
+}
+
+static void decode_Variable_values(YAML::Node const &node, Variable &var) {
+  auto const &values = node["values"];
+  var.values.reserve(values.size());
+  for (auto const &val : values) {
+    var.values.push_back(val.as<Value>());
+  }
+}
+
+static bool decode_DependentVariable_header(YAML::Node const &node,
+                                            DependentVariable &var) {
+  if (!node.IsMap() || !node["qualifiers"] ||
+      !decode_Variable_header(node, var)) {
+    return false;
+  }
+
+  for (auto const &qual : node["qualifiers"]) {
+    auto const &qkey = qual["name"].as<std::string>();
+    var.qualifiers[qkey] = qual["value"].as<std::string>();
+
+    if (qkey == "prettyname") {
+      var.prettyname = var.qualifiers[qkey];
+    }
   }
 
   return true;
 }
 
-bool convert<HEPData::DependentVariable>::decode(
-    const Node &node, HEPData::DependentVariable &var) {
-  if (!node.IsMap() || !node["qualifiers"]) {
+bool decode_Table_selected(
+    YAML::Node const &node, Table &tbl,
+    std::function<bool(DependentVariable const &)> const &pred) {
+  if (!node.IsMap() || !node["dependent_variables"] ||
+      !node["independent_variables"]) {
     return false;
   }
 
-  auto const &ivar = node.as<HEPData::Variable>();
+  for (auto const &dvar : node["dependent_variables"]) {
+    DependentVariable dv;
+    // dependent variables without qualifiers cannot be selected by a
+    // predicate on their metadata, so skip them rather than fail
+    if (!decode_DependentVariable_header(dvar, dv) || !pred(dv)) {
+      continue;
+    }
 
-  var.name = ivar.name;
-  var.units = ivar.units;
-  var.values = ivar.values;
+    decode_Variable_values(dvar, dv);
+    tbl.dependent_vars.push_back(std::move(dv));
 
-  for (auto const &qual : node["qualifiers"]) {
-    auto const & qkey = qual["name"].as<std::string>();
-    var.qualifiers[qkey] =
-        qual["value"].as<std::string>();
+    tbl.independent_vars.reserve(node["independent_variables"].size());
+    for (auto const &ivar : node["independent_variables"]) {
+      tbl.independent_vars.push_back(ivar.as<Variable>());
+    }
+    break;
+  }
 
-    if(qkey == "prettyname"){
-      var.prettyname = var.qualifiers[qkey];
+  return true;
+}
+
+namespace {
+
+// Builds a YAML::Node tree from parser events, but replaces the contents of
+// every mapping value keyed 'values' with an empty sequence without building
+// nodes for them.
+class ValuelessNodeBuilder : public YAML::EventHandler {
+
+  struct Frame {
+    YAML::Node node;
+    std::optional<std::string> key;
+  };
+
+  std::vector<Frame> stack;
+  // non-zero while inside a skipped values block, tracks the nesting depth
+  size_t skip_depth;
+
+  void add(YAML::Node const &child) {
+    if (!stack.size()) {
+      root = child;
+      return;
+    }
+
+    auto &top = stack.back();
+    if (top.node.IsSequence()) {
+      top.node.push_back(child);
+    } else if (top.key) {
+      top.node[top.key.value()] = child;
+      top.key = std::nullopt;
+    } else if (child.IsScalar()) {
+      top.key = child.Scalar();
+    } else {
+      throw std::runtime_error(
+          "Encountered a non-scalar mapping key while scanning table.");
+    }
+  }
+
+  void start(YAML::NodeType::value type) {
+    if (skip_depth) {
+      skip_depth++;
+      return;
+    }
+
+    if (stack.size() && stack.back().node.IsMap() && stack.back().key &&
+        (stack.back().key.value() == "values")) {
+      add(YAML::Node(YAML::NodeType::Sequence));
+      skip_depth = 1;
+      return;
+    }
+
+    stack.push_back(Frame{YAML::Node(type), std::nullopt});
+  }
+
+  void end() {
+    if (skip_depth) {
+      skip_depth--;
+      return;
+    }
+
+    auto child = stack.back().node;
+    stack.pop_back();
+    add(child);
+  }
+
+public:
+  YAML::Node root;
+
+  ValuelessNodeBuilder() : skip_depth{0} {}
+
+  void OnDocumentStart(YAML::Mark const &) override {}
+  void OnDocumentEnd() override {}
+
+  void OnNull(YAML::Mark const &, YAML::anchor_t) override {
+    if (!skip_depth) {
+      add(YAML::Node(YAML::NodeType::Null));
+    }
+  }
+  void OnAlias(YAML::Mark const &, YAML::anchor_t) override {
+    if (!skip_depth) {
+      add(YAML::Node(YAML::NodeType::Null));
+    }
+  }
+  void OnScalar(YAML::Mark const &, std::string const &, YAML::anchor_t,
+                std::string const &value) override {
+    if (!skip_depth) {
+      add(YAML::Node(value));
     }
   }
 
+  void OnSequenceStart(YAML::Mark const &, std::string const &, YAML::anchor_t,
+                       YAML::EmitterStyle::value) override {
+    start(YAML::NodeType::Sequence);
+  }
+  void OnSequenceEnd() override { end(); }
+
+  void OnMapStart(YAML::Mark const &, std::string const &, YAML::anchor_t,
+                  YAML::EmitterStyle::value) override {
+    start(YAML::NodeType::Map);
+  }
+  void OnMapEnd() override { end(); }
+};
+
+// Removes the bodies of block-style 'values:' mappings line-by-line so that
+// the YAML scanner never has to tokenize them. HEPData tables are
+// conventionally written in block style, any flow-style values that are left
+// untouched are skipped by the ValuelessNodeBuilder instead.
+std::string strip_block_values(std::string const &doc) {
+  std::string stripped;
+  stripped.reserve(doc.size() / 4);
+
+  size_t key_indent = 0;
+  bool skipping = false;
+
+  size_t line_start = 0;
+  while (line_start < doc.size()) {
+    auto line_end = doc.find('\n', line_start);
+    if (line_end == std::string::npos) {
+      line_end = doc.size();
+    }
+    std::string_view line(doc.data() + line_start, line_end - line_start);
+    line_start = line_end + 1;
+
+    auto indent = line.find_first_not_of(' ');
+    if (indent == std::string_view::npos) { // blank line
+      continue;
+    }
+    auto content = line.substr(indent);
+
+    if (skipping) {
+      // block sequences are allowed at the same indentation as their key
+      if ((indent > key_indent) ||
+          ((indent == key_indent) &&
+           ((content == "-") || (content.substr(0, 2) == "- ")))) {
+        continue;
+      }
+      skipping = false;
+    }
+
+    // find the key column, allowing for the key to open a sequence entry
+    auto key_col = indent;
+    while (content.substr(0, 2) == "- ") {
+      auto next = content.find_first_not_of(' ', 2);
+      if (next == std::string_view::npos) {
+        break;
+      }
+      key_col += next;
+      content = content.substr(next);
+    }
+
+    auto trimmed = content.substr(0, content.find_last_not_of(" \r") + 1);
+    if (trimmed == "values:") {
+      stripped.append(line.data(), line.size() - content.size());
+      stripped.append("values: []\n");
+      key_indent = key_col;
+      skipping = true;
+      continue;
+    }
+
+    stripped.append(line.data(), line.size());
+    stripped.push_back('\n');
+  }
+
+  return stripped;
+}
+
+} // namespace
+
+Table load_Table_metadata(std::filesystem::path const &source) {
+  std::string doc;
+  try {
+    doc = read_resource(source);
+  } catch (std::exception const &) {
+    throw std::runtime_error(
+        fmt::format("Failed to open table file: {}", source.native()));
+  }
+
+  ValuelessNodeBuilder builder;
+  try {
+    std::istringstream iss(strip_block_values(doc));
+    YAML::Parser parser(iss);
+    parser.HandleNextDocument(builder);
+  } catch (YAML::Exception const &) {
+    // the line-based stripping is not a YAML parser, if it has mangled an
+    // unusually formatted document then fall back to scanning all of it
+    builder = ValuelessNodeBuilder();
+    std::istringstream iss(doc);
+    YAML::Parser parser(iss);
+    parser.HandleNextDocument(builder);
+  }
+
+  auto const &node = builder.root;
+  if (!node.IsMap() || !node["dependent_variables"] ||
+      !node["independent_variables"]) {
+    throw std::runtime_error(fmt::format(
+        "File: {} does not contain a valid HEPData table.", source.native()));
+  }
+
+  Table tbl;
+  tbl.source = source;
+
+  for (auto const &ivar : node["independent_variables"]) {
+    tbl.independent_vars.emplace_back();
+    decode_Variable_header(ivar, tbl.independent_vars.back());
+  }
+
+  for (auto const &dvar : node["dependent_variables"]) {
+    tbl.dependent_vars.emplace_back();
+    if (!decode_DependentVariable_header(dvar, tbl.dependent_vars.back())) {
+      decode_Variable_header(dvar, tbl.dependent_vars.back());
+    }
+  }
+
+  return tbl;
+}
+
+} // namespace nuis::HEPData
+
+namespace YAML {
+
+bool convert<HEPData::Variable>::decode(const Node &node,
+                                        HEPData::Variable &var) {
+  if (!HEPData::decode_Variable_header(node, var)) {
+    return false;
+  }
+
+  HEPData::decode_Variable_values(node, var);
+
+  return true;
+}
+
+bool convert<HEPData::DependentVariable>::decode(
+    const Node &node, HEPData::DependentVariable &var) {
+  if (!HEPData::decode_DependentVariable_header(node, var)) {
+    return false;
+  }
+
+  HEPData::decode_Variable_values(node, var);
+
   return true;
 }
 
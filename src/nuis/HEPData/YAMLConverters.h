@@ -1,5 +1,8 @@
 #pragma once
 
+#include <filesystem>
+#include <functional>
+
 namespace nuis::HEPData {
 struct Extent;
 struct Value;
@@ -34,4 +37,25 @@ template <> struct convert<nuis::HEPData::Table> {
   static bool decode(const Node &node, nuis::HEPData::Table &tbl);
 };
 
-} // namespace YAML
\ No newline at end of file
+} // namespace YAML
+
+namespace nuis::HEPData {
+
+// Decodes the table at node into tbl, but only materialises the first
+// dependent variable for which pred returns true. pred is passed a
+// DependentVariable with only the header and qualifiers decoded, the values of
+// all other dependent variables are never converted. The independent variables
+// are only decoded if a dependent variable is selected. Returns false if node
+// does not describe a valid table.
+bool decode_Table_selected(
+    YAML::Node const &node, Table &tbl,
+    std::function<bool(DependentVariable const &)> const &pred);
+
+// Reads the table in the file at source without building or converting the
+// values of any variable, the returned variables carry only their names,
+// units, and qualifiers. Dependent variables without qualifiers are included
+// with an empty qualifier map. Useful for queries and triage that only need
+// table metadata, where it is much cheaper than a full decode.
+Table load_Table_metadata(std::filesystem::path const &source);
+
+} // namespace nuis::HEPData
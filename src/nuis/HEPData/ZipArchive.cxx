@@ -0,0 +1,325 @@
+#include "nuis/HEPData/ZipArchive.h"
+
+#include "zlib.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+namespace nuis::HEPData {
+
+namespace {
+
+constexpr uint32_t kLocalHeaderSig = 0x04034b50;
+constexpr uint32_t kCentralHeaderSig = 0x02014b50;
+constexpr uint32_t kEOCDSig = 0x06054b50;
+constexpr uint32_t kZip64EOCDSig = 0x06064b50;
+constexpr uint32_t kZip64LocatorSig = 0x07064b50;
+
+constexpr size_t kLocalHeaderLength = 30;
+constexpr size_t kCentralHeaderLength = 46;
+constexpr size_t kEOCDLength = 22;
+constexpr size_t kZip64EOCDLength = 56;
+constexpr size_t kZip64LocatorLength = 20;
+
+// zip fields are little-endian whatever the host
+template <typename T> T read_le(std::string_view bytes, size_t pos) {
+  if ((pos + sizeof(T)) > bytes.size()) {
+    throw std::runtime_error(
+        fmt::format("zip record truncated reading {} bytes at {} of {}",
+                    sizeof(T), pos, bytes.size()));
+  }
+  T v = 0;
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    v |= T(uint8_t(bytes[pos + i])) << (8 * i);
+  }
+  return v;
+}
+
+} // namespace
+
+std::pair<uint64_t, uint64_t>
+locate_zip_central_directory(std::string_view tail, uint64_t archive_size) {
+  if (tail.size() < kEOCDLength) {
+    throw std::runtime_error(
+        fmt::format("{} bytes is too short to be a zip archive", tail.size()));
+  }
+  uint64_t tail_offset = archive_size - tail.size();
+
+  // the comment at the end is variable length, so search back for a
+  // signature whose comment length runs exactly to the end
+  size_t eocd = tail.size() - kEOCDLength;
+  while (true) {
+    if ((read_le<uint32_t>(tail, eocd) == kEOCDSig) &&
+        ((eocd + kEOCDLength + read_le<uint16_t>(tail, eocd + 20)) ==
+         tail.size())) {
+      break;
+    }
+    if (!eocd) {
+      throw std::runtime_error(
+          "failed to find the end of central directory record, not a zip "
+          "archive?");
+    }
+    eocd--;
+  }
+
+  uint64_t cd_size = read_le<uint32_t>(tail, eocd + 12);
+  uint64_t cd_offset = read_le<uint32_t>(tail, eocd + 16);
+
+  if ((cd_size == 0xFFFFFFFF) || (cd_offset == 0xFFFFFFFF)) {
+    if ((eocd < kZip64LocatorLength) ||
+        (read_le<uint32_t>(tail, eocd - kZip64LocatorLength) !=
+         kZip64LocatorSig)) {
+      throw std::runtime_error("zip64 archive is missing the zip64 end of "
+                               "central directory locator");
+    }
+    uint64_t z64_offset =
+        read_le<uint64_t>(tail, eocd - kZip64LocatorLength + 8);
+    if ((z64_offset < tail_offset) ||
+        ((z64_offset - tail_offset + kZip64EOCDLength) > tail.size())) {
+      throw std::runtime_error(
+          "zip64 end of central directory record lies outside of the tail");
+    }
+    size_t z64 = z64_offset - tail_offset;
+    if (read_le<uint32_t>(tail, z64) != kZip64EOCDSig) {
+      throw std::runtime_error(
+          "bad zip64 end of central directory record signature");
+    }
+    cd_size = read_le<uint64_t>(tail, z64 + 40);
+    cd_offset = read_le<uint64_t>(tail, z64 + 48);
+  }
+
+  if ((cd_offset + cd_size) > archive_size) {
+    throw std::runtime_error(fmt::format(
+        "central directory at {} + {} runs past the end of a {} byte archive",
+        cd_offset, cd_size, archive_size));
+  }
+
+  return {cd_offset, cd_size};
+}
+
+ZipCentralDirectory read_zip_central_directory(std::string_view cd_bytes,
+                                               uint64_t offset) {
+  ZipCentralDirectory cd{offset, cd_bytes.size(), {}};
+
+  size_t pos = 0;
+  while (pos < cd_bytes.size()) {
+    if (read_le<uint32_t>(cd_bytes, pos) != kCentralHeaderSig) {
+      throw std::runtime_error(fmt::format(
+          "bad central directory header signature at offset {}", pos));
+    }
+
+    ZipMember member;
+    member.compression_method = read_le<uint16_t>(cd_bytes, pos + 10);
+    member.crc32 = read_le<uint32_t>(cd_bytes, pos + 16);
+    member.compressed_size = read_le<uint32_t>(cd_bytes, pos + 20);
+    member.uncompressed_size = read_le<uint32_t>(cd_bytes, pos + 24);
+    size_t name_len = read_le<uint16_t>(cd_bytes, pos + 28);
+    size_t extra_len = read_le<uint16_t>(cd_bytes, pos + 30);
+    size_t comment_len = read_le<uint16_t>(cd_bytes, pos + 32);
+    member.local_header_offset = read_le<uint32_t>(cd_bytes, pos + 42);
+
+    size_t name_pos = pos + kCentralHeaderLength;
+    if ((name_pos + name_len + extra_len + comment_len) > cd_bytes.size()) {
+      throw std::runtime_error("central directory entry truncated");
+    }
+    member.name = std::string(cd_bytes.substr(name_pos, name_len));
+
+    // fields that overflowed 32 bits are stored in order in the zip64 extra
+    auto extra = cd_bytes.substr(name_pos + name_len, extra_len);
+    size_t epos = 0;
+    while ((epos + 4) <= extra.size()) {
+      auto id = read_le<uint16_t>(extra, epos);
+      size_t len = read_le<uint16_t>(extra, epos + 2);
+      if (id == 0x0001) {
+        auto z64 = extra.substr(epos + 4, len);
+        size_t zpos = 0;
+        for (uint64_t *field :
+             {&member.uncompressed_size, &member.compressed_size,
+              &member.local_header_offset}) {
+          if (*field == 0xFFFFFFFF) {
+            *field = read_le<uint64_t>(z64, zpos);
+            zpos += 8;
+          }
+        }
+      }
+      epos += 4 + len;
+    }
+
+    pos = name_pos + name_len + extra_len + comment_len;
+
+    // directories carry no data
+    if (member.name.size() && (member.name.back() == '/')) {
+      continue;
+    }
+    cd.members[member.name] = std::move(member);
+  }
+
+  return cd;
+}
+
+uint64_t zip_member_extent(ZipMember const &member,
+                           std::string_view local_header) {
+  if (local_header.size() < kLocalHeaderLength) {
+    // the local extra field is usually no longer than the central one, which
+    // is at most a zip64 extra and a timestamp
+    return kLocalHeaderLength + member.name.size() + 64 +
+           member.compressed_size;
+  }
+  if (read_le<uint32_t>(local_header, 0) != kLocalHeaderSig) {
+    throw std::runtime_error(
+        fmt::format("bad local header signature for zip member {}",
+                    member.name));
+  }
+  return kLocalHeaderLength + read_le<uint16_t>(local_header, 26) +
+         read_le<uint16_t>(local_header, 28) + member.compressed_size;
+}
+
+std::string extract_zip_member(ZipMember const &member,
+                               std::string_view local_bytes) {
+  auto extent = zip_member_extent(member, local_bytes);
+  if (local_bytes.size() < extent) {
+    throw std::runtime_error(
+        fmt::format("zip member {} truncated, have {} of {} bytes",
+                    member.name, local_bytes.size(), extent));
+  }
+  auto data = local_bytes.substr(extent - member.compressed_size,
+                                 member.compressed_size);
+
+  std::string out;
+  if (member.compression_method == 0) {
+    out = std::string(data);
+  } else if (member.compression_method == 8) {
+    out.resize(member.uncompressed_size);
+
+    z_stream strm{};
+    // negative window bits select a raw deflate stream, zip has no zlib
+    // header
+    if (inflateInit2(&strm, -MAX_WBITS) != Z_OK) {
+      throw std::runtime_error("failed to initialise zlib inflate");
+    }
+    strm.next_in =
+        reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    strm.next_out = reinterpret_cast<Bytef *>(out.data());
+
+    // avail_in/out are 32 bit, so feed large members through in chunks
+    constexpr uint64_t kChunk = std::numeric_limits<uInt>::max();
+    uint64_t in_left = data.size(), out_left = out.size();
+    int zerr = Z_OK;
+    while (zerr == Z_OK) {
+      if (!strm.avail_in) {
+        strm.avail_in = uInt(std::min(in_left, kChunk));
+        in_left -= strm.avail_in;
+      }
+      if (!strm.avail_out) {
+        strm.avail_out = uInt(std::min(out_left, kChunk));
+        out_left -= strm.avail_out;
+      }
+      zerr = inflate(&strm, Z_NO_FLUSH);
+      if ((zerr == Z_BUF_ERROR) && (in_left || out_left)) {
+        zerr = Z_OK;
+      }
+    }
+    auto total_out = strm.total_out;
+    inflateEnd(&strm);
+
+    if ((zerr != Z_STREAM_END) || (total_out != member.uncompressed_size)) {
+      throw std::runtime_error(fmt::format(
+          "failed to inflate zip member {}: zlib error {}, got {} of {} bytes",
+          member.name, zerr, total_out, member.uncompressed_size));
+    }
+  } else {
+    throw std::runtime_error(
+        fmt::format("zip member {} uses unsupported compression method {}",
+                    member.name, member.compression_method));
+  }
+
+  uLong crc = crc32(0L, Z_NULL, 0);
+  for (size_t pos = 0; pos < out.size();) {
+    auto len = uInt(std::min<size_t>(out.size() - pos,
+                                     std::numeric_limits<uInt>::max()));
+    crc = crc32(crc, reinterpret_cast<Bytef const *>(out.data() + pos), len);
+    pos += len;
+  }
+  if (crc != member.crc32) {
+    throw std::runtime_error(
+        fmt::format("CRC mismatch extracting zip member {}", member.name));
+  }
+
+  return out;
+}
+
+ZipArchiveFile::ZipArchiveFile(std::filesystem::path const &archive_path)
+    : path{archive_path}, bytes{}, cd{}, mapping{nullptr}, contents{} {
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error(
+        fmt::format("Failed to open zip archive: {}", path.native()));
+  }
+  struct stat st;
+  if ((::fstat(fd, &st) == 0) && (st.st_size > 0)) {
+    void *m = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (m != MAP_FAILED) {
+      mapping = m;
+      bytes = std::string_view(static_cast<char const *>(m), st.st_size);
+    }
+  }
+  ::close(fd);
+
+  if (!mapping) {
+    std::ifstream fin(path, std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(fin),
+                    std::istreambuf_iterator<char>());
+    bytes = contents;
+  }
+
+  try {
+    auto tail = bytes.substr(bytes.size() - std::min(bytes.size(),
+                                                     kZipMaxTailLength));
+    auto [cd_offset, cd_size] = locate_zip_central_directory(tail, bytes.size());
+    cd = read_zip_central_directory(bytes.substr(cd_offset, cd_size),
+                                    cd_offset);
+  } catch (std::exception const &e) {
+    if (mapping) {
+      ::munmap(mapping, bytes.size());
+    }
+    throw std::runtime_error(fmt::format("Failed to index zip archive: {}: {}",
+                                         path.native(), e.what()));
+  }
+}
+
+ZipArchiveFile::~ZipArchiveFile() {
+  if (mapping) {
+    ::munmap(mapping, bytes.size());
+  }
+}
+
+bool ZipArchiveFile::has_member(std::string const &name) const {
+  return cd.members.count(name);
+}
+
+std::string ZipArchiveFile::extract_member(std::string const &name) const {
+  auto member = cd.members.find(name);
+  if (member == cd.members.end()) {
+    throw std::runtime_error(fmt::format("zip archive: {} has no member: {}",
+                                         path.native(), name));
+  }
+  auto const &m = member->second;
+  if (m.local_header_offset > bytes.size()) {
+    throw std::runtime_error(fmt::format(
+        "zip member {} lies outside of archive: {}", name, path.native()));
+  }
+  return extract_zip_member(m, bytes.substr(m.local_header_offset));
+}
+
+} // namespace nuis::HEPData
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace nuis::HEPData {
+
+// Just enough of the zip format to read HEPData submission archives: stored
+// and deflated members, including the zip64 extensions. The functions below
+// work on byte ranges of an archive so that only the needed parts have to be
+// read, whether from a file or over the network.
+
+struct ZipMember {
+  std::string name;
+  uint16_t compression_method;
+  uint32_t crc32;
+  uint64_t compressed_size;
+  uint64_t uncompressed_size;
+  uint64_t local_header_offset;
+};
+
+struct ZipCentralDirectory {
+  uint64_t offset;
+  uint64_t size;
+  std::map<std::string, ZipMember> members;
+};
+
+// The end of central directory records always lie within this many bytes of
+// the end of an archive.
+constexpr size_t kZipMaxTailLength = 22 + 0xFFFF + 20 + 56;
+
+// Locates the central directory from the final bytes of an archive that is
+// archive_size bytes long, returns its offset and size.
+std::pair<uint64_t, uint64_t>
+locate_zip_central_directory(std::string_view tail, uint64_t archive_size);
+
+// Indexes the central directory bytes found at offset in the archive.
+ZipCentralDirectory read_zip_central_directory(std::string_view cd_bytes,
+                                               uint64_t offset);
+
+// The length of the local header plus the compressed data of member. The
+// local header length is only known once its fixed part has been read, until
+// then pass an empty local_header to get an estimate.
+uint64_t zip_member_extent(ZipMember const &member,
+                           std::string_view local_header = {});
+
+// Decompresses member from the archive bytes starting at its local header and
+// checks the CRC. Throws if the bytes are truncated or corrupt.
+std::string extract_zip_member(ZipMember const &member,
+                               std::string_view local_bytes);
+
+// A zip archive on disk opened for reading. The file is memory mapped, or
+// read into memory where it can't be mapped, and its central directory is
+// indexed on construction. Nothing is modified afterwards, so members can be
+// extracted from multiple threads at once.
+struct ZipArchiveFile {
+  std::filesystem::path path;
+  std::string_view bytes;
+  ZipCentralDirectory cd;
+
+  explicit ZipArchiveFile(std::filesystem::path const &archive_path);
+  ~ZipArchiveFile();
+
+  ZipArchiveFile(ZipArchiveFile const &) = delete;
+  ZipArchiveFile &operator=(ZipArchiveFile const &) = delete;
+
+  bool has_member(std::string const &name) const;
+  // throws if there is no member called name
+  std::string extract_member(std::string const &name) const;
+
+private:
+  void *mapping;
+  std::string contents;
+};
+
+} // namespace nuis::HEPData